@@ -0,0 +1,64 @@
+#include <string.h>
+#include "candle_ring.h"
+
+static candle_t *candle_ring_slot(candle_ring_t *ring, int i)
+{
+    return &ring->slots[(ring->head + i) % CANDLE_RING_SIZE];
+}
+
+void candle_ring_reset(candle_ring_t *ring)
+{
+    memset(ring, 0, sizeof(*ring));
+}
+
+void candle_ring_put(candle_ring_t *ring, const candle_t *candle)
+{
+    // Updates almost always hit the newest candle, so search backwards
+    for (int i = ring->count - 1; i >= 0; i--)
+    {
+        candle_t *slot = candle_ring_slot(ring, i);
+        if (slot->open_time_ms == candle->open_time_ms)
+        {
+            *slot = *candle;
+            return;
+        }
+        if (slot->open_time_ms < candle->open_time_ms)
+        {
+            if (i != ring->count - 1)
+            {
+                return; // Falls between two stored candles: a gap we cannot fill in order
+            }
+            break;
+        }
+    }
+    if (ring->count > 0 && candle->open_time_ms < candle_ring_slot(ring, 0)->open_time_ms)
+    {
+        return;
+    }
+
+    if (ring->count == CANDLE_RING_SIZE)
+    {
+        ring->head = (ring->head + 1) % CANDLE_RING_SIZE;
+        ring->count--;
+    }
+    *candle_ring_slot(ring, ring->count++) = *candle;
+}
+
+int candle_ring_count(const candle_ring_t *ring)
+{
+    return ring->count;
+}
+
+const candle_t *candle_ring_at(const candle_ring_t *ring, int i)
+{
+    if (i < 0 || i >= ring->count)
+    {
+        return NULL;
+    }
+    return &ring->slots[(ring->head + i) % CANDLE_RING_SIZE];
+}
+
+const candle_t *candle_ring_last(const candle_ring_t *ring)
+{
+    return candle_ring_at(ring, ring->count - 1);
+}
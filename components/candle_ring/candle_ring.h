@@ -0,0 +1,55 @@
+#ifndef CANDLE_RING_H
+#define CANDLE_RING_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+// Candles kept per series, a few more than any window drawn from them
+#ifndef CANDLE_RING_SIZE
+#define CANDLE_RING_SIZE 32
+#endif
+
+    typedef struct
+    {
+        int64_t open_time_ms;
+        double open;
+        double high;
+        double low;
+        double close;
+        double volume; // in the base asset
+    } candle_t;
+
+    /*
+     * Candles ordered by open time, oldest first. Once full, appending a
+     * new candle drops the oldest one.
+     */
+    typedef struct
+    {
+        candle_t slots[CANDLE_RING_SIZE];
+        uint16_t head; // slot of the oldest candle
+        uint16_t count;
+    } candle_ring_t;
+
+    void candle_ring_reset(candle_ring_t *ring);
+    /*
+     * Store a candle: one with the open time of a stored candle replaces
+     * it (the still-open candle changes until it closes), a newer one is
+     * appended. Candles that would go before or between stored ones are
+     * dropped.
+     */
+    void candle_ring_put(candle_ring_t *ring, const candle_t *candle);
+    int candle_ring_count(const candle_ring_t *ring);
+    // i-th candle from the oldest, NULL when out of range
+    const candle_t *candle_ring_at(const candle_ring_t *ring, int i);
+    // The newest candle, NULL when empty
+    const candle_t *candle_ring_last(const candle_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CANDLE_RING_H
@@ -0,0 +1,154 @@
+#include <math.h>
+#include "downsample.h"
+
+void downsample_init(downsample_t *ds, downsample_mode_t mode, int total, int64_t *out, int width)
+{
+    *ds = (downsample_t){
+        .mode = mode,
+        .out = out,
+        .width = width,
+        .total = total,
+    };
+    if (total > width)
+    {
+        // LTTB keeps the first and the last value outside the buckets
+        ds->buckets = mode == DOWNSAMPLE_LTTB ? width - 2 : width / 2;
+    }
+    if (ds->buckets < 1)
+    {
+        ds->buckets = 0; // short enough, or too narrow: values are copied
+    }
+}
+
+static void downsample_write(downsample_t *ds, int64_t value)
+{
+    if (ds->written < ds->width)
+    {
+        ds->out[ds->written++] = value;
+    }
+}
+
+// Twice the area of the triangle a, p, c, with c the bucket mean
+static double downsample_area(downsample_point_t a, downsample_point_t p, double cx, double cy)
+{
+    return fabs((double)(p.index - a.index) * (cy - a.value) - (cx - a.index) * (double)(p.value - a.value));
+}
+
+// LTTB: keep one extreme of the pending bucket, given where the series goes next
+static void downsample_select(downsample_t *ds, double cx, double cy)
+{
+    const downsample_bucket_t *b = &ds->pending;
+    downsample_point_t keep = b->min;
+    if (b->max.index != b->min.index &&
+        downsample_area(ds->kept, b->max, cx, cy) > downsample_area(ds->kept, b->min, cx, cy))
+    {
+        keep = b->max;
+    }
+    downsample_write(ds, keep.value);
+    ds->kept = keep;
+}
+
+// The current bucket is complete
+static void downsample_close(downsample_t *ds)
+{
+    downsample_bucket_t *b = &ds->current;
+    if (b->count == 0)
+    {
+        return;
+    }
+    if (ds->mode == DOWNSAMPLE_MINMAX)
+    {
+        downsample_point_t first = b->min.index < b->max.index ? b->min : b->max;
+        downsample_point_t second = b->min.index < b->max.index ? b->max : b->min;
+        // A flat bucket gives its value twice, so the output has a fixed width
+        downsample_write(ds, first.value);
+        downsample_write(ds, second.value);
+    }
+    else
+    {
+        if (ds->pending.count)
+        {
+            // A bucket holds consecutive indexes, so their mean is the midpoint
+            downsample_select(ds, b->first + (b->count - 1) / 2.0, b->sum / b->count);
+        }
+        ds->pending = *b;
+    }
+    *b = (downsample_bucket_t){0};
+}
+
+void downsample_push(downsample_t *ds, int64_t value)
+{
+    int64_t i = ds->pushed;
+    if (i >= ds->total)
+    {
+        return;
+    }
+    ds->pushed++;
+    downsample_point_t point = {i, value};
+    ds->last = point;
+    if (ds->buckets == 0)
+    {
+        downsample_write(ds, value);
+        return;
+    }
+    int bucket;
+    if (ds->mode == DOWNSAMPLE_LTTB)
+    {
+        if (i == 0)
+        {
+            downsample_write(ds, value);
+            ds->kept = point;
+            return;
+        }
+        if (i == ds->total - 1)
+        {
+            return; // written by downsample_finish()
+        }
+        bucket = (int)((i - 1) * ds->buckets / (ds->total - 2));
+    }
+    else
+    {
+        bucket = (int)(i * ds->buckets / ds->total);
+    }
+    if (bucket != ds->bucket)
+    {
+        downsample_close(ds);
+        ds->bucket = bucket;
+    }
+    downsample_bucket_t *b = &ds->current;
+    if (b->count == 0)
+    {
+        b->first = i;
+    }
+    if (b->count == 0 || value < b->min.value)
+    {
+        b->min = point;
+    }
+    if (b->count == 0 || value > b->max.value)
+    {
+        b->max = point;
+    }
+    b->sum += (double)value;
+    b->count++;
+}
+
+int downsample_finish(downsample_t *ds)
+{
+    if (ds->buckets == 0 || ds->pushed == 0)
+    {
+        return ds->written;
+    }
+    downsample_close(ds);
+    if (ds->mode == DOWNSAMPLE_LTTB && ds->pushed > 1)
+    {
+        if (ds->pending.count)
+        {
+            downsample_select(ds, (double)ds->last.index, (double)ds->last.value);
+        }
+        if (ds->last.index > ds->kept.index)
+        {
+            downsample_write(ds, ds->last.value);
+        }
+    }
+    return ds->written;
+}
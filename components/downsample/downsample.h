@@ -0,0 +1,73 @@
+#ifndef DOWNSAMPLE_H
+#define DOWNSAMPLE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+    typedef enum
+    {
+        // The lowest and the highest value of each of width / 2 buckets, in
+        // the order they came in. Every spike survives.
+        DOWNSAMPLE_MINMAX,
+        // Largest-Triangle-Three-Buckets over the min and max of each
+        // bucket: keeps the first and last value and, for each bucket in
+        // between, whichever of its extremes spans the larger triangle with
+        // the value kept before it and the mean of the next bucket. Follows
+        // the shape of the series more closely than MINMAX.
+        DOWNSAMPLE_LTTB,
+    } downsample_mode_t;
+
+    typedef struct
+    {
+        int64_t index;
+        int64_t value;
+    } downsample_point_t;
+
+    // Extremes and running sum of one bucket
+    typedef struct
+    {
+        downsample_point_t min;
+        downsample_point_t max;
+        int64_t first; // index of the bucket's first value
+        double sum;    // of the values, for the LTTB mean
+        int count;
+    } downsample_bucket_t;
+
+    /*
+     * Reduces a series of known length to at most `width` values in one
+     * pass, seeing each value once and keeping a constant amount of state,
+     * so the series itself is never stored. Values are in any fixed point
+     * unit, like the ones kline_chart_render() draws.
+     */
+    typedef struct
+    {
+        downsample_mode_t mode;
+        int64_t *out;
+        int width;
+        int total;  // values expected
+        int pushed; // values seen so far
+        int written;
+        int bucket; // bucket the next value falls in
+        int buckets;
+        downsample_bucket_t current;
+        downsample_bucket_t pending; // LTTB: waits for the mean of the next bucket
+        downsample_point_t kept;     // LTTB: the value chosen last
+        downsample_point_t last;
+    } downsample_t;
+
+    // `total` values will be pushed; out receives up to `width` of them
+    void downsample_init(downsample_t *ds, downsample_mode_t mode, int total, int64_t *out, int width);
+    void downsample_push(downsample_t *ds, int64_t value);
+    // Flush the last buckets. Returns the number of values in out, which is
+    // fewer than width when fewer than `total` values were pushed.
+    int downsample_finish(downsample_t *ds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DOWNSAMPLE_H
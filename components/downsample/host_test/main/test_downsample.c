@@ -0,0 +1,271 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "downsample.h"
+
+#define SERIES_MAX 2000
+#define WIDTH_MAX 64
+#define BENCH_VALUES 2000000
+
+static int64_t series[SERIES_MAX];
+static int64_t out[WIDTH_MAX + 1];
+static int64_t expected[WIDTH_MAX];
+static uint32_t seed;
+
+void setUp(void)
+{
+    seed = 1;
+}
+
+void tearDown(void)
+{
+}
+
+static uint32_t next_random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+// A random walk with the odd spike, in 1e-8 units around 2450.00
+static void fill_series(int total)
+{
+    int64_t value = 245000000000LL;
+    for (int i = 0; i < total; i++)
+    {
+        value += (int64_t)(next_random() % 2000001) - 1000000;
+        series[i] = next_random() % 50 ? value : value + ((int64_t)(next_random() % 3) - 1) * 5000000000LL;
+    }
+}
+
+/*
+ * References: the documented algorithms over the whole series in memory,
+ * written for clarity rather than with the streaming state of downsample.c.
+ */
+
+// Index of the first lowest and the first highest value in [from, to)
+static void bucket_extremes(int from, int to, int *min, int *max)
+{
+    *min = from;
+    *max = from;
+    for (int i = from + 1; i < to; i++)
+    {
+        if (series[i] < series[*min])
+        {
+            *min = i;
+        }
+        if (series[i] > series[*max])
+        {
+            *max = i;
+        }
+    }
+}
+
+// First index of bucket b of `buckets` over `count` values
+static int bucket_start(int b, int buckets, int count)
+{
+    int i = 0;
+    while (i < count && (int64_t)i * buckets / count < b)
+    {
+        i++;
+    }
+    return i;
+}
+
+static int reference_minmax(int total, int width)
+{
+    if (total <= width || width / 2 < 1)
+    {
+        int n = total < width ? total : width;
+        memcpy(expected, series, n * sizeof(int64_t));
+        return n;
+    }
+    int buckets = width / 2;
+    int n = 0;
+    for (int b = 0; b < buckets; b++)
+    {
+        int min, max;
+        bucket_extremes(bucket_start(b, buckets, total), bucket_start(b + 1, buckets, total), &min, &max);
+        expected[n++] = series[min < max ? min : max];
+        expected[n++] = series[min < max ? max : min];
+    }
+    return n;
+}
+
+static double triangle(int a, int p, double cx, double cy)
+{
+    return fabs((double)(p - a) * (cy - series[a]) - (cx - a) * (double)(series[p] - series[a]));
+}
+
+static int reference_lttb(int total, int width)
+{
+    int buckets = width - 2;
+    if (total <= width || buckets < 1)
+    {
+        int n = total < width ? total : width;
+        memcpy(expected, series, n * sizeof(int64_t));
+        return n;
+    }
+    // Buckets cover indexes 1 .. total - 2
+    int inner = total - 2;
+    int n = 0;
+    int kept = 0;
+    expected[n++] = series[0];
+    for (int b = 0; b < buckets; b++)
+    {
+        int from = 1 + bucket_start(b, buckets, inner);
+        int to = 1 + bucket_start(b + 1, buckets, inner);
+        double cx = total - 1;
+        double cy = series[total - 1];
+        if (b + 1 < buckets)
+        {
+            int next_to = 1 + bucket_start(b + 2, buckets, inner);
+            double sum = 0;
+            for (int i = to; i < next_to; i++)
+            {
+                sum += series[i];
+            }
+            cx = to + (next_to - to - 1) / 2.0;
+            cy = sum / (next_to - to);
+        }
+        int min, max;
+        bucket_extremes(from, to, &min, &max);
+        kept = max != min && triangle(kept, max, cx, cy) > triangle(kept, min, cx, cy) ? max : min;
+        expected[n++] = series[kept];
+    }
+    expected[n++] = series[total - 1];
+    return n;
+}
+
+static int run_downsample(downsample_mode_t mode, int total, int width, int pushed)
+{
+    downsample_t ds;
+    out[width] = 0x5A5A5A5A; // guard past the end
+    downsample_init(&ds, mode, total, out, width);
+    for (int i = 0; i < pushed; i++)
+    {
+        downsample_push(&ds, series[i]);
+    }
+    int n = downsample_finish(&ds);
+    TEST_ASSERT_EQUAL_INT64(0x5A5A5A5A, out[width]);
+    return n;
+}
+
+static void check_against_reference(downsample_mode_t mode)
+{
+    static const int totals[] = {1, 2, 3, 19, 20, 21, 39, 40, 41, 100, 288, 1000, 1999};
+    static const int widths[] = {1, 2, 3, 4, 5, 19, 20, 21, 64};
+    for (int t = 0; t < (int)(sizeof(totals) / sizeof(totals[0])); t++)
+    {
+        for (int w = 0; w < (int)(sizeof(widths) / sizeof(widths[0])); w++)
+        {
+            int total = totals[t];
+            int width = widths[w];
+            fill_series(total);
+            int n = mode == DOWNSAMPLE_LTTB ? reference_lttb(total, width) : reference_minmax(total, width);
+            char message[48];
+            snprintf(message, sizeof(message), "total %d width %d", total, width);
+            TEST_ASSERT_EQUAL_INT_MESSAGE(n, run_downsample(mode, total, width, total), message);
+            TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected, out, n * sizeof(int64_t), message);
+        }
+    }
+}
+
+static void test_minmax_matches_reference(void)
+{
+    check_against_reference(DOWNSAMPLE_MINMAX);
+}
+
+static void test_lttb_matches_reference(void)
+{
+    check_against_reference(DOWNSAMPLE_LTTB);
+}
+
+// The highest and the lowest value of the series always survive MINMAX
+static void test_minmax_keeps_extremes(void)
+{
+    fill_series(1000);
+    series[137] = 0;
+    series[862] = INT64_MAX;
+    int n = run_downsample(DOWNSAMPLE_MINMAX, 1000, 20, 1000);
+    TEST_ASSERT_EQUAL_INT(20, n);
+    bool low = false, high = false;
+    for (int i = 0; i < n; i++)
+    {
+        low |= out[i] == 0;
+        high |= out[i] == INT64_MAX;
+    }
+    TEST_ASSERT_TRUE(low && high);
+}
+
+static void test_lttb_keeps_ends(void)
+{
+    fill_series(288);
+    int n = run_downsample(DOWNSAMPLE_LTTB, 288, 20, 288);
+    TEST_ASSERT_EQUAL_INT(20, n);
+    TEST_ASSERT_EQUAL_INT64(series[0], out[0]);
+    TEST_ASSERT_EQUAL_INT64(series[287], out[19]);
+}
+
+// A fetch that ends early: fewer values, none past width, no crash
+static void test_short_series(void)
+{
+    fill_series(288);
+    for (int pushed = 0; pushed < 288; pushed += 7)
+    {
+        TEST_ASSERT_LESS_OR_EQUAL(20, run_downsample(DOWNSAMPLE_MINMAX, 288, 20, pushed));
+        TEST_ASSERT_LESS_OR_EQUAL(20, run_downsample(DOWNSAMPLE_LTTB, 288, 20, pushed));
+    }
+    TEST_ASSERT_EQUAL_INT(0, run_downsample(DOWNSAMPLE_LTTB, 288, 20, 0));
+}
+
+// Values past `total` are ignored
+static void test_extra_values(void)
+{
+    fill_series(100);
+    int n = run_downsample(DOWNSAMPLE_LTTB, 50, 20, 100);
+    TEST_ASSERT_EQUAL_INT(20, n);
+    TEST_ASSERT_EQUAL_INT64(series[49], out[19]);
+}
+
+// Not a pass/fail test: the time per pushed value on this host
+static void bench_mode(downsample_mode_t mode, const char *name)
+{
+    fill_series(SERIES_MAX);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    downsample_t ds;
+    int64_t sink = 0;
+    for (int run = 0; run < BENCH_VALUES / SERIES_MAX; run++)
+    {
+        downsample_init(&ds, mode, SERIES_MAX, out, 20);
+        for (int i = 0; i < SERIES_MAX; i++)
+        {
+            downsample_push(&ds, series[i] + run);
+        }
+        sink += out[downsample_finish(&ds) - 1];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("downsample %s: %.2f ns per value, %d into 20 (%d)\n", name, ns / BENCH_VALUES, SERIES_MAX,
+           (int)(sink & 1));
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_minmax_matches_reference);
+    RUN_TEST(test_lttb_matches_reference);
+    RUN_TEST(test_minmax_keeps_extremes);
+    RUN_TEST(test_lttb_keeps_ends);
+    RUN_TEST(test_short_series);
+    RUN_TEST(test_extra_values);
+    bench_mode(DOWNSAMPLE_MINMAX, "minmax");
+    bench_mode(DOWNSAMPLE_LTTB, "lttb");
+    exit(UNITY_END());
+}
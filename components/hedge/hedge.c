@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <string.h>
+#include "hedge.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "metrics.h"
+#include "trace.h"
+
+#define TAG "HEDGE"
+
+#define HEDGE_AVERAGE_WEIGHT 8 // a new sample moves the averages 1/8 of the way
+#define HEDGE_LABELS_MAX 32
+_Static_assert(HEDGE_TASKS <= 24, "one event group bit per helper");
+
+typedef struct
+{
+    const char *name;
+    int64_t latency_us;     // moving average, of answers and of attempts overtaken by another backend
+    int32_t error_permille; // moving average of failed attempts
+    uint32_t samples;
+#if CONFIG_METRICS_ENABLE
+    char labels[HEDGE_LABELS_MAX];
+    metrics_counter_t attempts;
+    metrics_counter_t failures;
+    metrics_counter_t wins;
+    metrics_histogram_t latency;
+#endif
+} hedge_backend_t;
+
+/*
+ * A helper task and the attempt it runs. The caller that claimed the slot
+ * collects the result, or detaches when it no longer wants it; the helper
+ * then frees the slot itself once the attempt returns.
+ */
+typedef struct
+{
+    TaskHandle_t task;
+    StaticTask_t tcb;
+    StackType_t stack[HEDGE_TASK_STACK_SIZE];
+    hedge_attempt_fn_t attempt;
+    int backend;
+    uint32_t timeout_ms;
+    int64_t start_us;
+    atomic_bool cancel;
+    esp_err_t err;
+    bool busy;     // claimed, until collected or, once detached, finished
+    bool done;     // the attempt returned
+    bool detached; // nobody collects it
+    _Alignas(max_align_t) uint8_t result[HEDGE_RESULT_MAX];
+} hedge_slot_t;
+
+static hedge_backend_t s_backends[HEDGE_BACKENDS_MAX];
+static int s_backend_count;
+static hedge_slot_t s_slots[HEDGE_TASKS];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+// Bit i is set when slot i's attempt returns
+static EventGroupHandle_t s_done;
+static StaticEventGroup_t s_done_buf;
+
+METRICS_COUNTER_DEFINE(m_requests, "hedge_requests_total", "Requests run against the backends")
+METRICS_COUNTER_DEFINE(m_hedged, "hedge_hedged_total", "Requests that asked a second backend after the latency budget")
+METRICS_COUNTER_DEFINE(m_failovers, "hedge_failovers_total", "Backends asked after another one failed")
+METRICS_HISTOGRAM_DEFINE(m_request, "hedge_request_seconds", "Whole request, until the winning answer",
+                         METRICS_UNIT_NETWORK_US)
+
+int hedge_register(const char *name)
+{
+    taskENTER_CRITICAL(&s_lock);
+    int id = s_backend_count < HEDGE_BACKENDS_MAX ? s_backend_count++ : -1;
+    taskEXIT_CRITICAL(&s_lock);
+    if (id < 0)
+    {
+        ESP_LOGE(TAG, "No room for backend %s", name);
+        return -1;
+    }
+    hedge_backend_t *backend = &s_backends[id];
+    backend->name = name;
+#if CONFIG_METRICS_ENABLE
+    snprintf(backend->labels, sizeof(backend->labels), "backend=\"%s\"", name);
+    backend->attempts.base = (metrics_metric_t){"hedge_attempts_total", "Attempts sent to a backend", backend->labels,
+                                                METRICS_COUNTER};
+    backend->failures.base = (metrics_metric_t){"hedge_failures_total", "Attempts that failed", backend->labels,
+                                                METRICS_COUNTER};
+    backend->wins.base = (metrics_metric_t){"hedge_wins_total", "Requests a backend answered first",
+                                            backend->labels, METRICS_COUNTER};
+    backend->latency.base = (metrics_metric_t){"hedge_attempt_seconds", "Successful attempts", backend->labels,
+                                               METRICS_HISTOGRAM};
+    backend->latency.unit_us = METRICS_UNIT_NETWORK_US;
+    metrics_register(&backend->attempts.base);
+    metrics_register(&backend->failures.base);
+    metrics_register(&backend->wins.base);
+    metrics_register(&backend->latency.base);
+#endif
+    return id;
+}
+
+// Fold one attempt into the backend's averages. An overtaken attempt took
+// at least elapsed_us, which counts as its latency.
+static void hedge_note(int id, esp_err_t err, bool overtaken, int64_t elapsed_us)
+{
+    hedge_backend_t *backend = &s_backends[id];
+    bool failed = err != ESP_OK && !overtaken;
+    taskENTER_CRITICAL(&s_lock);
+    if (!failed)
+    {
+        backend->latency_us = backend->samples == 0
+                                  ? elapsed_us
+                                  : backend->latency_us + (elapsed_us - backend->latency_us) / HEDGE_AVERAGE_WEIGHT;
+    }
+    backend->error_permille += ((failed ? 1000 : 0) - backend->error_permille) / HEDGE_AVERAGE_WEIGHT;
+    backend->samples++;
+    taskEXIT_CRITICAL(&s_lock);
+
+    METRICS_ADD(backend->attempts, 1);
+    if (failed)
+    {
+        METRICS_ADD(backend->failures, 1);
+        ESP_LOGW(TAG, "%s failed (%s) after %lld ms", backend->name, esp_err_to_name(err), elapsed_us / 1000);
+    }
+    else if (!overtaken)
+    {
+        METRICS_OBSERVE(backend->latency, elapsed_us);
+    }
+}
+
+// Backends by expected time to an answer, registration order on ties
+static int hedge_order(int *order, uint32_t timeout_ms)
+{
+    int64_t score[HEDGE_BACKENDS_MAX];
+    taskENTER_CRITICAL(&s_lock);
+    int count = s_backend_count;
+    for (int i = 0; i < count; i++)
+    {
+        const hedge_backend_t *backend = &s_backends[i];
+        score[i] = backend->samples == 0
+                       ? 0
+                       : backend->latency_us + (int64_t)backend->error_permille * timeout_ms; // ms * 1/1000 = us
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    for (int i = 0; i < count; i++)
+    {
+        int j = i;
+        for (; j > 0 && score[order[j - 1]] > score[i]; j--)
+        {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    return count;
+}
+
+static void hedge_task(void *arg)
+{
+    hedge_slot_t *slot = arg;
+    EventBits_t bit = (EventBits_t)1 << (slot - s_slots);
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        TRACE_BEGIN("hedge_attempt");
+        esp_err_t err = slot->attempt(slot->backend, slot->result, &slot->cancel, slot->timeout_ms);
+        TRACE_END("hedge_attempt");
+        taskENTER_CRITICAL(&s_lock);
+        slot->err = err;
+        slot->done = true;
+        if (slot->detached)
+        {
+            slot->busy = false;
+        }
+        taskEXIT_CRITICAL(&s_lock);
+        xEventGroupSetBits(s_done, bit);
+    }
+}
+
+esp_err_t hedge_start(UBaseType_t priority, BaseType_t core_id)
+{
+    if (s_done != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_done = xEventGroupCreateStatic(&s_done_buf);
+    for (int i = 0; i < HEDGE_TASKS; i++)
+    {
+        hedge_slot_t *slot = &s_slots[i];
+        char name[16];
+        snprintf(name, sizeof(name), "hedge%d", i);
+        TaskHandle_t task = xTaskCreateStaticPinnedToCore(hedge_task, name, HEDGE_TASK_STACK_SIZE, slot, priority,
+                                                          slot->stack, &slot->tcb, core_id);
+        if (task == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to start %s", name);
+            return ESP_FAIL;
+        }
+        taskENTER_CRITICAL(&s_lock);
+        slot->task = task;
+        taskEXIT_CRITICAL(&s_lock);
+    }
+    return ESP_OK;
+}
+
+// An idle helper, or NULL when every one is busy
+static hedge_slot_t *hedge_claim(void)
+{
+    hedge_slot_t *slot = NULL;
+    taskENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < HEDGE_TASKS && slot == NULL; i++)
+    {
+        if (s_slots[i].task != NULL && !s_slots[i].busy)
+        {
+            slot = &s_slots[i];
+            slot->busy = true;
+            slot->done = false;
+            slot->detached = false;
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return slot;
+}
+
+static void hedge_launch(hedge_slot_t *slot, hedge_attempt_fn_t attempt, int backend, const void *result,
+                         size_t size, uint32_t timeout_ms)
+{
+    slot->attempt = attempt;
+    slot->backend = backend;
+    slot->timeout_ms = timeout_ms;
+    slot->start_us = esp_timer_get_time();
+    atomic_store(&slot->cancel, false);
+    memcpy(slot->result, result, size);
+    xTaskNotifyGive(slot->task);
+}
+
+static bool hedge_finished(hedge_slot_t *slot)
+{
+    taskENTER_CRITICAL(&s_lock);
+    bool done = slot->done;
+    taskEXIT_CRITICAL(&s_lock);
+    return done;
+}
+
+// Stop waiting for a slot: cancel its attempt and leave it to finish alone
+static void hedge_detach(hedge_slot_t *slot)
+{
+    atomic_store(&slot->cancel, true);
+    taskENTER_CRITICAL(&s_lock);
+    if (slot->done)
+    {
+        slot->busy = false;
+    }
+    else
+    {
+        slot->detached = true;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+static void hedge_release(hedge_slot_t *slot)
+{
+    taskENTER_CRITICAL(&s_lock);
+    slot->busy = false;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t hedge_run(hedge_attempt_fn_t attempt, void *result, size_t size, uint32_t budget_ms, uint32_t timeout_ms,
+                    int *winner)
+{
+    if (size > HEDGE_RESULT_MAX)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    int order[HEDGE_BACKENDS_MAX];
+    int count = hedge_order(order, timeout_ms);
+    if (count == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    TRACE_SCOPE("hedge_run");
+    METRICS_ADD(m_requests, 1);
+    int64_t start_us = esp_timer_get_time();
+    int64_t deadline_us = start_us + timeout_ms * 1000LL;
+    int64_t hedge_us = budget_ms && count > 1 ? start_us + budget_ms * 1000LL : INT64_MAX;
+    bool inline_only = budget_ms == 0 || s_done == NULL;
+    hedge_slot_t *active[2] = {NULL, NULL}; // at most two backends at once
+    int next = 0;
+    int won = -1;
+    esp_err_t err = ESP_ERR_TIMEOUT;
+
+    while (won < 0)
+    {
+        int64_t now = esp_timer_get_time();
+        int running = (active[0] != NULL) + (active[1] != NULL);
+        if (next == count)
+        {
+            hedge_us = INT64_MAX; // nobody left to ask
+        }
+        bool hedge = running == 1 && now >= hedge_us;
+        if ((running == 0 || hedge) && next < count && now < deadline_us)
+        {
+            int backend = order[next++];
+            if (hedge)
+            {
+                hedge_us = INT64_MAX; // one try: no helper now means no hedge for this request
+            }
+            uint32_t left_ms = (deadline_us - now) / 1000;
+            hedge_slot_t *slot = inline_only ? NULL : hedge_claim();
+            if (slot == NULL && running > 0)
+            {
+                next--; // no helper for the hedge, the backend stays up for a failover
+                continue;
+            }
+            if (hedge)
+            {
+                METRICS_ADD(m_hedged, 1);
+                ESP_LOGI(TAG, "No answer after %lu ms, asking %s too", (unsigned long)budget_ms,
+                         s_backends[backend].name);
+            }
+            else if (next > 1)
+            {
+                METRICS_ADD(m_failovers, 1);
+            }
+            if (slot != NULL)
+            {
+                hedge_launch(slot, attempt, backend, result, size, left_ms);
+                active[active[0] == NULL ? 0 : 1] = slot;
+            }
+            else
+            {
+                // Nothing else in flight, so the caller's task may as well run it
+                err = attempt(backend, result, NULL, left_ms);
+                hedge_note(backend, err, false, esp_timer_get_time() - now);
+                won = err == ESP_OK ? backend : -1;
+            }
+            continue;
+        }
+        if (running == 0)
+        {
+            break; // out of backends or out of time
+        }
+        if (now >= deadline_us)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                if (active[i] != NULL)
+                {
+                    hedge_note(active[i]->backend, ESP_ERR_TIMEOUT, false, now - active[i]->start_us);
+                    hedge_detach(active[i]);
+                    active[i] = NULL;
+                }
+            }
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+
+        // Bits are only a wake-up: a slot counts as finished by its done flag,
+        // so a bit left over from a detached attempt costs one extra pass
+        EventBits_t bits = 0;
+        for (int i = 0; i < 2; i++)
+        {
+            bits |= active[i] != NULL ? (EventBits_t)1 << (active[i] - s_slots) : 0;
+        }
+        int64_t wake_us = hedge_us < deadline_us ? hedge_us : deadline_us;
+        xEventGroupWaitBits(s_done, bits, pdTRUE, pdFALSE, pdMS_TO_TICKS((wake_us - now) / 1000) + 1);
+        for (int i = 0; i < 2 && won < 0; i++)
+        {
+            hedge_slot_t *slot = active[i];
+            if (slot == NULL || !hedge_finished(slot))
+            {
+                continue;
+            }
+            int64_t elapsed_us = esp_timer_get_time() - slot->start_us;
+            hedge_note(slot->backend, slot->err, false, elapsed_us);
+            err = slot->err;
+            if (err == ESP_OK)
+            {
+                memcpy(result, slot->result, size);
+                won = slot->backend;
+            }
+            hedge_release(slot);
+            active[i] = NULL;
+        }
+    }
+
+    // The answer is in, whatever is still running lost
+    for (int i = 0; i < 2; i++)
+    {
+        if (active[i] != NULL)
+        {
+            hedge_note(active[i]->backend, ESP_OK, true, esp_timer_get_time() - active[i]->start_us);
+            hedge_detach(active[i]);
+        }
+    }
+    int64_t end_us = esp_timer_get_time();
+    if (won >= 0)
+    {
+        METRICS_ADD(s_backends[won].wins, 1);
+        METRICS_OBSERVE(m_request, end_us - start_us);
+        if (winner)
+        {
+            *winner = won;
+        }
+        return ESP_OK;
+    }
+    return err;
+}
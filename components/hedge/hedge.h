@@ -0,0 +1,77 @@
+#ifndef HEDGE_H
+#define HEDGE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifndef HEDGE_BACKENDS_MAX
+#define HEDGE_BACKENDS_MAX 4
+#endif
+// Attempts that can run besides the callers' own tasks, over all callers
+#ifndef HEDGE_TASKS
+#define HEDGE_TASKS 2
+#endif
+#ifndef HEDGE_TASK_STACK_SIZE
+#define HEDGE_TASK_STACK_SIZE (5 * 1024) // same requests as a scheduler worker
+#endif
+// Largest result an attempt can hand back
+#ifndef HEDGE_RESULT_MAX
+#define HEDGE_RESULT_MAX 512
+#endif
+
+    /*
+     * Runs a request against interchangeable backends, e.g. two exchanges
+     * serving the same prices. Every backend keeps a moving average of its
+     * latency and error rate, and requests go to the one expected to answer
+     * first, counting an error as a whole timeout; one that has not been
+     * measured yet goes first, so each gets its turn. If that one has not answered
+     * within the latency budget, the next best backend is asked as well and
+     * whichever succeeds first wins; the other is cancelled. A backend that
+     * fails is replaced by the next one while time is left.
+     *
+     * Attempts run on a small pool of helper tasks and write into a result
+     * buffer of their own, so a cancelled attempt can finish in the
+     * background while its caller has already moved on. With no helper free
+     * the request runs on the caller's task, one backend after the other.
+     */
+
+    /*
+     * One attempt against a backend. result starts as a copy of the
+     * caller's result: the attempt reads its inputs from there and must set
+     * every output field itself. Once *cancel is set the result is no
+     * longer wanted and the attempt should give up soon. NULL when the
+     * attempt runs on the caller's task and cannot be cancelled.
+     */
+    typedef esp_err_t (*hedge_attempt_fn_t)(int backend, void *result, const atomic_bool *cancel,
+                                            uint32_t timeout_ms);
+
+    // Backend ids count up from 0 in registration order, -1 when full.
+    // name must stay valid; it labels the backend's metrics.
+    int hedge_register(const char *name);
+    // Start the helper tasks, pinned to core_id or tskNO_AFFINITY. Until
+    // then every request runs on its caller's task.
+    esp_err_t hedge_start(UBaseType_t priority, BaseType_t core_id);
+    /*
+     * Run attempt until one backend succeeds or timeout_ms is used up, and
+     * copy the winner's result into result (at most HEDGE_RESULT_MAX
+     * bytes). budget_ms is how long the first backend has before a second
+     * one is asked too. With 0 the attempts run on the caller's task, one
+     * after the other, and may write to the caller's data directly. winner,
+     * when not NULL, is set to the backend that answered.
+     */
+    esp_err_t hedge_run(hedge_attempt_fn_t attempt, void *result, size_t size, uint32_t budget_ms,
+                        uint32_t timeout_ms, int *winner);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEDGE_H
@@ -0,0 +1,249 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "hedge.h"
+#include "http_request.h"
+
+#define HEDGE_PRIORITY 5
+#define TIMEOUT_MS 2000
+#define BUDGET_MS 50
+#define FAST_MS 10
+#define SLOW_MS 300
+#define BENCH_REQUESTS 100
+#define BENCH_TAIL_EVERY 10 // every 10th primary answer takes SLOW_MS
+
+/*
+ * The first attempt of a request goes to the primary host and the second
+ * to the secondary one, whichever backend hedge_run() picked for them, so
+ * the tests set the latencies by role. http_request_mock.c delays each host
+ * by its own CRYPTOTAG_FIXTURE_LATENCY_MS_<HOST>.
+ */
+static const char *const urls[2] = {
+    "https://api.binance.com/api/v3/klines",
+    "https://quote.alltick.io/quote-b-api/kline",
+};
+static const char *const latency_vars[2] = {
+    "CRYPTOTAG_FIXTURE_LATENCY_MS_api_binance_com",
+    "CRYPTOTAG_FIXTURE_LATENCY_MS_quote_alltick_io",
+};
+
+// The attempts of one request. Static: a detached loser writes to it after
+// hedge_run() has returned.
+typedef struct
+{
+    atomic_int calls;
+    int backend[2];
+    esp_err_t err[2];
+    atomic_bool ended[2];
+    int64_t end_us[2];
+} request_t;
+
+// What hedge_run() copies to every attempt
+typedef struct
+{
+    request_t *request;
+    bool fail; // ask for a path that has no recording
+    bool deaf; // ignore the cancel flag
+    size_t bytes;
+} fetch_t;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void set_latency(int primary_ms, int secondary_ms)
+{
+    char value[16];
+    snprintf(value, sizeof(value), "%d", primary_ms);
+    setenv(latency_vars[0], value, 1);
+    snprintf(value, sizeof(value), "%d", secondary_ms);
+    setenv(latency_vars[1], value, 1);
+}
+
+static void count_bytes(void *ctx, const char *data, size_t len)
+{
+    *(size_t *)ctx += len;
+}
+
+static esp_err_t fetch(int backend, void *result, const atomic_bool *cancel, uint32_t timeout_ms)
+{
+    fetch_t *f = result;
+    request_t *request = f->request;
+    int nth = atomic_fetch_add(&request->calls, 1);
+    if (nth >= 2)
+    {
+        return ESP_FAIL; // runs on a helper, where an assert can't fail the test
+    }
+    request->backend[nth] = backend;
+    char url[96];
+    snprintf(url, sizeof(url), "%s%s", urls[nth], f->fail ? "/missing" : "");
+    f->bytes = 0;
+    esp_err_t err = http_get_stream_cancellable(url, timeout_ms, f->deaf ? NULL : cancel, count_bytes, &f->bytes);
+    request->err[nth] = err;
+    request->end_us[nth] = esp_timer_get_time();
+    atomic_store(&request->ended[nth], true);
+    return err;
+}
+
+// Run a request and return how long it took
+static int64_t run(request_t *request, fetch_t *f, uint32_t budget_ms, esp_err_t expect, int *winner)
+{
+    *request = (request_t){0};
+    f->request = request;
+    int64_t start_us = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(expect, hedge_run(fetch, f, sizeof(*f), budget_ms, TIMEOUT_MS, winner));
+    return esp_timer_get_time() - start_us;
+}
+
+// Wait until every attempt a request started has returned
+static void wait_attempts(request_t *request)
+{
+    for (int i = 0; i < atomic_load(&request->calls); i++)
+    {
+        while (!atomic_load(&request->ended[i]))
+        {
+            vTaskDelay(1);
+        }
+    }
+}
+
+static void test_primary_wins(void)
+{
+    static request_t request;
+    fetch_t f = {0};
+    int winner = -1;
+    set_latency(FAST_MS, FAST_MS);
+    int64_t us = run(&request, &f, BUDGET_MS * 4, ESP_OK, &winner);
+    TEST_ASSERT_EQUAL(1, atomic_load(&request.calls));
+    TEST_ASSERT_EQUAL(request.backend[0], winner);
+    TEST_ASSERT_LESS_THAN(BUDGET_MS * 4 * 1000, us);
+    TEST_ASSERT_GREATER_THAN(0, f.bytes);
+}
+
+static void test_hedge_wins(void)
+{
+    static request_t request;
+    fetch_t f = {0};
+    int winner = -1;
+    set_latency(SLOW_MS, FAST_MS);
+    int64_t us = run(&request, &f, BUDGET_MS, ESP_OK, &winner);
+    TEST_ASSERT_EQUAL(2, atomic_load(&request.calls));
+    TEST_ASSERT_EQUAL(request.backend[1], winner);
+    TEST_ASSERT_NOT_EQUAL(request.backend[0], request.backend[1]);
+    TEST_ASSERT_GREATER_OR_EQUAL(BUDGET_MS * 1000, us);
+    TEST_ASSERT_LESS_THAN(SLOW_MS * 1000, us);
+    wait_attempts(&request);
+}
+
+static void test_both_fail(void)
+{
+    static request_t request;
+    fetch_t f = {.fail = true};
+    int winner = -1;
+    set_latency(FAST_MS, FAST_MS);
+    run(&request, &f, BUDGET_MS, ESP_ERR_NOT_FOUND, &winner);
+    // The first failure fails over to the other backend straight away
+    TEST_ASSERT_EQUAL(2, atomic_load(&request.calls));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, request.err[0]);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, request.err[1]);
+    TEST_ASSERT_EQUAL(-1, winner);
+}
+
+static void test_loser_cancelled(void)
+{
+    static request_t request;
+    fetch_t f = {0};
+    set_latency(TIMEOUT_MS / 2, FAST_MS);
+    run(&request, &f, BUDGET_MS, ESP_OK, NULL);
+    int64_t won_us = esp_timer_get_time();
+    wait_attempts(&request);
+    // The slow primary gave up once cancelled, long before its answer or
+    // the timeout was due, and its helper is free again
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, request.err[0]);
+    TEST_ASSERT_LESS_THAN(SLOW_MS * 1000, request.end_us[0] - won_us);
+}
+
+static void test_detached_loser_holds_helper(void)
+{
+    static request_t losers[HEDGE_TASKS - 1];
+    static request_t request;
+    fetch_t deaf = {.deaf = true};
+    fetch_t f = {0};
+
+    // Losers that ignore the cancel keep all helpers but one busy
+    set_latency(TIMEOUT_MS / 2, FAST_MS);
+    for (int i = 0; i < HEDGE_TASKS - 1; i++)
+    {
+        run(&losers[i], &deaf, BUDGET_MS, ESP_OK, NULL);
+        TEST_ASSERT_FALSE(atomic_load(&losers[i].ended[0]));
+    }
+
+    // The last helper runs the primary; with none left for a hedge the
+    // request waits for it rather than failing
+    set_latency(SLOW_MS, FAST_MS);
+    int64_t us = run(&request, &f, BUDGET_MS, ESP_OK, NULL);
+    TEST_ASSERT_EQUAL(1, atomic_load(&request.calls));
+    TEST_ASSERT_GREATER_OR_EQUAL(SLOW_MS * 1000, us);
+    TEST_ASSERT_FALSE(atomic_load(&losers[0].ended[0]));
+
+    // Once the losers are done their helpers hedge again
+    for (int i = 0; i < HEDGE_TASKS - 1; i++)
+    {
+        wait_attempts(&losers[i]);
+    }
+    us = run(&request, &f, BUDGET_MS, ESP_OK, NULL);
+    TEST_ASSERT_EQUAL(2, atomic_load(&request.calls));
+    TEST_ASSERT_LESS_THAN(SLOW_MS * 1000, us);
+    wait_attempts(&request);
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// The primary answers in FAST_MS but every BENCH_TAIL_EVERY-th time in
+// SLOW_MS, the secondary always in FAST_MS. A budget of 0 never hedges.
+static void bench_latency(uint32_t budget_ms)
+{
+    static request_t request;
+    static int64_t us[BENCH_REQUESTS];
+    fetch_t f = {0};
+    for (int i = 0; i < BENCH_REQUESTS; i++)
+    {
+        set_latency(i % BENCH_TAIL_EVERY == BENCH_TAIL_EVERY - 1 ? SLOW_MS : FAST_MS, FAST_MS);
+        us[i] = run(&request, &f, budget_ms, ESP_OK, NULL);
+        wait_attempts(&request); // the next request starts on idle helpers
+    }
+    qsort(us, BENCH_REQUESTS, sizeof(us[0]), compare_us);
+    printf("hedge: budget %lu ms: p50 %.1f ms, p99 %.1f ms over %d requests\n", (unsigned long)budget_ms,
+           us[BENCH_REQUESTS / 2] / 1000.0, us[BENCH_REQUESTS * 99 / 100 - 1] / 1000.0, BENCH_REQUESTS);
+}
+
+void app_main(void)
+{
+    setenv("CRYPTOTAG_FIXTURES", FIXTURES_DIR, 1);
+    hedge_register("binance");
+    hedge_register("alltick");
+    ESP_ERROR_CHECK(hedge_start(HEDGE_PRIORITY, tskNO_AFFINITY));
+    UNITY_BEGIN();
+    RUN_TEST(test_primary_wins);
+    RUN_TEST(test_hedge_wins);
+    RUN_TEST(test_both_fail);
+    RUN_TEST(test_loser_cancelled);
+    RUN_TEST(test_detached_loser_holds_helper);
+    bench_latency(0);
+    bench_latency(BUDGET_MS);
+    exit(UNITY_END());
+}
@@ -1,29 +1,131 @@
+#include <string.h>
 #include "http_request.h"
 #include "esp_http_client.h"
 #include "esp_crt_bundle.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "trace.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/dns.h"
+#include "lwip/tcpip.h"
 
 #define TAG "HTTP_REQUEST"
 
+// Each idle TLS connection keeps its mbedTLS buffers (~20KB), so only the
+// hosts polled regularly should fit in the pool.
+#ifndef HTTP_POOL_SIZE
+#define HTTP_POOL_SIZE 3
+#endif
+#define HTTP_HOST_MAX 64
+#define HTTP_DEFAULT_TIMEOUT_MS 5000 // esp_http_client's own default
+#define HTTP_RESOLVE_MAX 4
+
 typedef struct
 {
-    char *buffer;
-    int length;
+    http_stream_cb_t on_data; // gets the body chunk by chunk
+    void *ctx;
+    int length; // body bytes received
+    const atomic_bool *cancel; // set by whoever no longer wants the response
+    bool cancelled;
+    bool connected;     // a new connection was opened for this request
+    int64_t start_us;   // esp_timer time the request started
+    int64_t connect_us; // DNS + TCP + TLS time when connected is set
+    int64_t header_us;  // time to the first response header
+    int64_t body_us;    // time to the first body byte
 } http_response_t;
 
+/*
+ * One keep-alive client per slot. The esp_http_client handle stays alive
+ * between requests, so its socket stays open and, once the server closes
+ * it, the saved TLS session ticket makes the reconnect an abbreviated
+ * handshake.
+ */
+typedef struct
+{
+    char host[HTTP_HOST_MAX]; // scheme://host[:port]
+    esp_http_client_handle_t client;
+    bool in_use;
+    int64_t last_used_us;
+} http_conn_t;
+
+static http_conn_t s_pool[HTTP_POOL_SIZE];
+static portMUX_TYPE s_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static http_stats_t s_stats;
+
+typedef struct
+{
+    char host[HTTP_HOST_MAX];
+    int64_t start_us;
+} http_lookup_t;
+
+// Handed to the TCP/IP task by http_resolve_ahead() while s_resolving is set
+static http_lookup_t s_lookups[HTTP_RESOLVE_MAX];
+static int s_lookup_count;
+static int s_lookups_pending;
+static http_resolved_cb_t s_resolved;
+static void *s_resolved_ctx;
+static atomic_bool s_resolving;
+
+// esp_http_client reports the connection only once it is up, so DNS, TCP
+// and TLS are one stage
+METRICS_HISTOGRAM_DEFINE(m_connect, "http_connect_seconds", "DNS + TCP + TLS time of new connections",
+                         METRICS_UNIT_NETWORK_US)
+METRICS_HISTOGRAM_DEFINE(m_first_byte, "http_first_byte_seconds", "Request sent to first response header",
+                         METRICS_UNIT_NETWORK_US)
+METRICS_HISTOGRAM_DEFINE(m_body, "http_body_seconds", "First to last body byte, parsing included",
+                         METRICS_UNIT_NETWORK_US)
+METRICS_HISTOGRAM_DEFINE(m_request, "http_request_seconds", "Whole GET, retries included", METRICS_UNIT_NETWORK_US)
+METRICS_COUNTER_DEFINE(m_requests, "http_requests_total", "GET requests")
+METRICS_COUNTER_DEFINE(m_failures, "http_failures_total", "GET requests that failed")
+METRICS_COUNTER_DEFINE(m_reconnects, "http_reconnects_total", "Kept-alive connections found closed and retried")
+METRICS_COUNTER_DEFINE(m_bytes, "http_received_bytes_total", "Response body bytes")
+METRICS_COUNTER_DEFINE(m_cancelled, "http_cancelled_total", "GET requests given up by their caller")
+
 static esp_err_t http_event_handler(esp_http_client_event_t *evt)
 {
     http_response_t *response = (http_response_t *)evt->user_data;
+    if (response && response->cancel && atomic_load(response->cancel))
+    {
+        // Close the socket under the client, its next read fails and
+        // esp_http_client_perform() returns
+        if (!response->cancelled)
+        {
+            TRACE_INSTANT("http_cancelled");
+            response->cancelled = true;
+            esp_http_client_cancel_request(evt->client);
+        }
+        return ESP_OK;
+    }
     switch (evt->event_id)
     {
+    case HTTP_EVENT_ON_CONNECTED:
+        TRACE_INSTANT("http_connected");
+        if (response)
+        {
+            response->connected = true;
+            response->connect_us = esp_timer_get_time() - response->start_us;
+        }
+        break;
+    case HTTP_EVENT_ON_HEADER:
+        if (response && response->header_us == 0)
+        {
+            TRACE_INSTANT("http_first_header");
+            response->header_us = esp_timer_get_time() - response->start_us;
+        }
+        break;
     case HTTP_EVENT_ON_DATA:
         // ESP_LOGI(TAG, "Received data, len=%d", evt->data_len);
-        if (evt->data && response)
+        if (response && response->body_us == 0)
+        {
+            response->body_us = esp_timer_get_time() - response->start_us;
+        }
+        if (evt->data && response && response->on_data)
         {
-            response->buffer = realloc(response->buffer, response->length + evt->data_len + 1);
-            memcpy(response->buffer + response->length, evt->data, evt->data_len);
+            TRACE_SCOPE("http_on_data");
+            response->on_data(response->ctx, evt->data, evt->data_len);
             response->length += evt->data_len;
-            response->buffer[response->length] = 0;
         }
         break;
     case HTTP_EVENT_ON_FINISH:
@@ -38,33 +140,306 @@ static esp_err_t http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-char *http_get(char *url)
+// Copy "https://host[:port]" out of a URL
+static void http_url_host(const char *url, char *host, size_t size)
+{
+    const char *p = strstr(url, "://");
+    p = p ? p + 3 : url;
+    p += strcspn(p, "/?#");
+    size_t len = p - url;
+    if (len >= size)
+    {
+        len = size - 1;
+    }
+    memcpy(host, url, len);
+    host[len] = 0;
+}
+
+static esp_http_client_handle_t http_client_create(const char *url)
 {
-    http_response_t response = {0};
     esp_http_client_config_t config = {
         .url = url,
         .crt_bundle_attach = esp_crt_bundle_attach,
         .event_handler = http_event_handler,
-        .user_data = &response,
         .buffer_size = 1024,
         .buffer_size_tx = 1024,
+        .keep_alive_enable = true,   // TCP keep-alive, notices dead peers
+        .save_client_session = true, // TLS session ticket for reconnects
     };
+    return esp_http_client_init(&config);
+}
+
+/*
+ * Take an idle pooled client for the URL's host. Prefers an open one for
+ * the same host, then an empty slot, then evicts the least recently used
+ * idle client. Returns NULL when every slot is busy.
+ */
+static http_conn_t *http_pool_acquire(const char *url)
+{
+    char host[HTTP_HOST_MAX];
+    http_url_host(url, host, sizeof(host));
+
+    http_conn_t *conn = NULL;
+    esp_http_client_handle_t evicted = NULL;
+    taskENTER_CRITICAL(&s_pool_lock);
+    int match = -1, empty = -1, lru = -1;
+    for (int i = 0; i < HTTP_POOL_SIZE; i++)
+    {
+        if (s_pool[i].in_use)
+        {
+            continue;
+        }
+        if (s_pool[i].client == NULL)
+        {
+            empty = empty < 0 ? i : empty;
+        }
+        else if (strcmp(s_pool[i].host, host) == 0)
+        {
+            match = match < 0 ? i : match;
+        }
+        else if (lru < 0 || s_pool[i].last_used_us < s_pool[lru].last_used_us)
+        {
+            lru = i;
+        }
+    }
+    int pick = match >= 0 ? match : empty >= 0 ? empty : lru;
+    if (pick >= 0)
+    {
+        conn = &s_pool[pick];
+        conn->in_use = true;
+        if (pick == lru)
+        {
+            evicted = conn->client;
+            conn->client = NULL;
+        }
+        strcpy(conn->host, host);
+    }
+    taskEXIT_CRITICAL(&s_pool_lock);
+
+    if (evicted)
+    {
+        esp_http_client_cleanup(evicted);
+    }
+    if (conn && conn->client == NULL)
+    {
+        conn->client = http_client_create(url);
+        if (conn->client == NULL)
+        {
+            conn->in_use = false;
+            return NULL;
+        }
+    }
+    return conn;
+}
+
+static void http_pool_release(http_conn_t *conn)
+{
+    taskENTER_CRITICAL(&s_pool_lock);
+    conn->last_used_us = esp_timer_get_time();
+    conn->in_use = false;
+    taskEXIT_CRITICAL(&s_pool_lock);
+}
+
+// Run one GET on a pooled connection, the body goes to response
+static esp_err_t http_perform(const char *url, int timeout_ms, http_response_t *response)
+{
+    TRACE_SCOPE("http_get");
+    http_conn_t *conn = http_pool_acquire(url);
+    http_conn_t oneshot = {0};
+    if (conn == NULL)
+    {
+        // Pool exhausted: fall back to a throwaway connection
+        conn = &oneshot;
+        conn->client = http_client_create(url);
+        if (conn->client == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    esp_err_t err = ESP_FAIL;
+    esp_http_client_set_user_data(conn->client, response);
+    esp_http_client_set_url(conn->client, url);
+    esp_http_client_set_timeout_ms(conn->client, timeout_ms > 0 ? timeout_ms : HTTP_DEFAULT_TIMEOUT_MS);
+    int64_t first_start_us = esp_timer_get_time();
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        response->connected = false;
+        response->start_us = esp_timer_get_time();
+        response->header_us = 0;
+        response->body_us = 0;
+        err = esp_http_client_perform(conn->client);
+        // Only a request that failed before any of the body arrived can be
+        // repeated without the caller seeing the data twice
+        if (err == ESP_OK || response->connected || response->length > 0 || response->cancelled || attempt > 0)
+        {
+            break;
+        }
+        // The kept-alive socket was closed by the server while idle:
+        // reconnect once, resuming the TLS session.
+        ESP_LOGW(TAG, "Reused connection to %s failed (%s), reconnecting", conn->host, esp_err_to_name(err));
+        esp_http_client_close(conn->client);
+        taskENTER_CRITICAL(&s_pool_lock);
+        s_stats.reconnects++;
+        taskEXIT_CRITICAL(&s_pool_lock);
+        METRICS_ADD(m_reconnects, 1);
+    }
+    int64_t end_us = esp_timer_get_time();
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_err_t err = esp_http_client_perform(client);
+    if (response->cancelled)
+    {
+        err = ESP_ERR_TIMEOUT;
+    }
+    int status = esp_http_client_get_status_code(conn->client);
+    if (err == ESP_OK && (status < 200 || status > 299))
+    {
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+
+    taskENTER_CRITICAL(&s_pool_lock);
+    s_stats.requests++;
+    if (response->connected)
+    {
+        s_stats.connects++;
+        s_stats.connect_us_last = response->connect_us;
+        s_stats.connect_us_total += response->connect_us;
+    }
+    else if (err == ESP_OK)
+    {
+        s_stats.reused++;
+    }
+    if (err != ESP_OK && !response->cancelled)
+    {
+        s_stats.failures++;
+    }
+    taskEXIT_CRITICAL(&s_pool_lock);
+
+    METRICS_ADD(m_requests, 1);
+    METRICS_ADD(m_bytes, response->length);
+    METRICS_OBSERVE(m_request, end_us - first_start_us);
+    if (response->connected)
+    {
+        METRICS_OBSERVE(m_connect, response->connect_us);
+    }
     if (err == ESP_OK)
     {
-        ESP_LOGI(TAG, "HTTP GET Status = %d, content_length = %lld",
-                 esp_http_client_get_status_code(client),
-                 esp_http_client_get_content_length(client));
+        // Headers come after the connection is up, whose time is counted above
+        METRICS_OBSERVE(m_first_byte, response->header_us - (response->connected ? response->connect_us : 0));
+        METRICS_OBSERVE(m_body, response->body_us ? end_us - response->start_us - response->body_us : 0);
+        ESP_LOGI(TAG, "HTTP GET Status = %d, content_length = %lld, %s in %lld ms",
+                 status, esp_http_client_get_content_length(conn->client),
+                 response->connected ? "new connection" : "reused connection",
+                 (end_us - response->start_us) / 1000);
+    }
+    else if (response->cancelled)
+    {
+        METRICS_ADD(m_cancelled, 1);
+        ESP_LOGW(TAG, "HTTP GET to %s cancelled after %lld ms", conn->host, (end_us - response->start_us) / 1000);
+        esp_http_client_close(conn->client);
+    }
+    else
+    {
+        METRICS_ADD(m_failures, 1);
+        ESP_LOGE(TAG, "HTTP GET request failed: %s, status = %d", esp_err_to_name(err), status);
+        esp_http_client_close(conn->client);
+    }
+
+    esp_http_client_set_user_data(conn->client, NULL);
+    if (conn == &oneshot)
+    {
+        esp_http_client_cleanup(conn->client);
     }
     else
     {
-        ESP_LOGE(TAG, "HTTP GET request failed: %s", esp_err_to_name(err));
-        free(response.buffer);
-        return NULL;
+        http_pool_release(conn);
     }
+    return err;
+}
 
-    esp_http_client_cleanup(client);
-    return response.buffer;
-}
\ No newline at end of file
+esp_err_t http_get_stream(const char *url, int timeout_ms, http_stream_cb_t on_data, void *ctx)
+{
+    return http_get_stream_cancellable(url, timeout_ms, NULL, on_data, ctx);
+}
+
+esp_err_t http_get_stream_cancellable(const char *url, int timeout_ms, const atomic_bool *cancel,
+                                      http_stream_cb_t on_data, void *ctx)
+{
+    http_response_t response = {
+        .on_data = on_data,
+        .ctx = ctx,
+        .cancel = cancel,
+    };
+    return http_perform(url, timeout_ms, &response);
+}
+
+void http_get_stats(http_stats_t *stats)
+{
+    taskENTER_CRITICAL(&s_pool_lock);
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_pool_lock);
+}
+
+static void http_lookup_done(const char *name, const ip_addr_t *addr, void *arg)
+{
+    http_lookup_t *lookup = (http_lookup_t *)arg;
+    if (addr)
+    {
+        ESP_LOGI(TAG, "Resolved %s in %lld ms", lookup->host, (esp_timer_get_time() - lookup->start_us) / 1000);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Could not resolve %s", lookup->host);
+    }
+    if (--s_lookups_pending == 0)
+    {
+        if (s_resolved)
+        {
+            s_resolved(s_resolved_ctx);
+        }
+        atomic_store(&s_resolving, false);
+    }
+}
+
+// lwIP's DNS API may only be called on the TCP/IP task
+static void http_lookup_start(void *arg)
+{
+    s_lookups_pending = s_lookup_count;
+    for (int i = 0; i < s_lookup_count; i++)
+    {
+        http_lookup_t *lookup = &s_lookups[i];
+        ip_addr_t addr;
+        lookup->start_us = esp_timer_get_time();
+        err_t err = dns_gethostbyname(lookup->host, &addr, http_lookup_done, lookup);
+        if (err != ERR_INPROGRESS)
+        {
+            // Cached already, or failed at once
+            http_lookup_done(lookup->host, err == ERR_OK ? &addr : NULL, lookup);
+        }
+    }
+}
+
+esp_err_t http_resolve_ahead(const char *const *hosts, int count, http_resolved_cb_t done, void *ctx)
+{
+    if (count <= 0 || count > HTTP_RESOLVE_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool idle = false;
+    if (!atomic_compare_exchange_strong(&s_resolving, &idle, true))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(s_lookups[i].host, sizeof(s_lookups[i].host), "%s", hosts[i]);
+    }
+    s_lookup_count = count;
+    s_resolved = done;
+    s_resolved_ctx = ctx;
+    if (tcpip_callback(http_lookup_start, NULL) != ERR_OK)
+    {
+        atomic_store(&s_resolving, false);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
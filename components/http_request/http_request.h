@@ -1,6 +1,43 @@
 #ifndef HTTP_REQUEST_H
 #define HTTP_REQUEST_H
 
-char *http_get(char *url);
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Connection pool counters. Reuse rate is reused / requests, the mean
+// handshake time (DNS + TCP + TLS) is connect_us_total / connects.
+typedef struct
+{
+    uint32_t requests;
+    uint32_t reused;     // served on an already open connection
+    uint32_t connects;   // new connections opened
+    uint32_t reconnects; // kept-alive connection found closed, retried
+    uint32_t failures;
+    int64_t connect_us_last;
+    int64_t connect_us_total;
+} http_stats_t;
+
+// Hand the body to on_data chunk by chunk as it arrives, nothing is
+// buffered. Fails on transport errors and non-2xx statuses. Connections
+// are kept alive per host and reused by later requests. timeout_ms <= 0
+// uses the default of 5 s.
+typedef void (*http_stream_cb_t)(void *ctx, const char *data, size_t len);
+esp_err_t http_get_stream(const char *url, int timeout_ms, http_stream_cb_t on_data, void *ctx);
+// Same, but given up once *cancel is set: nothing more reaches on_data,
+// the connection is dropped and the call fails with ESP_ERR_TIMEOUT. The
+// flag is looked at as the response comes in, so a request that gets no
+// answer at all still runs into its timeout.
+esp_err_t http_get_stream_cancellable(const char *url, int timeout_ms, const atomic_bool *cancel,
+                                      http_stream_cb_t on_data, void *ctx);
+void http_get_stats(http_stats_t *stats);
+// Look these host names up now, all at once, so the first requests to them
+// find the address in lwIP's DNS cache instead of each waiting for its own
+// lookup. Returns straight away; done(ctx), when not NULL, runs on the
+// TCP/IP task once every host has an answer. Up to 4 hosts, one batch at a
+// time.
+typedef void (*http_resolved_cb_t)(void *ctx);
+esp_err_t http_resolve_ahead(const char *const *hosts, int count, http_resolved_cb_t done, void *ctx);
 
 #endif // HTTP_REQUEST_H
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "http_request.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TAG "HTTP_REQUEST"
+
+/*
+ * Linux builds answer GETs from recorded responses instead of the network.
+ * https://host/path?query is served from $CRYPTOTAG_FIXTURES/host/path
+ * ("fixtures" when unset). The query is dropped, since it carries
+ * timestamps, except for a symbol= parameter: host/path.SYMBOL is tried
+ * first so each coin can have its own recording. When FILE.1, FILE.2, ...
+ * exist they are served in turn and the last one repeats, which replays a
+ * series of polls. $CRYPTOTAG_FIXTURE_LATENCY_MS delays every response,
+ * and $CRYPTOTAG_FIXTURE_LATENCY_MS_<HOST> (dots as underscores, e.g.
+ * CRYPTOTAG_FIXTURE_LATENCY_MS_api_binance_com) the ones from one host.
+ * A request cancelled while it waits gives up straight away, as one with
+ * its connection closed would.
+ */
+
+#define HTTP_FIXTURE_PATH_MAX 256
+#define HTTP_FIXTURE_CHUNK 512 // smaller than esp_http_client's buffer, splits tokens the same way
+#define HTTP_FIXTURE_REPLAYS 16
+#define HTTP_FIXTURE_POLL_MS 10 // how often a delayed response checks for a cancel
+
+typedef struct
+{
+    char path[HTTP_FIXTURE_PATH_MAX];
+    int served;
+} http_replay_t;
+
+static http_replay_t s_replays[HTTP_FIXTURE_REPLAYS];
+static int s_replay_count;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static http_stats_t s_stats;
+
+static bool http_fixture_exists(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f)
+    {
+        fclose(f);
+    }
+    return f != NULL;
+}
+
+// Next file of a numbered series, or path itself
+static void http_fixture_replay(char *path, size_t size)
+{
+    taskENTER_CRITICAL(&s_lock);
+    http_replay_t *replay = NULL;
+    for (int i = 0; i < s_replay_count && !replay; i++)
+    {
+        replay = strcmp(s_replays[i].path, path) == 0 ? &s_replays[i] : NULL;
+    }
+    if (!replay && s_replay_count < HTTP_FIXTURE_REPLAYS)
+    {
+        replay = &s_replays[s_replay_count++];
+        snprintf(replay->path, sizeof(replay->path), "%s", path);
+        replay->served = 0;
+    }
+    int next = replay ? ++replay->served : 1;
+    taskEXIT_CRITICAL(&s_lock);
+
+    char numbered[HTTP_FIXTURE_PATH_MAX + 12];
+    for (; next > 0; next--)
+    {
+        snprintf(numbered, sizeof(numbered), "%s.%d", path, next);
+        if (http_fixture_exists(numbered))
+        {
+            snprintf(path, size, "%s", numbered);
+            return;
+        }
+    }
+}
+
+static FILE *http_fixture_open(const char *url, const atomic_bool *cancel)
+{
+    const char *dir = getenv("CRYPTOTAG_FIXTURES");
+    const char *p = strstr(url, "://");
+    p = p ? p + 3 : url;
+    size_t len = strcspn(p, "?#");
+
+    char path[HTTP_FIXTURE_PATH_MAX];
+    const char *symbol = strstr(p, "symbol=");
+    if (symbol && (symbol[-1] == '?' || symbol[-1] == '&'))
+    {
+        symbol += strlen("symbol=");
+        snprintf(path, sizeof(path), "%s/%.*s.%.*s", dir ? dir : "fixtures", (int)len, p,
+                 (int)strcspn(symbol, "&#"), symbol);
+        if (!http_fixture_exists(path))
+        {
+            symbol = NULL;
+        }
+    }
+    if (!symbol)
+    {
+        snprintf(path, sizeof(path), "%s/%.*s", dir ? dir : "fixtures", (int)len, p);
+    }
+    http_fixture_replay(path, sizeof(path));
+
+    char name[HTTP_FIXTURE_PATH_MAX];
+    int prefix = snprintf(name, sizeof(name), "CRYPTOTAG_FIXTURE_LATENCY_MS_");
+    snprintf(name + prefix, sizeof(name) - prefix, "%.*s", (int)strcspn(p, "/:?#"), p);
+    for (char *c = name + prefix; *c; c++)
+    {
+        *c = *c == '.' || *c == '-' ? '_' : *c;
+    }
+    const char *latency = getenv(name);
+    if (latency == NULL)
+    {
+        latency = getenv("CRYPTOTAG_FIXTURE_LATENCY_MS");
+    }
+    for (int left_ms = latency ? atoi(latency) : 0; left_ms > 0 && !(cancel && atomic_load(cancel));
+         left_ms -= HTTP_FIXTURE_POLL_MS)
+    {
+        vTaskDelay(pdMS_TO_TICKS(left_ms < HTTP_FIXTURE_POLL_MS ? left_ms : HTTP_FIXTURE_POLL_MS));
+    }
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "No fixture %s for %s", path, url);
+    }
+    return f;
+}
+
+static void http_fixture_count(esp_err_t err)
+{
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.requests++;
+    if (err == ESP_OK)
+    {
+        s_stats.reused++;
+    }
+    else
+    {
+        s_stats.failures++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t http_get_stream(const char *url, int timeout_ms, http_stream_cb_t on_data, void *ctx)
+{
+    return http_get_stream_cancellable(url, timeout_ms, NULL, on_data, ctx);
+}
+
+esp_err_t http_get_stream_cancellable(const char *url, int timeout_ms, const atomic_bool *cancel,
+                                      http_stream_cb_t on_data, void *ctx)
+{
+    FILE *f = http_fixture_open(url, cancel);
+    if (f == NULL)
+    {
+        http_fixture_count(ESP_ERR_NOT_FOUND);
+        return ESP_ERR_NOT_FOUND;
+    }
+    char chunk[HTTP_FIXTURE_CHUNK];
+    size_t len;
+    esp_err_t err = ESP_OK;
+    while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    {
+        if (cancel && atomic_load(cancel))
+        {
+            ESP_LOGW(TAG, "GET %s cancelled", url);
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+        on_data(ctx, chunk, len);
+    }
+    fclose(f);
+    if (err == ESP_OK)
+    {
+        http_fixture_count(ESP_OK);
+    }
+    return err;
+}
+
+void http_get_stats(http_stats_t *stats)
+{
+    taskENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+// The host resolves names as it connects, there is no cache to warm up
+esp_err_t http_resolve_ahead(const char *const *hosts, int count, http_resolved_cb_t done, void *ctx)
+{
+    if (done)
+    {
+        done(ctx);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,255 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "i2c_lcd.h"
+#include "i2c_lcd_priv.h"
+#include "lcd_bus_mock.h"
+#include "sim_priv.h"
+
+#define SCL_SLOW_HZ 100000
+#define SCL_FAST_HZ 400000
+#define RENDER_PRIORITY 5
+#define ROUNDS (2 * LCD_MAX)
+#define HOG_FRAMES 10 // posted by display 0 per round
+#define BENCH_FRAMES 10
+
+// What the render task sent: consecutive transfers to one display are one
+// entry, so a frame is one entry
+typedef struct
+{
+    int order[4 * LCD_MAX];
+    int count; // may exceed the entries kept
+    uint32_t bytes[LCD_MAX];
+} bus_log_t;
+
+static uint8_t addresses[LCD_MAX];
+static int display_count;
+static char drawn[LCD_MAX][LCD_COLS + 1]; // last text drawn on row 0
+static bus_log_t bus_log;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static int display_index(uint8_t address)
+{
+    for (int i = 0; i < display_count; i++)
+    {
+        if (addresses[i] == address)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Stands in for the emulator once the render task runs. Called from that
+// task, so it only records.
+static esp_err_t log_sink(uint8_t address, const uint8_t *data, size_t len, void *ctx)
+{
+    int display = display_index(address);
+    if (display < 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (bus_log.count == 0 || bus_log.order[bus_log.count - 1] != display)
+    {
+        if (bus_log.count < (int)(sizeof(bus_log.order) / sizeof(bus_log.order[0])))
+        {
+            bus_log.order[bus_log.count] = display;
+        }
+        bus_log.count++;
+    }
+    bus_log.bytes[display] += len + 1;
+    return ESP_OK;
+}
+
+// Text that differs per display and frame, so every flush sends something
+static void draw(int display, int frame)
+{
+    snprintf(drawn[display], sizeof(drawn[display]), "display %d %-6d", display, frame);
+    lcd_fb_put_string(lcd_instance(display), 0, 0, drawn[display]);
+}
+
+// Draw and flush every display, with the scheduler suspended so the render
+// task finds them all pending in one pass. Display 0 flushes HOG_FRAMES
+// times, as a display redrawing all the time would.
+static void post_all(int round)
+{
+    vTaskSuspendAll();
+    for (int f = 0; f < HOG_FRAMES; f++)
+    {
+        draw(0, round * HOG_FRAMES + f);
+        lcd_fb_flush(lcd_instance(0));
+    }
+    for (int i = 1; i < display_count; i++)
+    {
+        draw(i, round);
+        lcd_fb_flush(lcd_instance(i));
+    }
+    xTaskResumeAll();
+}
+
+// With the logging sink a pass takes microseconds once nothing is pending
+static void wait_rendered(void)
+{
+    for (int i = 0; i < display_count; i++)
+    {
+        while (lcd_instance(i)->pending)
+        {
+            vTaskDelay(1);
+        }
+    }
+    vTaskDelay(pdMS_TO_TICKS(20));
+}
+
+static void test_probe(void)
+{
+    display_count = lcd_probe(NULL, addresses);
+    TEST_ASSERT_EQUAL(LCD_MAX, display_count);
+    for (int i = 0; i < display_count; i++)
+    {
+        TEST_ASSERT_EQUAL(LCD_I2C_ADDRESS - (LCD_MAX - 1) + i, addresses[i]);
+        lcd_config_t config = {
+            .address = addresses[i],
+            .scl_speed_hz = SCL_SLOW_HZ,
+        };
+        lcd_handle_t lcd;
+        TEST_ASSERT_EQUAL(ESP_OK, lcd_init(&config, &lcd));
+        TEST_ASSERT_TRUE(lcd == lcd_instance(i));
+        draw(i, 0);
+        lcd_fb_flush(lcd);
+    }
+    // Each display shows its own text
+    for (int i = 0; i < display_count; i++)
+    {
+        sim_screen_t screen;
+        sim_lcd_stats_t stats;
+        sim_lcd_snapshot(LCD_I2C_ADDRESS - addresses[i], screen, &stats);
+        TEST_ASSERT_EQUAL_STRING(drawn[i], screen[0]);
+        TEST_ASSERT_EQUAL(0, stats.violations);
+    }
+}
+
+static void test_round_robin(void)
+{
+    lcd_bus_mock_set_sink(log_sink, NULL);
+    lcd_bus_mock_set_source(NULL, NULL);
+    TEST_ASSERT_EQUAL(ESP_OK, lcd_render_start(RENDER_PRIORITY, tskNO_AFFINITY));
+    int first = -1;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        bus_log = (bus_log_t){0};
+        post_all(round);
+        wait_rendered();
+        // One frame from every display, the hog's newest, in turn from the
+        // display after the one the last pass started with
+        TEST_ASSERT_EQUAL(display_count, bus_log.count);
+        for (int i = 0; i < display_count; i++)
+        {
+            TEST_ASSERT_EQUAL((bus_log.order[0] + i) % display_count, bus_log.order[i]);
+        }
+        if (first >= 0)
+        {
+            TEST_ASSERT_EQUAL((first + 1) % display_count, bus_log.order[0]);
+        }
+        first = bus_log.order[0];
+        TEST_ASSERT_EQUAL_MEMORY(drawn[0], lcd_instance(0)->shown.text[0], LCD_COLS);
+    }
+}
+
+static void test_full_carries_over(void)
+{
+    // A full frame resends every DDRAM cell
+    const uint32_t full_bytes = LCD_ROWS * LCD_DDRAM_COLS * LCD_EXPANDER_STATES_PER_BYTE;
+    bus_log = (bus_log_t){0};
+    vTaskSuspendAll();
+    // Display 1's full redraw is superseded before the task takes it,
+    // display 2 only changes
+    lcd_fb_invalidate(lcd_instance(1));
+    draw(1, 1);
+    lcd_fb_flush(lcd_instance(1));
+    draw(1, 2);
+    lcd_fb_flush(lcd_instance(1));
+    draw(2, 2);
+    lcd_fb_flush(lcd_instance(2));
+    xTaskResumeAll();
+    wait_rendered();
+    TEST_ASSERT_GREATER_OR_EQUAL(full_bytes, bus_log.bytes[1]);
+    TEST_ASSERT_LESS_THAN(full_bytes, bus_log.bytes[2]);
+    TEST_ASSERT_EQUAL_MEMORY(drawn[1], lcd_instance(1)->shown.text[0], LCD_COLS);
+
+    // Once rendered it does not stick
+    bus_log = (bus_log_t){0};
+    vTaskSuspendAll();
+    draw(1, 3);
+    lcd_fb_flush(lcd_instance(1));
+    xTaskResumeAll();
+    wait_rendered();
+    TEST_ASSERT_LESS_THAN(full_bytes, bus_log.bytes[1]);
+}
+
+// The same price frame on the first `count` displays. Runs before the render
+// task starts, flushing from the drawing task: the mock bus completes each
+// transfer before it returns, so the task could not overlap them anyway.
+static void bench_displays(void)
+{
+    static const uint32_t speeds[] = {SCL_SLOW_HZ, SCL_FAST_HZ};
+    static const int counts[] = {1, 4, 8};
+    int frame = 0;
+    for (int s = 0; s < (int)(sizeof(speeds) / sizeof(speeds[0])); s++)
+    {
+        sim_lcd_set_speed(speeds[s]);
+        for (int i = 0; i < display_count; i++)
+        {
+            lcd_instance(i)->gap_states = lcd_gap_states(speeds[s]);
+        }
+        for (int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])) && counts[c] <= display_count; c++)
+        {
+            sim_screen_t screen;
+            sim_lcd_stats_t before, after;
+            sim_lcd_snapshot(0, screen, &before);
+            int64_t start_us = esp_timer_get_time();
+            for (int f = 0; f < BENCH_FRAMES; f++, frame++)
+            {
+                char price[LCD_COLS + 1], change[LCD_COLS + 1];
+                snprintf(price, sizeof(price), "ETH %-12.2f", 2450.0 + frame * 1.37);
+                snprintf(change, sizeof(change), "24h %+-11.2f%%", frame * 0.07 - 1.0);
+                for (int i = 0; i < counts[c]; i++)
+                {
+                    lcd_fb_put_string(lcd_instance(i), 0, 0, price);
+                    lcd_fb_put_string(lcd_instance(i), 1, 0, change);
+                    lcd_fb_flush(lcd_instance(i));
+                }
+            }
+            int64_t us = esp_timer_get_time() - start_us;
+            sim_lcd_snapshot(0, screen, &after);
+            printf("i2c_lcd: %d display(s) at %lu kHz: %.1f frames/s, %lu bus bytes per frame, %lu timing "
+                   "violations\n",
+                   counts[c], (unsigned long)(speeds[s] / 1000), BENCH_FRAMES * 1e6 / us,
+                   (unsigned long)((after.bytes - before.bytes) / BENCH_FRAMES),
+                   (unsigned long)(after.violations - before.violations));
+        }
+    }
+}
+
+void app_main(void)
+{
+    sim_lcd_attach(SCL_SLOW_HZ, LCD_MAX);
+    UNITY_BEGIN();
+    RUN_TEST(test_probe);
+    bench_displays();
+    RUN_TEST(test_round_robin);
+    RUN_TEST(test_full_carries_over);
+    exit(UNITY_END());
+}
@@ -1,30 +1,41 @@
 #include <stdio.h>
 #include "i2c_lcd.h"
+#include "i2c_lcd_priv.h"
+#include "lcd_bus.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "trace.h"
 
 #define TAG "I2C_LCD"
 
-// PCF8574T pin connections to the LCD
-#define LCD_BACKLIGHT 0x08 // P3
-#define LCD_EN 0x04        // P2
-#define LCD_RW 0x02        // P1
-#define LCD_RS 0x01        // P0
-
-static uint8_t backlight_state = LCD_BACKLIGHT;
-static i2c_port_t s_i2c_port; // Store the I2C port number
-
-static esp_err_t i2c_write_byte(uint8_t data)
-{
-    // ESP_LOGD(TAG, "Writing byte: 0x%02X", data);
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (LCD_I2C_ADDRESS << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, data | backlight_state, true);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(s_i2c_port, cmd, 1000 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(cmd);
+#define LCD_BUSY_FLAG 0x80
+// Status reads before giving up on a command and using the fallback delay
+#define LCD_BUSY_POLL_LIMIT 16
+
+// Fallback execution times when the busy flag can't be read. The datasheet
+// values are for fosc = 270kHz; these cover the 190kHz worst case.
+#define LCD_EXEC_CLEAR_US 2200 // clear display, return home
+#define LCD_EXEC_US 60         // everything else
+// The controller takes 40 ms to power up after VCC reaches 2.7 V
+#define LCD_POWER_UP_US 50000
+
+static struct lcd_dev s_lcds[LCD_MAX];
+static int s_lcd_count;
+
+METRICS_COUNTER_DEFINE(m_transactions, "lcd_i2c_transactions_total", "I2C transactions to the LCD")
+METRICS_COUNTER_DEFINE(m_bytes, "lcd_i2c_bytes_total", "Bytes on the wire to the LCD, address bytes included")
+
+static esp_err_t i2c_write_bytes(lcd_handle_t lcd, const uint8_t *data, size_t len)
+{
+    esp_err_t ret = lcd_bus_transmit(lcd->dev, data, len);
+    lcd->stats.transactions++;
+    lcd->stats.bytes += len + 1; // address byte included
+    METRICS_ADD(m_transactions, 1);
+    METRICS_ADD(m_bytes, len + 1);
     if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "I2C Write Error: %s", esp_err_to_name(ret));
@@ -32,100 +43,334 @@ static esp_err_t i2c_write_byte(uint8_t data)
     return ret;
 }
 
-static void lcd_send_four_bits(uint8_t data)
+esp_err_t lcd_burst_flush(lcd_burst_t *burst)
+{
+    esp_err_t ret = ESP_OK;
+    if (burst->len > 0)
+    {
+        TRACE_SCOPE("i2c_write");
+        ret = i2c_write_bytes(burst->lcd, burst->buf, burst->len);
+        burst->len = 0;
+    }
+    if (burst->err == ESP_OK)
+    {
+        burst->err = ret;
+    }
+    return ret;
+}
+
+// Flush and wait for the bus, for the blocking lcd_* calls
+static esp_err_t lcd_burst_sync(lcd_burst_t *burst)
+{
+    lcd_burst_flush(burst);
+    esp_err_t ret = lcd_bus_wait(burst->lcd->dev);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "I2C Write Error: %s", esp_err_to_name(ret));
+    }
+    if (burst->err == ESP_OK)
+    {
+        burst->err = ret;
+    }
+    return burst->err;
+}
+
+void lcd_burst_idle(lcd_burst_t *burst)
+{
+    if (burst->len + 1 > sizeof(burst->buf))
+    {
+        lcd_burst_flush(burst);
+    }
+    burst->buf[burst->len++] = burst->lcd->backlight_state;
+}
+
+void lcd_backlight_set(lcd_handle_t lcd, bool on)
+{
+    lcd->backlight_state = on ? LCD_BACKLIGHT : 0x00;
+}
+
+static void lcd_burst_nibble(lcd_burst_t *burst, uint8_t data)
 {
-    i2c_write_byte(data);
-    i2c_write_byte(data | LCD_EN);
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-    i2c_write_byte(data);
-    vTaskDelay(5 / portTICK_PERIOD_MS);
+    data |= burst->lcd->backlight_state;
+    burst->buf[burst->len++] = data;
+    burst->buf[burst->len++] = data | LCD_EN;
+    burst->buf[burst->len++] = data;
+}
+
+void lcd_burst_byte(lcd_burst_t *burst, uint8_t value, uint8_t mode)
+{
+    uint8_t gap = burst->lcd->gap_states;
+    if (burst->len + LCD_EXPANDER_STATES_PER_BYTE + gap > sizeof(burst->buf))
+    {
+        lcd_burst_flush(burst);
+    }
+    lcd_burst_nibble(burst, (value & 0xF0) | mode);
+    lcd_burst_nibble(burst, ((value << 4) & 0xF0) | mode);
+    for (int i = 0; i < gap; i++)
+    {
+        burst->buf[burst->len] = burst->buf[burst->len - 1]; // EN stays low
+        burst->len++;
+    }
 }
 
-void lcd_send_cmd(char cmd)
+uint8_t lcd_gap_states(uint32_t scl_speed_hz)
 {
-    uint8_t high_nibble = cmd & 0xF0;
-    uint8_t low_nibble = (cmd << 4) & 0xF0;
-    lcd_send_four_bits(high_nibble);
-    lcd_send_four_bits(low_nibble);
+    // 9 clocks per expander state, two of them already in the gap
+    uint32_t states = (LCD_EXEC_WORST_US * (scl_speed_hz / 1000) + 9000 - 1) / 9000;
+    if (states <= 2)
+    {
+        return 0;
+    }
+    return states - 2 < LCD_GAP_STATES_MAX ? states - 2 : LCD_GAP_STATES_MAX;
 }
 
-void lcd_send_data(char data)
+// Waits shorter than a tick spin: vTaskDelay() would round them down to
+// nothing, and the next command would reach the controller too early.
+static void lcd_delay_us(uint32_t us)
 {
-    uint8_t high_nibble = data & 0xF0;
-    uint8_t low_nibble = (data << 4) & 0xF0;
-    lcd_send_four_bits(high_nibble | LCD_RS);
-    lcd_send_four_bits(low_nibble | LCD_RS);
+    const uint32_t tick_us = portTICK_PERIOD_MS * 1000;
+    if (us >= tick_us)
+    {
+        vTaskDelay((us + tick_us - 1) / tick_us);
+    }
+    else
+    {
+        esp_rom_delay_us(us);
+    }
 }
 
-void lcd_clear(void)
+// Clock one nibble out of the LCD with RW high. The data pins are written
+// high first so the PCF8574 quasi-bidirectional port can be pulled low by
+// the controller, and the port is sampled while EN is high.
+static esp_err_t lcd_read_nibble(lcd_handle_t lcd, uint8_t *nibble)
 {
-    lcd_send_cmd(0x01); // Clear screen
-    vTaskDelay(10 / portTICK_PERIOD_MS);
+    uint8_t states[] = {
+        0xF0 | LCD_RW | lcd->backlight_state,
+        0xF0 | LCD_RW | LCD_EN | lcd->backlight_state,
+    };
+    uint8_t port = 0;
+    esp_err_t ret = lcd_bus_transmit_receive(lcd->dev, states, sizeof(states), &port);
+    lcd->stats.transactions++;
+    lcd->stats.bytes += sizeof(states) + 3; // two address bytes, one read back
+    METRICS_ADD(m_transactions, 1);
+    METRICS_ADD(m_bytes, sizeof(states) + 3);
+    *nibble = port & 0xF0;
+    return ret;
 }
 
-void lcd_put_cur(int row, int col)
+// Busy flag in bit 7, address counter in bits 6..0
+static esp_err_t lcd_read_status(lcd_handle_t lcd, uint8_t *status)
+{
+    uint8_t high = 0, low = 0;
+    esp_err_t ret = lcd_read_nibble(lcd, &high);
+    if (ret == ESP_OK)
+    {
+        ret = lcd_read_nibble(lcd, &low);
+    }
+    uint8_t idle = 0xF0 | LCD_RW | lcd->backlight_state; // Drop EN again
+    i2c_write_bytes(lcd, &idle, 1);
+    *status = high | (low >> 4);
+    return ret;
+}
+
+// Wait until the controller has executed the last command: poll the busy
+// flag when read-back is enabled, otherwise sleep the datasheet time.
+static void lcd_wait_ready(lcd_handle_t lcd, uint32_t fallback_us)
+{
+    TRACE_SCOPE("lcd_wait_ready");
+    lcd_bus_wait(lcd->dev);
+    if (lcd->busy_poll)
+    {
+        int i;
+        for (i = 0; i < LCD_BUSY_POLL_LIMIT; i++)
+        {
+            uint8_t status = 0;
+            esp_err_t ret = lcd_read_status(lcd, &status);
+            if (ret != ESP_OK)
+            {
+                ESP_LOGW(TAG, "Busy flag read failed (%s), using fixed delays", esp_err_to_name(ret));
+                lcd->busy_poll = false;
+                break;
+            }
+            if (!(status & LCD_BUSY_FLAG))
+            {
+                ESP_LOGD(TAG, "Ready after %d polls, AC=0x%02X", i + 1, status & 0x7F);
+                return;
+            }
+        }
+        if (i == LCD_BUSY_POLL_LIMIT)
+        {
+            // Most likely a backpack with RW tied low, which always reads busy
+            ESP_LOGW(TAG, "Still busy after %d polls, using fixed delays", LCD_BUSY_POLL_LIMIT);
+            lcd->busy_poll = false;
+        }
+    }
+    lcd_delay_us(fallback_us);
+}
+
+esp_err_t lcd_burst_wait_clear(lcd_burst_t *burst)
+{
+    lcd_burst_sync(burst);
+    lcd_wait_ready(burst->lcd, LCD_EXEC_CLEAR_US);
+    return burst->err;
+}
+
+static void lcd_send_four_bits(lcd_handle_t lcd, uint8_t data)
+{
+    lcd_burst_t burst = {.lcd = lcd};
+    lcd_burst_nibble(&burst, data);
+    lcd_burst_sync(&burst);
+}
+
+void lcd_send_cmd(lcd_handle_t lcd, char cmd)
+{
+    lcd_burst_t burst = {.lcd = lcd};
+    lcd_burst_byte(&burst, cmd, 0);
+    if ((uint8_t)cmd == 0x01 || (uint8_t)(cmd & 0xFE) == 0x02)
+    {
+        lcd_burst_wait_clear(&burst); // Clear and home are slow
+    }
+    else
+    {
+        lcd_burst_sync(&burst);
+    }
+}
+
+void lcd_send_data(lcd_handle_t lcd, char data)
+{
+    lcd_burst_t burst = {.lcd = lcd};
+    lcd_burst_byte(&burst, data, LCD_RS);
+    lcd_burst_sync(&burst);
+}
+
+void lcd_clear(lcd_handle_t lcd)
+{
+    lcd_send_cmd(lcd, 0x01); // Clear screen
+}
+
+void lcd_put_cur(lcd_handle_t lcd, int row, int col)
 {
     int row_offsets[] = {0x00, 0x40};
     if (row > 1)
     {
         row = 1;
     }
-    lcd_send_cmd(0x80 | (col + row_offsets[row]));
+    lcd_send_cmd(lcd, 0x80 | (col + row_offsets[row]));
 }
 
-void lcd_init(i2c_port_t i2c_num)
+int lcd_probe(lcd_bus_handle_t bus, uint8_t addresses[LCD_MAX])
 {
-    s_i2c_port = i2c_num;                // Store the port number
-    vTaskDelay(50 / portTICK_PERIOD_MS); // Wait for LCD to power up
-    lcd_send_four_bits(0x30);
-    vTaskDelay(5 / portTICK_PERIOD_MS);
-    lcd_send_four_bits(0x30);
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-    lcd_send_four_bits(0x30);
-    vTaskDelay(10 / portTICK_PERIOD_MS);
-    lcd_send_four_bits(0x20); // Set to 4-bit mode
-    vTaskDelay(10 / portTICK_PERIOD_MS);
+    static const uint8_t bases[] = {0x20, 0x38}; // PCF8574, PCF8574A
+    int count = 0;
+    for (size_t b = 0; b < sizeof(bases); b++)
+    {
+        for (uint8_t address = bases[b]; address < bases[b] + 8 && count < LCD_MAX; address++)
+        {
+            if (lcd_bus_probe(bus, address) == ESP_OK)
+            {
+                addresses[count++] = address;
+            }
+        }
+    }
+    return count;
+}
 
-    lcd_send_cmd(0x28); // Function set: 4-bit, 2-line, 5x8 dot matrix
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-    lcd_send_cmd(0x08); // Display off
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-    lcd_send_cmd(0x01); // Clear screen
-    vTaskDelay(2 / portTICK_PERIOD_MS);
-    lcd_send_cmd(0x06); // Entry mode set
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-    lcd_send_cmd(0x0C); // Display on, cursor off, blink off
-    vTaskDelay(2 / portTICK_PERIOD_MS);
-    ESP_LOGI(TAG, "LCD Initialized");
+lcd_handle_t lcd_instance(int index)
+{
+    return index < s_lcd_count ? &s_lcds[index] : NULL;
 }
 
-void lcd_send_string(const char *str)
+esp_err_t lcd_init(const lcd_config_t *config, lcd_handle_t *ret_lcd)
 {
+    if (s_lcd_count == LCD_MAX)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    lcd_handle_t lcd = &s_lcds[s_lcd_count];
+    uint8_t address = config->address ? config->address : LCD_I2C_ADDRESS;
+    esp_err_t ret = lcd_bus_attach(config->bus, address, config->scl_speed_hz, config->async, &lcd->dev);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    lcd->backlight_state = LCD_BACKLIGHT;
+    lcd->gap_states = lcd_gap_states(config->scl_speed_hz);
+    lcd_fb_init(lcd);
+    // It has been powered as long as the chip has, which by the time the app
+    // starts is usually longer than the LCD needs
+    int64_t uptime_us = esp_timer_get_time();
+    if (uptime_us < LCD_POWER_UP_US)
+    {
+        lcd_delay_us(LCD_POWER_UP_US - uptime_us);
+    }
+    // The busy flag can't be read until the interface is in 4-bit mode
+    lcd_send_four_bits(lcd, 0x30);
+    lcd_delay_us(4100);
+    lcd_send_four_bits(lcd, 0x30);
+    lcd_delay_us(100);
+    lcd_send_four_bits(lcd, 0x30);
+    lcd_delay_us(LCD_EXEC_US);
+    lcd_send_four_bits(lcd, 0x20); // Set to 4-bit mode
+    lcd_delay_us(LCD_EXEC_US);
+    lcd->busy_poll = config->busy_poll;
+
+    lcd_send_cmd(lcd, 0x28); // Function set: 4-bit, 2-line, 5x8 dot matrix
+    lcd_send_cmd(lcd, 0x08); // Display off
+    lcd_send_cmd(lcd, 0x01); // Clear screen
+    lcd_send_cmd(lcd, 0x06); // Entry mode set
+    lcd_send_cmd(lcd, 0x0C); // Display on, cursor off, blink off
+    ESP_LOGI(TAG, "LCD 0x%02X Initialized%s", address, lcd->busy_poll ? ", polling busy flag" : "");
+    // Counted last: the render task may look at it from now on
+    s_lcd_count++;
+    *ret_lcd = lcd;
+    return ESP_OK;
+}
+
+void lcd_send_string(lcd_handle_t lcd, const char *str)
+{
+    lcd_burst_t burst = {.lcd = lcd};
     while (*str)
     {
-        lcd_send_data(*str++);
+        lcd_burst_byte(&burst, *str++, LCD_RS);
     }
+    lcd_burst_sync(&burst);
 }
 
-void lcd_backlight_on(void)
+void lcd_backlight_on(lcd_handle_t lcd)
 {
-    backlight_state = LCD_BACKLIGHT;
-    i2c_write_byte(0); // Send a dummy byte to update backlight state immediately
+    lcd_burst_t burst = {.lcd = lcd};
+    lcd_backlight_set(lcd, true);
+    lcd_burst_idle(&burst); // Send a dummy byte to update backlight state immediately
+    lcd_burst_sync(&burst);
 }
 
-void lcd_backlight_off(void)
+void lcd_backlight_off(lcd_handle_t lcd)
 {
-    backlight_state = 0x00;
-    i2c_write_byte(0); // Send a dummy byte to update backlight state immediately
+    lcd_burst_t burst = {.lcd = lcd};
+    lcd_backlight_set(lcd, false);
+    lcd_burst_idle(&burst); // Send a dummy byte to update backlight state immediately
+    lcd_burst_sync(&burst);
 }
 
-void lcd_create_char(uint8_t location, uint8_t charmap[])
+void lcd_create_char(lcd_handle_t lcd, uint8_t location, uint8_t charmap[])
 {
+    lcd_burst_t burst = {.lcd = lcd};
     location &= 0x7; // We only have 8 locations (0-7)
-    lcd_send_cmd(0x40 | (location << 3));
+    lcd_burst_byte(&burst, 0x40 | (location << 3), 0);
     for (int i = 0; i < 8; i++)
     {
-        lcd_send_data(charmap[i]);
+        lcd_burst_byte(&burst, charmap[i], LCD_RS);
     }
-    lcd_send_cmd(0x80); // Return to DDRAM address
+    lcd_burst_byte(&burst, 0x80, 0); // Return to DDRAM address
+    lcd_burst_sync(&burst);
+}
+
+void lcd_get_stats(lcd_handle_t lcd, lcd_stats_t *stats)
+{
+    *stats = lcd->stats;
+}
+
+void lcd_reset_stats(lcd_handle_t lcd)
+{
+    lcd->stats = (lcd_stats_t){0};
 }
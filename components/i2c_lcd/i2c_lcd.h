@@ -6,20 +6,118 @@ extern "C"
 {
 #endif
 
-#include "driver/i2c.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
 
-// PCF8574T is 0x27
+#if CONFIG_IDF_TARGET_LINUX
+    // Linux builds talk to lcd_bus_mock.h instead of an I2C peripheral
+    typedef void *lcd_bus_handle_t;
+#else
+#include "driver/i2c_master.h"
+    typedef i2c_master_bus_handle_t lcd_bus_handle_t;
+#endif
+
+// PCF8574T is 0x27, the default address. PCF8574 modules answer at
+// 0x20..0x27 and PCF8574A ones at 0x38..0x3F, set by their A0..A2 pads.
 #define LCD_I2C_ADDRESS 0x27
+// Displays one program can drive
+#define LCD_MAX 8
+
+// Size of the shadow framebuffer, up to 4x20 controllers are supported
+#ifndef LCD_ROWS
+#define LCD_ROWS 2
+#endif
+#ifndef LCD_COLS
+#define LCD_COLS 16
+#endif
+// DDRAM columns per row. One and two line controllers keep 40, of which the
+// screen shows LCD_COLS from the display shift on; four line modules split
+// the DDRAM lines across two rows each, so they get no more than they show.
+#if LCD_ROWS <= 2
+#define LCD_DDRAM_COLS 40
+#else
+#define LCD_DDRAM_COLS LCD_COLS
+#endif
+
+    // Bus traffic counters, to compare driver changes on real hardware
+    typedef struct
+    {
+        uint32_t transactions; // I2C transactions issued
+        uint32_t bytes;        // bytes on the wire, address bytes included
+    } lcd_stats_t;
+
+    typedef struct
+    {
+        lcd_bus_handle_t bus;
+        uint8_t address; // 0 for LCD_I2C_ADDRESS
+        uint32_t scl_speed_hz;
+        bool async;     // bus was created with trans_queue_depth >= the number of displays
+        bool busy_poll; // read the busy flag instead of sleeping fixed times
+    } lcd_config_t;
+
+    // One display. Several can share a bus, each at its own address.
+    typedef struct lcd_dev *lcd_handle_t;
+
+    // Addresses on the bus that acknowledge, PCF8574 ones first; at most
+    // LCD_MAX. Returns how many were found.
+    int lcd_probe(lcd_bus_handle_t bus, uint8_t addresses[LCD_MAX]);
+    // ESP_ERR_NO_MEM once LCD_MAX displays are initialized
+    esp_err_t lcd_init(const lcd_config_t *config, lcd_handle_t *ret_lcd);
+    void lcd_send_cmd(lcd_handle_t lcd, char cmd);
+    void lcd_send_data(lcd_handle_t lcd, char data);
+    void lcd_send_string(lcd_handle_t lcd, const char *str);
+    void lcd_clear(lcd_handle_t lcd);
+    void lcd_put_cur(lcd_handle_t lcd, int row, int col);
+    void lcd_backlight_on(lcd_handle_t lcd);
+    void lcd_backlight_off(lcd_handle_t lcd);
+    void lcd_create_char(lcd_handle_t lcd, uint8_t location, uint8_t charmap[]);
+    void lcd_get_stats(lcd_handle_t lcd, lcd_stats_t *stats);
+    void lcd_reset_stats(lcd_handle_t lcd);
+
+    // Shadow framebuffer: draw calls only touch RAM, lcd_fb_flush() sends
+    // the cells and CGRAM rows that changed since the last flush. Direct
+    // lcd_send_* calls bypass the shadow; call lcd_fb_invalidate() after them.
+    // All lcd_fb_* calls for one display must come from a single drawing task.
+    // Columns count in DDRAM: lcd_fb_put_char() also reaches the ones past
+    // LCD_COLS that are off screen until the display is shifted, while
+    // lcd_fb_put_string() stops at LCD_COLS. lcd_fb_clear() also undoes
+    // any shift.
+    void lcd_fb_clear(lcd_handle_t lcd);
+    void lcd_fb_put_char(lcd_handle_t lcd, int row, int col, char c);
+    void lcd_fb_put_string(lcd_handle_t lcd, int row, int col, const char *str);
+    // Show DDRAM from column `col` on. Costs one shift command per column
+    // moved, whichever way round is shorter; the text is not resent.
+    void lcd_fb_shift(lcd_handle_t lcd, int col);
+    /*
+     * Marquee: fill the whole DDRAM line of a row from `text`, repeated, and
+     * shift the display so it shows the text from position `pos` on. Every
+     * row scrolls with the shift, so give them all the same pos. Advancing
+     * pos by one changes a single off-screen cell, the one that comes into
+     * view 24 steps later, so a step costs one shift command and at most
+     * one character.
+     */
+    void lcd_fb_marquee(lcd_handle_t lcd, int row, const char *text, int pos);
+    // Fixes a CGRAM slot to `charmap`; lcd_fb_put_glyph() leaves it alone
+    void lcd_fb_create_char(lcd_handle_t lcd, uint8_t location, const uint8_t charmap[8]);
+    // Draw a 5x8 bitmap at a cell. Cells with identical bitmaps share one
+    // CGRAM slot and a blank bitmap needs none; slots no longer on screen
+    // are reused least recently used first. ESP_ERR_NO_MEM when all slots
+    // show other bitmaps, the cell is then left blank.
+    esp_err_t lcd_fb_put_glyph(lcd_handle_t lcd, int row, int col, const uint8_t bitmap[8]);
+    void lcd_fb_backlight(lcd_handle_t lcd, bool on);
+    void lcd_fb_invalidate(lcd_handle_t lcd);
+    void lcd_fb_flush(lcd_handle_t lcd);
 
-    void lcd_init(i2c_port_t i2c_num);
-    void lcd_send_cmd(char cmd);
-    void lcd_send_data(char data);
-    void lcd_send_string(const char *str);
-    void lcd_clear(void);
-    void lcd_put_cur(int row, int col);
-    void lcd_backlight_on(void);
-    void lcd_backlight_off(void);
-    void lcd_create_char(uint8_t location, uint8_t charmap[]);
+    // Start the render task, one for all displays. From then on lcd_fb_flush()
+    // only posts the frame and returns; the task owns the bus and the direct
+    // lcd_* calls must no longer be used. A frame that is not yet rendered is
+    // replaced by a newer one of the same display. Each pass renders at most
+    // one frame per display, so a display that redraws all the time can't
+    // hold the bus while the others wait.
+    esp_err_t lcd_render_start(UBaseType_t priority, BaseType_t core_id);
 
 #ifdef __cplusplus
 }
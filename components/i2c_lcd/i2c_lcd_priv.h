@@ -0,0 +1,108 @@
+#ifndef I2C_LCD_PRIV_H
+#define I2C_LCD_PRIV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "i2c_lcd.h"
+#include "lcd_bus.h"
+
+// PCF8574T pin connections to the LCD
+#define LCD_BACKLIGHT 0x08 // P3
+#define LCD_EN 0x04        // P2
+#define LCD_RW 0x02        // P1
+#define LCD_RS 0x01        // P0
+
+// Largest single burst, in LCD bytes: enough for a CGRAM glyph plus its
+// address commands, or a full 16 column row with its cursor move.
+#define LCD_BURST_MAX_BYTES 32
+// Every LCD byte is two nibbles, every nibble is three expander states.
+#define LCD_EXPANDER_STATES_PER_BYTE 6
+// Idle states added after each LCD byte on a fast bus, up to 1MHz
+#define LCD_GAP_STATES_MAX 4
+// A command at the 190kHz worst-case fosc, 37us at 270kHz
+#define LCD_EXEC_WORST_US 53
+#define LCD_BURST_MAX_STATES (LCD_BURST_MAX_BYTES * (LCD_EXPANDER_STATES_PER_BYTE + LCD_GAP_STATES_MAX))
+
+/*
+ * A burst collects the PCF8574 output states for several LCD bytes and sends
+ * them in one I2C transaction. Each expander state costs one I2C byte on the
+ * wire, 9 clocks with the ACK (90us at 100kHz, 22.5us at 400kHz), so the bus
+ * itself meets the HD44780 timing: EN high >= 450ns and address setup
+ * >= 60ns. Between the last EN fall of one byte and the first EN rise of the
+ * next sit two expander states, 180us at 100kHz but only 45us at 400kHz,
+ * against the LCD_EXEC_WORST_US a command may take. On a bus that fast each
+ * byte is followed by lcd->gap_states idle states to make up the rest. Only
+ * clear/home (1.52ms) need an explicit wait after the burst.
+ */
+typedef struct
+{
+    lcd_handle_t lcd;
+    uint8_t buf[LCD_BURST_MAX_STATES];
+    size_t len;
+    esp_err_t err; // first bus error seen by this burst, sticky
+} lcd_burst_t;
+
+// Queue one LCD byte; mode is 0 for a command or LCD_RS for data.
+// A full burst is flushed to the bus first.
+void lcd_burst_byte(lcd_burst_t *burst, uint8_t value, uint8_t mode);
+esp_err_t lcd_burst_flush(lcd_burst_t *burst);
+// Queue a single expander state with all LCD lines low, used to latch a new
+// backlight state when nothing else is sent.
+void lcd_burst_idle(lcd_burst_t *burst);
+// Send the burst and wait out a queued clear or return home. Returns the
+// burst's sticky error.
+esp_err_t lcd_burst_wait_clear(lcd_burst_t *burst);
+// Backlight bit for the expander states queued from now on
+void lcd_backlight_set(lcd_handle_t lcd, bool on);
+
+// One complete screen: what lcd_fb_flush() hands to the renderer
+typedef struct
+{
+    char text[LCD_ROWS][LCD_DDRAM_COLS];
+    uint8_t cgram[8][8];
+    uint8_t shift; // DDRAM column shown leftmost
+    bool backlight;
+    bool full; // resend everything, the controller state is unknown
+} lcd_frame_t;
+
+#define LCD_GLYPH_SLOTS 8
+
+struct lcd_dev
+{
+    lcd_bus_dev_t *dev;
+    uint8_t backlight_state;
+    uint8_t gap_states; // idle states after each LCD byte, see lcd_burst_t
+    bool busy_poll;
+    lcd_stats_t stats;
+
+    // Framebuffer, see lcd_fb.c
+    lcd_frame_t want;
+    bool want_full;
+    lcd_frame_t shown;
+    bool valid; // false until the first render, or after an error
+    uint64_t glyph_key[LCD_GLYPH_SLOTS];  // valid once the slot is used
+    uint32_t glyph_used[LCD_GLYPH_SLOTS]; // glyph_clock at last use, 0 when never
+    uint32_t glyph_clock;
+    uint8_t glyph_pinned; // slots set by lcd_fb_create_char()
+
+    // The frame waiting for the render task, see lcd_render.c
+    lcd_frame_t posted;
+    bool pending;
+};
+
+// Initialized displays by index, NULL past the last one
+lcd_handle_t lcd_instance(int index);
+// Idle states that stretch the gap between two LCD bytes to LCD_EXEC_WORST_US
+// on a bus at scl_speed_hz, what lcd_init() sets gap_states to
+uint8_t lcd_gap_states(uint32_t scl_speed_hz);
+
+// Diff a frame against the controller state and send what changed.
+// Called from the render task once it runs, otherwise from lcd_fb_flush().
+void lcd_fb_render(lcd_handle_t lcd, const lcd_frame_t *frame);
+// Set up the framebuffer of a new display
+void lcd_fb_init(lcd_handle_t lcd);
+// Hand a frame to the render task, false if it is not running
+bool lcd_render_post(lcd_handle_t lcd, const lcd_frame_t *frame);
+
+#endif // I2C_LCD_PRIV_H
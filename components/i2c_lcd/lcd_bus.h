@@ -0,0 +1,33 @@
+#ifndef LCD_BUS_H
+#define LCD_BUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "i2c_lcd.h"
+
+/*
+ * Transport between the driver and the PCF8574. lcd_bus_i2c.c drives the
+ * ESP-IDF i2c_master API, lcd_bus_mock.c stands in for it on Linux builds.
+ */
+
+// One expander on the bus
+typedef struct lcd_bus_dev lcd_bus_dev_t;
+
+// ESP_OK when a device acknowledges the address
+esp_err_t lcd_bus_probe(lcd_bus_handle_t bus, uint8_t address);
+esp_err_t lcd_bus_attach(lcd_bus_handle_t bus, uint8_t address, uint32_t scl_speed_hz, bool async,
+                         lcd_bus_dev_t **ret_dev);
+// Start sending len bytes (at most sizeof(lcd_burst_t.buf)). The data is
+// copied, so the caller may reuse its buffer at once. One transfer per
+// device is in flight at a time; a second call waits for the first to
+// complete. Transfers to other devices queue up behind it on the bus.
+esp_err_t lcd_bus_transmit(lcd_bus_dev_t *dev, const uint8_t *data, size_t len);
+// Send len bytes, then read one byte back from the expander in the same
+// transaction. Blocks until the byte is in. Not supported by every bus.
+esp_err_t lcd_bus_transmit_receive(lcd_bus_dev_t *dev, const uint8_t *data, size_t len, uint8_t *rx);
+// Block until the device's transfers are done. Returns the first error
+// reported by an asynchronous transfer since the previous wait.
+esp_err_t lcd_bus_wait(lcd_bus_dev_t *dev);
+
+#endif // LCD_BUS_H
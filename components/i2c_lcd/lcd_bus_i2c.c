@@ -0,0 +1,162 @@
+#include <string.h>
+#include "driver/i2c_master.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "i2c_lcd_priv.h"
+#include "lcd_bus.h"
+
+#define TAG "I2C_LCD"
+
+#define LCD_BUS_TIMEOUT_MS 1000
+#define LCD_BUS_PROBE_TIMEOUT_MS 50
+
+struct lcd_bus_dev
+{
+    i2c_master_dev_handle_t handle;
+    bool async;
+    SemaphoreHandle_t idle; // held while a transfer is in flight
+    StaticSemaphore_t idle_buf;
+    volatile esp_err_t async_err;
+    // One buffer on the wire while the other one is filled
+    uint8_t buf[2][LCD_BURST_MAX_STATES];
+    int buf_index;
+    uint8_t rx;
+};
+
+static lcd_bus_dev_t s_devs[LCD_MAX];
+static int s_dev_count;
+
+static bool lcd_bus_on_trans_done(i2c_master_dev_handle_t handle, const i2c_master_event_data_t *evt, void *arg)
+{
+    lcd_bus_dev_t *dev = arg;
+    BaseType_t woken = pdFALSE;
+    if (evt->event == I2C_EVENT_NACK || evt->event == I2C_EVENT_TIMEOUT)
+    {
+        dev->async_err = evt->event == I2C_EVENT_NACK ? ESP_FAIL : ESP_ERR_TIMEOUT;
+    }
+    xSemaphoreGiveFromISR(dev->idle, &woken);
+    return woken == pdTRUE;
+}
+
+esp_err_t lcd_bus_probe(lcd_bus_handle_t bus, uint8_t address)
+{
+    return i2c_master_probe(bus, address, LCD_BUS_PROBE_TIMEOUT_MS);
+}
+
+esp_err_t lcd_bus_attach(lcd_bus_handle_t bus, uint8_t address, uint32_t scl_speed_hz, bool async,
+                         lcd_bus_dev_t **ret_dev)
+{
+    if (s_dev_count == LCD_MAX)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    lcd_bus_dev_t *dev = &s_devs[s_dev_count];
+    i2c_device_config_t dev_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = address,
+        .scl_speed_hz = scl_speed_hz,
+    };
+    esp_err_t ret = i2c_master_bus_add_device(bus, &dev_config, &dev->handle);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "i2c_master_bus_add_device failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    s_dev_count++;
+
+    dev->idle = xSemaphoreCreateBinaryStatic(&dev->idle_buf);
+    xSemaphoreGive(dev->idle);
+    dev->async_err = ESP_OK;
+    dev->async = false;
+    if (async)
+    {
+        // Needs a bus created with trans_queue_depth > 0
+        i2c_master_event_callbacks_t cbs = {
+            .on_trans_done = lcd_bus_on_trans_done,
+        };
+        dev->async = i2c_master_register_event_callbacks(dev->handle, &cbs, dev) == ESP_OK;
+        if (!dev->async)
+        {
+            ESP_LOGW(TAG, "Asynchronous I2C unavailable, LCD writes will block");
+        }
+    }
+    *ret_dev = dev;
+    return ESP_OK;
+}
+
+esp_err_t lcd_bus_transmit(lcd_bus_dev_t *dev, const uint8_t *data, size_t len)
+{
+    if (len > sizeof(dev->buf[0]))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *buf = dev->buf[dev->buf_index];
+    dev->buf_index ^= 1;
+    memcpy(buf, data, len);
+    if (!dev->async)
+    {
+        return i2c_master_transmit(dev->handle, buf, len, LCD_BUS_TIMEOUT_MS);
+    }
+
+    if (xSemaphoreTake(dev->idle, pdMS_TO_TICKS(LCD_BUS_TIMEOUT_MS)) != pdTRUE)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    esp_err_t ret = i2c_master_transmit(dev->handle, buf, len, LCD_BUS_TIMEOUT_MS);
+    if (ret != ESP_OK)
+    {
+        xSemaphoreGive(dev->idle); // Nothing was queued, no callback will come
+    }
+    return ret;
+}
+
+esp_err_t lcd_bus_wait(lcd_bus_dev_t *dev)
+{
+    if (dev->async)
+    {
+        if (xSemaphoreTake(dev->idle, pdMS_TO_TICKS(LCD_BUS_TIMEOUT_MS)) != pdTRUE)
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+        xSemaphoreGive(dev->idle);
+    }
+    esp_err_t ret = dev->async_err;
+    dev->async_err = ESP_OK;
+    return ret;
+}
+
+esp_err_t lcd_bus_transmit_receive(lcd_bus_dev_t *dev, const uint8_t *data, size_t len, uint8_t *rx)
+{
+    if (len > sizeof(dev->buf[0]))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *buf = dev->buf[dev->buf_index];
+    dev->buf_index ^= 1;
+    memcpy(buf, data, len);
+    if (!dev->async)
+    {
+        return i2c_master_transmit_receive(dev->handle, buf, len, rx, 1, LCD_BUS_TIMEOUT_MS);
+    }
+
+    if (xSemaphoreTake(dev->idle, pdMS_TO_TICKS(LCD_BUS_TIMEOUT_MS)) != pdTRUE)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    esp_err_t err = dev->async_err; // Keep errors of earlier writes for lcd_bus_wait()
+    dev->async_err = ESP_OK;
+    esp_err_t ret = i2c_master_transmit_receive(dev->handle, buf, len, &dev->rx, 1, LCD_BUS_TIMEOUT_MS);
+    if (ret == ESP_OK)
+    {
+        if (xSemaphoreTake(dev->idle, pdMS_TO_TICKS(LCD_BUS_TIMEOUT_MS)) != pdTRUE)
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+        ret = dev->async_err;
+        *rx = dev->rx;
+    }
+    dev->async_err = err;
+    xSemaphoreGive(dev->idle);
+    return ret;
+}
@@ -0,0 +1,28 @@
+#ifndef LCD_BUS_MOCK_H
+#define LCD_BUS_MOCK_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+    // Linux builds only: every transfer the driver makes is handed to the
+    // sink instead of an I2C peripheral. Without a sink the bytes are dropped.
+    // Probes are empty writes; anything but ESP_OK reads as no acknowledge.
+    typedef esp_err_t (*lcd_bus_mock_sink_t)(uint8_t address, const uint8_t *data, size_t len, void *ctx);
+
+    // Reads return the expander port state. Without a source reads fail.
+    typedef esp_err_t (*lcd_bus_mock_source_t)(uint8_t address, uint8_t *data, void *ctx);
+
+    void lcd_bus_mock_set_sink(lcd_bus_mock_sink_t sink, void *ctx);
+    void lcd_bus_mock_set_source(lcd_bus_mock_source_t source, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LCD_BUS_MOCK_H
@@ -0,0 +1,260 @@
+#include <string.h>
+#include "i2c_lcd.h"
+#include "i2c_lcd_priv.h"
+
+/*
+ * Shadow copy of DDRAM and CGRAM, one per display. Callers draw into `want`,
+ * lcd_fb_render() compares a frame with what the controller is known to hold
+ * (`shown`) and only sends the cells and glyph rows that differ, in a single
+ * burst. A cursor or CGRAM address command is only emitted when the next
+ * dirty byte is not the one the address counter already points at.
+ *
+ * `want` belongs to the drawing task, `shown` to whoever renders: the
+ * render task once it runs, the drawing task before that.
+ *
+ * Glyph manager for the 8 CGRAM slots. A bitmap is keyed by its 8 rows
+ * packed into 64 bits, so finding an identical one is a single compare.
+ * Which slots are still on screen is read off want.text when needed.
+ */
+
+static const uint8_t row_offsets[] = {0x00, 0x40, 0x14, 0x54};
+
+void lcd_fb_init(lcd_handle_t lcd)
+{
+    memset(lcd->want.text, ' ', sizeof(lcd->want.text));
+    lcd->want.backlight = true;
+    lcd->want_full = true;
+}
+
+void lcd_fb_clear(lcd_handle_t lcd)
+{
+    memset(lcd->want.text, ' ', sizeof(lcd->want.text));
+    lcd->want.shift = 0;
+}
+
+void lcd_fb_put_char(lcd_handle_t lcd, int row, int col, char c)
+{
+    if (row < 0 || row >= LCD_ROWS || col < 0 || col >= LCD_DDRAM_COLS)
+    {
+        return;
+    }
+    lcd->want.text[row][col] = c;
+}
+
+void lcd_fb_put_string(lcd_handle_t lcd, int row, int col, const char *str)
+{
+    while (*str && col < LCD_COLS)
+    {
+        lcd_fb_put_char(lcd, row, col++, *str++);
+    }
+}
+
+void lcd_fb_shift(lcd_handle_t lcd, int col)
+{
+    lcd->want.shift = ((col % LCD_DDRAM_COLS) + LCD_DDRAM_COLS) % LCD_DDRAM_COLS;
+}
+
+void lcd_fb_marquee(lcd_handle_t lcd, int row, const char *text, int pos)
+{
+    if (row < 0 || row >= LCD_ROWS)
+    {
+        return;
+    }
+    size_t len = strlen(text);
+    unsigned start = pos < 0 ? 0 : (unsigned)pos;
+    // Column (start + k) % LCD_DDRAM_COLS shows text position start + k
+    for (unsigned k = 0; k < LCD_DDRAM_COLS; k++)
+    {
+        lcd->want.text[row][(start + k) % LCD_DDRAM_COLS] = len ? text[(start + k) % len] : ' ';
+    }
+    lcd_fb_shift(lcd, start);
+}
+
+void lcd_fb_create_char(lcd_handle_t lcd, uint8_t location, const uint8_t charmap[8])
+{
+    memcpy(lcd->want.cgram[location & 0x7], charmap, 8);
+    lcd->glyph_pinned |= 1 << (location & 0x7);
+}
+
+static uint64_t lcd_glyph_key(const uint8_t bitmap[8])
+{
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        key = key << 8 | (bitmap[i] & 0x1f);
+    }
+    return key;
+}
+
+// Slots referenced by a character on screen
+static uint8_t lcd_glyph_on_screen(lcd_handle_t lcd)
+{
+    uint8_t mask = 0;
+    for (int row = 0; row < LCD_ROWS; row++)
+    {
+        for (int col = 0; col < LCD_DDRAM_COLS; col++)
+        {
+            uint8_t c = lcd->want.text[row][col];
+            if (c < LCD_GLYPH_SLOTS)
+            {
+                mask |= 1 << c;
+            }
+        }
+    }
+    return mask;
+}
+
+esp_err_t lcd_fb_put_glyph(lcd_handle_t lcd, int row, int col, const uint8_t bitmap[8])
+{
+    if (row < 0 || row >= LCD_ROWS || col < 0 || col >= LCD_DDRAM_COLS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // The cell's old glyph no longer counts as on screen
+    lcd->want.text[row][col] = ' ';
+    uint64_t key = lcd_glyph_key(bitmap);
+    if (key == 0)
+    {
+        return ESP_OK;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < LCD_GLYPH_SLOTS; i++)
+    {
+        if (!(lcd->glyph_pinned & (1 << i)) && lcd->glyph_used[i] && lcd->glyph_key[i] == key)
+        {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0)
+    {
+        uint8_t busy = lcd_glyph_on_screen(lcd) | lcd->glyph_pinned;
+        for (int i = 0; i < LCD_GLYPH_SLOTS; i++)
+        {
+            if (!(busy & (1 << i)) && (slot < 0 || lcd->glyph_used[i] < lcd->glyph_used[slot]))
+            {
+                slot = i;
+            }
+        }
+        if (slot < 0)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        // lcd_fb_render() only uploads the rows that differ from CGRAM
+        memcpy(lcd->want.cgram[slot], bitmap, 8);
+        lcd->glyph_key[slot] = key;
+    }
+    lcd->glyph_used[slot] = ++lcd->glyph_clock;
+    lcd->want.text[row][col] = slot;
+    return ESP_OK;
+}
+
+void lcd_fb_backlight(lcd_handle_t lcd, bool on)
+{
+    lcd->want.backlight = on;
+}
+
+void lcd_fb_invalidate(lcd_handle_t lcd)
+{
+    lcd->want_full = true;
+}
+
+void lcd_fb_flush(lcd_handle_t lcd)
+{
+    lcd->want.full = lcd->want_full;
+    lcd->want_full = false;
+    if (!lcd_render_post(lcd, &lcd->want))
+    {
+        lcd_fb_render(lcd, &lcd->want);
+    }
+}
+
+void lcd_fb_render(lcd_handle_t lcd, const lcd_frame_t *frame)
+{
+    lcd_burst_t burst = {.lcd = lcd};
+    int addr = -1; // address counter, -1 when unknown
+    bool in_cgram = false;
+    bool valid = lcd->valid && !frame->full;
+    lcd_frame_t *shown = &lcd->shown;
+
+    lcd_backlight_set(lcd, frame->backlight);
+    if (!valid && LCD_DDRAM_COLS > LCD_COLS)
+    {
+        // Return home: the shift is unknown, make it 0. A failure lands in
+        // burst.err like any other byte of the frame.
+        lcd_burst_byte(&burst, 0x02, 0);
+        lcd_burst_wait_clear(&burst);
+        shown->shift = 0;
+    }
+
+    for (int slot = 0; slot < 8; slot++)
+    {
+        for (int line = 0; line < 8; line++)
+        {
+            uint8_t bits = frame->cgram[slot][line];
+            if (valid && shown->cgram[slot][line] == bits)
+            {
+                continue;
+            }
+            // CGRAM is one contiguous 64 byte space, so runs carry on
+            // across glyph boundaries.
+            int cg_addr = (slot << 3) | line;
+            if (!in_cgram || addr != cg_addr)
+            {
+                lcd_burst_byte(&burst, 0x40 | cg_addr, 0);
+            }
+            lcd_burst_byte(&burst, bits, LCD_RS);
+            shown->cgram[slot][line] = bits;
+            in_cgram = true;
+            addr = cg_addr + 1;
+        }
+    }
+
+    for (int row = 0; row < LCD_ROWS; row++)
+    {
+        for (int col = 0; col < LCD_DDRAM_COLS; col++)
+        {
+            char c = frame->text[row][col];
+            if (valid && shown->text[row][col] == c)
+            {
+                continue;
+            }
+            int dd_addr = row_offsets[row] + col;
+            if (in_cgram || addr != dd_addr)
+            {
+                lcd_burst_byte(&burst, 0x80 | dd_addr, 0);
+            }
+            lcd_burst_byte(&burst, c, LCD_RS);
+            shown->text[row][col] = c;
+            in_cgram = false;
+            addr = dd_addr + 1;
+        }
+    }
+
+    if (in_cgram)
+    {
+        lcd_burst_byte(&burst, 0x80, 0); // Leave the address counter in DDRAM
+    }
+    // Shifting moves the window over DDRAM without touching its contents
+    int steps = (frame->shift - shown->shift + LCD_DDRAM_COLS) % LCD_DDRAM_COLS;
+    uint8_t shift_cmd = 0x18; // Display shift left: the window moves right
+    if (steps > LCD_DDRAM_COLS / 2)
+    {
+        steps = LCD_DDRAM_COLS - steps;
+        shift_cmd = 0x1C; // Display shift right
+    }
+    for (int i = 0; i < steps; i++)
+    {
+        lcd_burst_byte(&burst, shift_cmd, 0);
+    }
+    shown->shift = frame->shift;
+    if (burst.len == 0 && (!valid || shown->backlight != frame->backlight))
+    {
+        lcd_burst_idle(&burst); // Nothing else to send, latch the backlight
+    }
+    shown->backlight = frame->backlight;
+    lcd_burst_flush(&burst);
+    // After a bus error the controller state is unknown, resend it all next time
+    lcd->valid = burst.err == ESP_OK;
+}
@@ -0,0 +1,108 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "trace.h"
+#include "i2c_lcd.h"
+#include "i2c_lcd_priv.h"
+
+#define TAG "I2C_LCD"
+
+#define LCD_RENDER_STACK_SIZE 3072
+
+/*
+ * The render task owns the bus and schedules it between the displays. Each
+ * display has a single posted frame that lcd_fb_flush() overwrites, so it
+ * never blocks and a frame the task has not picked up yet is simply
+ * superseded by the newer one. A pass takes at most one frame from every
+ * display, starting one display further on each time, so displays that
+ * update together share the bus evenly.
+ *
+ * Transfers are asynchronous per display: while the last burst of one frame
+ * is still being clocked out, the task already diffs the next display's
+ * frame and queues its bursts behind it, so several displays updating in the
+ * same pass go out back to back without the bus going idle in between.
+ */
+static TaskHandle_t s_task;
+static StaticTask_t s_task_buf;
+static StackType_t s_task_stack[LCD_RENDER_STACK_SIZE];
+static lcd_frame_t s_frame;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+METRICS_HISTOGRAM_DEFINE(m_render, "lcd_render_seconds", "Diffing and writing one frame to the LCD",
+                         METRICS_UNIT_CPU_US)
+
+static bool lcd_render_take(lcd_handle_t lcd, lcd_frame_t *frame)
+{
+    taskENTER_CRITICAL(&s_lock);
+    bool pending = lcd->pending;
+    if (pending)
+    {
+        memcpy(frame, &lcd->posted, sizeof(*frame));
+        lcd->pending = false;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return pending;
+}
+
+static void lcd_render_task(void *arg)
+{
+    int first = 0;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        int count = 0;
+        while (lcd_instance(count) != NULL)
+        {
+            count++;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            lcd_handle_t lcd = lcd_instance((first + i) % count);
+            if (lcd_render_take(lcd, &s_frame))
+            {
+                TRACE_SCOPE("lcd_render");
+                int64_t start_us = esp_timer_get_time();
+                lcd_fb_render(lcd, &s_frame);
+                METRICS_OBSERVE(m_render, esp_timer_get_time() - start_us);
+            }
+        }
+        first = count > 0 ? (first + 1) % count : 0;
+    }
+}
+
+esp_err_t lcd_render_start(UBaseType_t priority, BaseType_t core_id)
+{
+    if (s_task != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_task = xTaskCreateStaticPinnedToCore(lcd_render_task, "lcd_render", LCD_RENDER_STACK_SIZE, NULL, priority,
+                                           s_task_stack, &s_task_buf, core_id);
+    if (s_task == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to start the render task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+bool lcd_render_post(lcd_handle_t lcd, const lcd_frame_t *frame)
+{
+    if (s_task == NULL)
+    {
+        return false;
+    }
+    taskENTER_CRITICAL(&s_lock);
+    // A full redraw that has not been rendered yet carries over to the
+    // frame that supersedes it
+    bool full = lcd->pending && lcd->posted.full;
+    memcpy(&lcd->posted, frame, sizeof(*frame));
+    lcd->posted.full |= full;
+    lcd->pending = true;
+    taskEXIT_CRITICAL(&s_lock);
+    xTaskNotifyGive(s_task);
+    return true;
+}
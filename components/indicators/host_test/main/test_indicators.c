@@ -0,0 +1,254 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "unity.h"
+#include "indicators.h"
+
+#define CANDLE_MS (5 * 60 * 1000LL)
+#define DAY_MS (24 * 60 * 60 * 1000LL)
+#define HISTORY_MAX 1200
+
+static indicators_t ind;
+static candle_t history[HISTORY_MAX]; // every candle put, the last one still open
+static int history_count;
+static uint32_t seed;
+
+void setUp(void)
+{
+    indicators_reset(&ind);
+    history_count = 0;
+    seed = 1;
+}
+
+void tearDown(void)
+{
+}
+
+static uint32_t next_random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+/*
+ * Reference: the textbook definitions over the whole history, recomputed
+ * from scratch on every call. history[n] is candle number n, so the open
+ * candle is number n = history_count - 1 and n closed candles precede it.
+ */
+
+static double reference_value(indicator_t indicator)
+{
+    int n = history_count - 1;
+    const candle_t *open = &history[n];
+    switch (indicator)
+    {
+    case INDICATOR_SMA:
+    {
+        if (n < INDICATORS_MA_PERIOD - 1)
+        {
+            return NAN;
+        }
+        double sum = 0;
+        for (int i = n - INDICATORS_MA_PERIOD + 1; i <= n; i++)
+        {
+            sum += history[i].close;
+        }
+        return sum / INDICATORS_MA_PERIOD;
+    }
+    case INDICATOR_EMA:
+    {
+        if (n < 1)
+        {
+            return NAN;
+        }
+        double alpha = 2.0 / (INDICATORS_MA_PERIOD + 1);
+        double ema = history[0].close;
+        for (int i = 1; i <= n; i++)
+        {
+            ema = alpha * history[i].close + (1 - alpha) * ema;
+        }
+        return ema;
+    }
+    case INDICATOR_VWAP:
+    {
+        double pv = 0, volume = 0;
+        for (int i = 0; i <= n; i++)
+        {
+            if (history[i].open_time_ms / DAY_MS == open->open_time_ms / DAY_MS)
+            {
+                pv += (history[i].high + history[i].low + history[i].close) / 3 * history[i].volume;
+                volume += history[i].volume;
+            }
+        }
+        return volume > 0 ? pv / volume : NAN;
+    }
+    case INDICATOR_RSI:
+    {
+        if (n <= INDICATORS_RSI_PERIOD)
+        {
+            return NAN;
+        }
+        double gain = 0, loss = 0;
+        for (int i = 1; i <= n; i++)
+        {
+            double diff = history[i].close - history[i - 1].close;
+            double up = diff > 0 ? diff : 0;
+            double down = diff < 0 ? -diff : 0;
+            if (i <= INDICATORS_RSI_PERIOD)
+            {
+                // The first averages are plain means
+                gain += up / INDICATORS_RSI_PERIOD;
+                loss += down / INDICATORS_RSI_PERIOD;
+            }
+            else
+            {
+                gain = (gain * (INDICATORS_RSI_PERIOD - 1) + up) / INDICATORS_RSI_PERIOD;
+                loss = (loss * (INDICATORS_RSI_PERIOD - 1) + down) / INDICATORS_RSI_PERIOD;
+            }
+        }
+        if (loss == 0)
+        {
+            return gain == 0 ? 50 : 100;
+        }
+        return 100 - 100 / (1 + gain / loss);
+    }
+    case INDICATOR_CHANGE:
+        return n >= INDICATORS_WINDOW ? (open->close / history[n - INDICATORS_WINDOW].close - 1) * 100 : NAN;
+    case INDICATOR_LOW:
+    case INDICATOR_HIGH:
+    {
+        double extreme = open->close;
+        for (int i = n > INDICATORS_WINDOW - 1 ? n - INDICATORS_WINDOW + 1 : 0; i < n; i++)
+        {
+            double close = history[i].close;
+            extreme = indicator == INDICATOR_LOW ? fmin(extreme, close) : fmax(extreme, close);
+        }
+        return extreme;
+    }
+    default:
+        return NAN;
+    }
+}
+
+// Both sides get the candle, the reference with the rules of indicators_put()
+static void put(const candle_t *candle)
+{
+    indicators_put(&ind, candle);
+    if (history_count > 0 && candle->open_time_ms < history[history_count - 1].open_time_ms)
+    {
+        return;
+    }
+    if (history_count == 0 || candle->open_time_ms > history[history_count - 1].open_time_ms)
+    {
+        TEST_ASSERT_TRUE(history_count < HISTORY_MAX);
+        history_count++;
+    }
+    history[history_count - 1] = *candle;
+}
+
+static void assert_matches_reference(void)
+{
+    static const char *const names[] = {"SMA", "EMA", "VWAP", "RSI", "change", "low", "high"};
+    for (int i = 0; i < INDICATOR_COUNT; i++)
+    {
+        double expected = reference_value((indicator_t)i);
+        double actual = indicators_value(&ind.base, &ind.open, (indicator_t)i);
+        char message[64];
+        snprintf(message, sizeof(message), "%s after %d candles", names[i], history_count);
+        if (isnan(expected))
+        {
+            TEST_ASSERT_TRUE_MESSAGE(isnan(actual), message);
+        }
+        else
+        {
+            // Running sums drift from the recomputed ones by rounding only
+            TEST_ASSERT_DOUBLE_WITHIN_MESSAGE(fabs(expected) * 1e-9 + 1e-9, expected, actual, message);
+        }
+    }
+}
+
+// A random candle at time t; closes on a coarse grid so equal closes happen
+static candle_t random_candle(int64_t t, double *price)
+{
+    *price += ((int)(next_random() % 21) - 10) * 0.5;
+    if (*price < 10)
+    {
+        *price = 10;
+    }
+    double close = *price;
+    double open = close + ((int)(next_random() % 5) - 2) * 0.5;
+    return (candle_t){
+        .open_time_ms = t,
+        .open = open,
+        .high = fmax(open, close) + (next_random() % 4) * 0.25,
+        .low = fmin(open, close) - (next_random() % 4) * 0.25,
+        .close = close,
+        .volume = next_random() % 7 ? (next_random() % 10000) / 100.0 : 0,
+    };
+}
+
+static void test_empty(void)
+{
+    for (int i = 0; i < INDICATOR_COUNT; i++)
+    {
+        TEST_ASSERT_TRUE(isnan(indicators_value(&ind.base, &ind.open, (indicator_t)i)));
+    }
+}
+
+/*
+ * Several windows of candles, each updated a few times while open, starting
+ * an hour before midnight UTC so the VWAP session rolls over; a late candle
+ * now and then must be ignored. Checked after every put.
+ */
+static void test_matches_reference(void)
+{
+    int64_t t = 1760000000000LL / DAY_MS * DAY_MS + DAY_MS - 60 * 60 * 1000LL;
+    double price = 2450;
+    for (int i = 0; i < 4 * INDICATORS_WINDOW; i++)
+    {
+        int updates = 1 + next_random() % 3;
+        for (int u = 0; u < updates; u++)
+        {
+            candle_t candle = random_candle(t, &price);
+            put(&candle);
+            assert_matches_reference();
+        }
+        if (i > 0 && next_random() % 10 == 0)
+        {
+            candle_t late = random_candle(t - CANDLE_MS, &price);
+            put(&late);
+            assert_matches_reference();
+        }
+        // A missing candle now and then: the exchange had no trades
+        t += next_random() % 20 ? CANDLE_MS : 2 * CANDLE_MS;
+    }
+}
+
+// Long flat stretches and a window's worth of falling closes
+static void test_low_high_edges(void)
+{
+    int64_t t = 1760000000000LL;
+    for (int i = 0; i < 3 * INDICATORS_WINDOW; i++)
+    {
+        double close = 100;
+        if (i >= INDICATORS_WINDOW && i < 2 * INDICATORS_WINDOW)
+        {
+            close = 300 - (i - INDICATORS_WINDOW) * 0.5;
+        }
+        candle_t candle = {.open_time_ms = t, .open = close, .high = close, .low = close, .close = close, .volume = 1};
+        put(&candle);
+        assert_matches_reference();
+        t += CANDLE_MS;
+    }
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_matches_reference);
+    RUN_TEST(test_low_high_edges);
+    exit(UNITY_END());
+}
@@ -0,0 +1,175 @@
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include "indicators.h"
+
+#define INDICATORS_DAY_MS (24 * 60 * 60 * 1000LL)
+#define INDICATORS_EMA_ALPHA (2.0 / (INDICATORS_MA_PERIOD + 1))
+
+_Static_assert(INDICATORS_MA_PERIOD < INDICATORS_WINDOW, "the SMA reads its closes back from the window");
+_Static_assert(INDICATORS_WINDOW <= UINT16_MAX, "deques hold uint16_t positions");
+
+void indicators_reset(indicators_t *ind)
+{
+    memset(ind, 0, sizeof(*ind));
+}
+
+static double indicators_typical(const candle_t *candle)
+{
+    return (candle->high + candle->low + candle->close) / 3;
+}
+
+// Candles closed since the one at ring position pos, 0 for the newest
+static int indicators_age(const indicators_t *ind, uint16_t pos)
+{
+    int newest = (int)((ind->base.closed - 1) % INDICATORS_WINDOW);
+    return (newest - pos + INDICATORS_WINDOW) % INDICATORS_WINDOW;
+}
+
+/*
+ * Push the newest close onto a monotonic deque and drop what left the
+ * window. Entries behind a close that is as low (or as high) can never be
+ * the extreme again, so the front always holds it, and every position is
+ * pushed and popped once: amortized constant time.
+ */
+static double indicators_deque_push(indicators_t *ind, uint16_t *deque, uint16_t *head, uint16_t *count, bool low)
+{
+    uint16_t pos = (ind->base.closed - 1) % INDICATORS_WINDOW;
+    double close = ind->closes[pos];
+    while (*count > 0)
+    {
+        double back = ind->closes[deque[(*head + *count - 1) % INDICATORS_WINDOW]];
+        if (low ? back < close : back > close)
+        {
+            break;
+        }
+        (*count)--;
+    }
+    deque[(*head + *count) % INDICATORS_WINDOW] = pos;
+    (*count)++;
+    // The base covers the newest INDICATORS_WINDOW - 1 closed candles, the
+    // open one completes the window
+    while (indicators_age(ind, deque[*head]) >= INDICATORS_WINDOW - 1 && *count > 1)
+    {
+        *head = (*head + 1) % INDICATORS_WINDOW;
+        (*count)--;
+    }
+    return ind->closes[deque[*head]];
+}
+
+static void indicators_close(indicators_t *ind, const candle_t *candle)
+{
+    indicators_base_t *base = &ind->base;
+    uint32_t n = base->closed; // number of this candle
+    double close = candle->close;
+
+    if (n == 0)
+    {
+        base->ema = close;
+    }
+    else
+    {
+        base->ema += INDICATORS_EMA_ALPHA * (close - base->ema);
+        double diff = close - base->last_close;
+        double gain = diff > 0 ? diff : 0;
+        double loss = diff < 0 ? -diff : 0;
+        if (n <= INDICATORS_RSI_PERIOD)
+        {
+            base->gain += gain;
+            base->loss += loss;
+            if (n == INDICATORS_RSI_PERIOD)
+            {
+                base->gain /= INDICATORS_RSI_PERIOD;
+                base->loss /= INDICATORS_RSI_PERIOD;
+            }
+        }
+        else
+        {
+            base->gain = (base->gain * (INDICATORS_RSI_PERIOD - 1) + gain) / INDICATORS_RSI_PERIOD;
+            base->loss = (base->loss * (INDICATORS_RSI_PERIOD - 1) + loss) / INDICATORS_RSI_PERIOD;
+        }
+    }
+
+    base->sma_sum += close;
+    if (n >= INDICATORS_MA_PERIOD - 1)
+    {
+        base->sma_sum -= ind->closes[(n - (INDICATORS_MA_PERIOD - 1)) % INDICATORS_WINDOW];
+    }
+    ind->closes[n % INDICATORS_WINDOW] = close;
+
+    int64_t day = candle->open_time_ms / INDICATORS_DAY_MS;
+    if (day != base->vwap_day)
+    {
+        base->vwap_day = day;
+        base->vwap_pv = 0;
+        base->vwap_volume = 0;
+    }
+    base->vwap_pv += indicators_typical(candle) * candle->volume;
+    base->vwap_volume += candle->volume;
+
+    base->last_close = close;
+    base->closed = n + 1;
+    base->low = indicators_deque_push(ind, ind->low_deque, &ind->low_head, &ind->low_count, true);
+    base->high = indicators_deque_push(ind, ind->high_deque, &ind->high_head, &ind->high_count, false);
+    // The slot the next close goes to holds the one a window before it
+    base->change_base = base->closed >= INDICATORS_WINDOW ? ind->closes[base->closed % INDICATORS_WINDOW] : 0;
+}
+
+void indicators_put(indicators_t *ind, const candle_t *candle)
+{
+    if (ind->open.open_time_ms != 0 && candle->open_time_ms < ind->open.open_time_ms)
+    {
+        return;
+    }
+    if (ind->open.open_time_ms != 0 && candle->open_time_ms > ind->open.open_time_ms)
+    {
+        indicators_close(ind, &ind->open);
+    }
+    ind->open = *candle;
+}
+
+double indicators_value(const indicators_base_t *base, const candle_t *open, indicator_t indicator)
+{
+    if (open->open_time_ms == 0)
+    {
+        return NAN;
+    }
+    double close = open->close;
+    switch (indicator)
+    {
+    case INDICATOR_SMA:
+        return base->closed >= INDICATORS_MA_PERIOD - 1 ? (base->sma_sum + close) / INDICATORS_MA_PERIOD : NAN;
+    case INDICATOR_EMA:
+        return base->closed ? base->ema + INDICATORS_EMA_ALPHA * (close - base->ema) : NAN;
+    case INDICATOR_VWAP:
+    {
+        bool same_day = open->open_time_ms / INDICATORS_DAY_MS == base->vwap_day && base->closed;
+        double pv = (same_day ? base->vwap_pv : 0) + indicators_typical(open) * open->volume;
+        double volume = (same_day ? base->vwap_volume : 0) + open->volume;
+        return volume > 0 ? pv / volume : NAN;
+    }
+    case INDICATOR_RSI:
+    {
+        if (base->closed <= INDICATORS_RSI_PERIOD)
+        {
+            return NAN;
+        }
+        double diff = close - base->last_close;
+        double gain = (base->gain * (INDICATORS_RSI_PERIOD - 1) + (diff > 0 ? diff : 0)) / INDICATORS_RSI_PERIOD;
+        double loss = (base->loss * (INDICATORS_RSI_PERIOD - 1) + (diff < 0 ? -diff : 0)) / INDICATORS_RSI_PERIOD;
+        if (loss == 0)
+        {
+            return gain == 0 ? 50 : 100;
+        }
+        return 100 - 100 / (1 + gain / loss);
+    }
+    case INDICATOR_CHANGE:
+        return base->change_base > 0 ? (close / base->change_base - 1) * 100 : NAN;
+    case INDICATOR_LOW:
+        return base->closed && base->low < close ? base->low : close;
+    case INDICATOR_HIGH:
+        return base->closed && base->high > close ? base->high : close;
+    default:
+        return NAN;
+    }
+}
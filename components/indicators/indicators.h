@@ -0,0 +1,87 @@
+#ifndef INDICATORS_H
+#define INDICATORS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include "candle_ring.h"
+
+// Candles behind the % change and the rolling low/high: a day of 5 minute ones
+#ifndef INDICATORS_WINDOW
+#define INDICATORS_WINDOW 288
+#endif
+#ifndef INDICATORS_MA_PERIOD
+#define INDICATORS_MA_PERIOD 20
+#endif
+#ifndef INDICATORS_RSI_PERIOD
+#define INDICATORS_RSI_PERIOD 14
+#endif
+
+    typedef enum
+    {
+        INDICATOR_SMA,    // of the closes over INDICATORS_MA_PERIOD candles
+        INDICATOR_EMA,    // of the closes, same period
+        INDICATOR_VWAP,   // since 00:00 UTC, from the typical price of each candle
+        INDICATOR_RSI,    // Wilder's, 0..100
+        INDICATOR_CHANGE, // % since the close INDICATORS_WINDOW candles back
+        INDICATOR_LOW,    // lowest close over INDICATORS_WINDOW candles
+        INDICATOR_HIGH,   // highest close, same window
+        INDICATOR_COUNT,
+    } indicator_t;
+
+    /*
+     * What the indicators need to know about the closed candles. Together
+     * with the still-open candle it gives every value in constant time, so
+     * a copy travels with each chart snapshot and streamed trades can
+     * update the values without the rest of the engine.
+     */
+    typedef struct
+    {
+        uint32_t closed;   // closed candles seen
+        double last_close; // of the newest closed candle
+        double ema;
+        double sma_sum; // closes of the newest INDICATORS_MA_PERIOD - 1 closed candles
+        double gain;    // Wilder averages, plain sums while warming up
+        double loss;
+        double vwap_pv; // price * volume over the session's closed candles
+        double vwap_volume;
+        int64_t vwap_day; // UTC day the sums belong to
+        double low;       // over the newest INDICATORS_WINDOW - 1 closed candles
+        double high;
+        double change_base; // close INDICATORS_WINDOW candles before the open one
+    } indicators_base_t;
+
+    /*
+     * Fed with candles as they are fetched. Every update costs constant
+     * time and the state has a fixed size: running sums, and monotonic
+     * deques for the rolling low and high.
+     */
+    typedef struct
+    {
+        indicators_base_t base;
+        candle_t open; // the newest candle, still changing; open_time_ms 0 before any
+        double closes[INDICATORS_WINDOW]; // closed candle n at n % INDICATORS_WINDOW
+        uint16_t low_deque[INDICATORS_WINDOW];  // positions in closes, closes rising
+        uint16_t high_deque[INDICATORS_WINDOW]; // positions in closes, closes falling
+        uint16_t low_head, low_count;
+        uint16_t high_head, high_count;
+    } indicators_t;
+
+    void indicators_reset(indicators_t *ind);
+    /*
+     * Same rules as candle_ring_put(): the open candle is replaced by a
+     * candle with its open time, a newer candle closes it and takes its
+     * place, an older one is ignored.
+     */
+    void indicators_put(indicators_t *ind, const candle_t *candle);
+    // NAN until enough candles have closed
+    double indicators_value(const indicators_base_t *base, const candle_t *open, indicator_t indicator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INDICATORS_H
@@ -0,0 +1,364 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "cJSON.h"
+#include "json_stream.h"
+
+#define MAX_EMITS 64
+#define BENCH_ROUNDS 2000
+
+// One callback, as the caller saw it
+typedef struct
+{
+    int path;
+    int index;
+    char value[JSON_STREAM_TOKEN_MAX + 1];
+    size_t len;
+} emit_t;
+
+typedef struct
+{
+    emit_t emits[MAX_EMITS];
+    int count;
+} record_t;
+
+static const char *const kline_paths[] = {"[*][1]"};
+static const char kline_doc[] = "[[1700000000000,\"2489.37\",\"2490.1\",\"2488\",\"2489.9\",\"12.5\"],"
+                                " [1700000060000, \"2489.90\", \"2491\", \"2489\", \"2490.5\", \"3\"]]";
+
+static const char *const alltick_paths[] = {"ret", "data.kline_list[*].open_price"};
+static const char alltick_doc[] = "{\"ret\":200,\"msg\":\"ok\",\"data\":{\"code\":\"ETHUSDT\",\"kline_list\":["
+                                  "{\"timestamp\":\"1700000000\",\"open_price\":\"2489.37\",\"x\":{\"open_price\":\"9\"}},"
+                                  "{\"open_price\":\"2489.90\",\"volume\":\"3\"}]},\"open_price\":\"1\"}";
+
+static const char *const gas_paths[] = {"status", "result.suggestBaseFee"};
+static const char gas_doc[] = "{\"status\":\"1\",\"message\":\"OK\",\"result\":{\"LastBlock\":\"21000000\","
+                              "\"suggestBaseFee\":\"0.874\",\"gasUsedRatio\":\"0.5,0.3\",\"esc\\\"aped\":[true,null,-1.5e3]}}";
+
+static record_t record;
+
+void setUp(void)
+{
+    record = (record_t){0};
+}
+
+void tearDown(void)
+{
+}
+
+static void on_value(void *ctx, int path, int index, const char *value, size_t len)
+{
+    record_t *r = ctx;
+    TEST_ASSERT_LESS_THAN(MAX_EMITS, r->count);
+    TEST_ASSERT_EQUAL(len, strlen(value));
+    emit_t *e = &r->emits[r->count++];
+    e->path = path;
+    e->index = index;
+    e->len = len;
+    memcpy(e->value, value, len + 1);
+}
+
+// Parse a document in chunks of `chunk` bytes after a first one of `first`
+static esp_err_t parse(const char *const *paths, int count, const char *doc, size_t first, size_t chunk,
+                       record_t *r)
+{
+    json_stream_t js;
+    TEST_ASSERT_EQUAL(ESP_OK, json_stream_init(&js, paths, count, on_value, r));
+    size_t len = strlen(doc);
+    size_t n = first < len ? first : len;
+    esp_err_t ret = json_stream_feed(&js, doc, n);
+    for (size_t off = n; off < len && ret == ESP_OK; off += n)
+    {
+        n = len - off < chunk ? len - off : chunk;
+        ret = json_stream_feed(&js, doc + off, n);
+    }
+    return ret == ESP_OK ? json_stream_finish(&js) : ret;
+}
+
+static void assert_emit(const record_t *r, int i, int path, int index, const char *value)
+{
+    TEST_ASSERT_LESS_THAN(r->count, i);
+    TEST_ASSERT_EQUAL(path, r->emits[i].path);
+    TEST_ASSERT_EQUAL(index, r->emits[i].index);
+    TEST_ASSERT_EQUAL_STRING(value, r->emits[i].value);
+}
+
+static void test_binance_kline_path(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, parse(kline_paths, 1, kline_doc, SIZE_MAX, 1, &record));
+    TEST_ASSERT_EQUAL(2, record.count);
+    assert_emit(&record, 0, 0, 0, "2489.37");
+    assert_emit(&record, 1, 0, 1, "2489.90");
+}
+
+static void test_alltick_path(void)
+{
+    // Neither the nested nor the top-level "open_price" is on the path
+    TEST_ASSERT_EQUAL(ESP_OK, parse(alltick_paths, 2, alltick_doc, SIZE_MAX, 1, &record));
+    TEST_ASSERT_EQUAL(3, record.count);
+    assert_emit(&record, 0, 0, -1, "200");
+    assert_emit(&record, 1, 1, 0, "2489.37");
+    assert_emit(&record, 2, 1, 1, "2489.90");
+}
+
+static void test_etherscan_path(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, parse(gas_paths, 2, gas_doc, SIZE_MAX, 1, &record));
+    TEST_ASSERT_EQUAL(2, record.count);
+    assert_emit(&record, 0, 0, -1, "1");
+    assert_emit(&record, 1, 1, -1, "0.874");
+}
+
+// The same callbacks whichever byte a chunk boundary falls on, and when
+// every byte is its own chunk
+static void check_split(const char *const *paths, int count, const char *doc)
+{
+    record_t whole = {0};
+    TEST_ASSERT_EQUAL(ESP_OK, parse(paths, count, doc, SIZE_MAX, 1, &whole));
+    for (size_t cut = 0; cut <= strlen(doc); cut++)
+    {
+        for (int bytewise = 0; bytewise < 2; bytewise++)
+        {
+            record_t split = {0};
+            TEST_ASSERT_EQUAL(ESP_OK, parse(paths, count, doc, cut, bytewise ? 1 : SIZE_MAX, &split));
+            TEST_ASSERT_EQUAL(whole.count, split.count);
+            TEST_ASSERT_EQUAL_MEMORY(whole.emits, split.emits, sizeof(emit_t) * whole.count);
+        }
+    }
+}
+
+static void test_split_anywhere(void)
+{
+    check_split(kline_paths, 1, kline_doc);
+    check_split(alltick_paths, 2, alltick_doc);
+    check_split(gas_paths, 2, gas_doc);
+}
+
+static void test_long_key_and_value(void)
+{
+    // The path key is the first JSON_STREAM_TOKEN_MAX bytes of the long key
+    static const char *const paths[] = {"a234567890123456789012345678901b", "v"};
+    static const char doc[] = "{\"a234567890123456789012345678901bXYZ\":\"long\","
+                              "\"a234567890123456789012345678901b\":\"exact\","
+                              "\"v\":\"0123456789012345678901234567890123456789\"}";
+    TEST_ASSERT_EQUAL(JSON_STREAM_TOKEN_MAX, strlen(paths[0]));
+    TEST_ASSERT_EQUAL(ESP_OK, parse(paths, 2, doc, SIZE_MAX, 1, &record));
+    TEST_ASSERT_EQUAL(2, record.count);
+    assert_emit(&record, 0, 0, -1, "exact");
+    assert_emit(&record, 1, 1, -1, "01234567890123456789012345678901");
+    TEST_ASSERT_EQUAL(JSON_STREAM_TOKEN_MAX, record.emits[1].len);
+
+    // A path key longer than a kept key could never match
+    static const char *const too_long[] = {"a234567890123456789012345678901bX"};
+    json_stream_t js;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, json_stream_init(&js, too_long, 1, on_value, &record));
+}
+
+static void test_depth(void)
+{
+    char doc[2 * (JSON_STREAM_MAX_DEPTH + 1) + 2];
+    for (int depth = JSON_STREAM_MAX_DEPTH; depth <= JSON_STREAM_MAX_DEPTH + 1; depth++)
+    {
+        memset(doc, '[', depth);
+        doc[depth] = '1';
+        memset(doc + depth + 1, ']', depth);
+        doc[2 * depth + 1] = 0;
+        json_stream_t js;
+        TEST_ASSERT_EQUAL(ESP_OK, json_stream_init(&js, kline_paths, 1, on_value, &record));
+        esp_err_t expect = depth > JSON_STREAM_MAX_DEPTH ? ESP_ERR_INVALID_RESPONSE : ESP_OK;
+        TEST_ASSERT_EQUAL(expect, json_stream_feed(&js, doc, strlen(doc)));
+        TEST_ASSERT_EQUAL(expect, json_stream_finish(&js));
+    }
+}
+
+static void test_malformed(void)
+{
+    static const char *const docs[] = {
+        "{\"a\" 1}", "{\"a\":1,}", "[1,]", "{\"a\":1]", "[1}", "]", "{\"a\":1}}", "@", "{1:2}", "[1 2]", "{,}", "[\"a\":1]",
+    };
+    for (int i = 0; i < (int)(sizeof(docs) / sizeof(docs[0])); i++)
+    {
+        json_stream_t js;
+        TEST_ASSERT_EQUAL(ESP_OK, json_stream_init(&js, kline_paths, 1, on_value, &record));
+        TEST_ASSERT_EQUAL_MESSAGE(ESP_ERR_INVALID_RESPONSE, json_stream_feed(&js, docs[i], strlen(docs[i])), docs[i]);
+        // Stays failed
+        TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, json_stream_feed(&js, "1", 1));
+        TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, json_stream_finish(&js));
+    }
+}
+
+// Every proper prefix of a document is accepted by feed, then rejected by
+// finish
+static void check_truncated(const char *const *paths, int count, const char *doc)
+{
+    for (size_t len = 0; len < strlen(doc); len++)
+    {
+        json_stream_t js;
+        TEST_ASSERT_EQUAL(ESP_OK, json_stream_init(&js, paths, count, on_value, &record));
+        TEST_ASSERT_EQUAL(ESP_OK, json_stream_feed(&js, doc, len));
+        TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, json_stream_finish(&js));
+        record.count = 0;
+    }
+}
+
+static void test_truncated(void)
+{
+    check_truncated(kline_paths, 1, kline_doc);
+    check_truncated(alltick_paths, 2, alltick_doc);
+    check_truncated(gas_paths, 2, gas_doc);
+}
+
+static void test_root_scalar(void)
+{
+    // A root number has no end until finish
+    static const char *const root[] = {""};
+    json_stream_t js;
+    TEST_ASSERT_EQUAL(ESP_OK, json_stream_init(&js, root, 1, on_value, &record));
+    TEST_ASSERT_EQUAL(ESP_OK, json_stream_feed(&js, " 42", 3));
+    TEST_ASSERT_EQUAL(0, record.count);
+    TEST_ASSERT_EQUAL(ESP_OK, json_stream_finish(&js));
+    TEST_ASSERT_EQUAL(1, record.count);
+    assert_emit(&record, 0, 0, -1, "42");
+}
+
+// Recorded bodies, the paths the app asks for in them
+typedef struct
+{
+    const char *name;
+    const char *file;
+    const char *const *paths;
+    int path_count;
+} body_t;
+
+static const char *const app_kline_paths[] = {"[*][0]", "[*][1]", "[*][4]", "[*][2]", "[*][3]", "[*][5]"};
+static const char *const app_alltick_paths[] = {"ret", "data.kline_list[*].timestamp",
+                                                "data.kline_list[*].open_price", "data.kline_list[*].close_price",
+                                                "data.kline_list[*].high_price", "data.kline_list[*].low_price",
+                                                "data.kline_list[*].volume"};
+
+static const body_t bodies[] = {
+    {"Binance klines", "api.binance.com/api/v3/klines", app_kline_paths, 6},
+    {"AllTick kline", "quote.alltick.io/quote-b-api/kline", app_alltick_paths, 7},
+    {"Etherscan gas", "api.etherscan.io/v2/api", gas_paths, 2},
+};
+
+// cJSON's heap use, through its hooks
+static size_t heap_now;
+static size_t heap_peak;
+
+static void *counting_malloc(size_t size)
+{
+    size_t *block = malloc(sizeof(size_t) + size);
+    if (!block)
+    {
+        return NULL;
+    }
+    *block = size;
+    heap_now += size;
+    heap_peak = heap_now > heap_peak ? heap_now : heap_peak;
+    return block + 1;
+}
+
+static void counting_free(void *ptr)
+{
+    if (ptr)
+    {
+        size_t *block = (size_t *)ptr - 1;
+        heap_now -= *block;
+        free(block);
+    }
+}
+
+static char *read_body(const char *file, size_t *len)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", FIXTURES_DIR, file);
+    FILE *f = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, path);
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *body = malloc(*len + 1);
+    TEST_ASSERT_EQUAL(*len, fread(body, 1, *len, f));
+    body[*len] = 0;
+    fclose(f);
+    return body;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void count_value(void *ctx, int path, int index, const char *value, size_t len)
+{
+    (*(int *)ctx)++;
+}
+
+// Both parse the body as it arrives in a whole: cJSON has to hold the body
+// and its tree, json_stream only itself
+static void bench_body(const body_t *b)
+{
+    size_t len;
+    char *body = read_body(b->file, &len);
+
+    int values = 0;
+    double start = now_ns();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        json_stream_t js;
+        json_stream_init(&js, b->paths, b->path_count, count_value, &values);
+        json_stream_feed(&js, body, len);
+        TEST_ASSERT_EQUAL(ESP_OK, json_stream_finish(&js));
+    }
+    double stream_ns = (now_ns() - start) / BENCH_ROUNDS / len;
+
+    cJSON_Hooks hooks = {.malloc_fn = counting_malloc, .free_fn = counting_free};
+    cJSON_InitHooks(&hooks);
+    heap_peak = 0;
+    start = now_ns();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        cJSON *root = cJSON_ParseWithLength(body, len);
+        TEST_ASSERT_NOT_NULL(root);
+        cJSON_Delete(root);
+    }
+    double cjson_ns = (now_ns() - start) / BENCH_ROUNDS / len;
+    cJSON_InitHooks(NULL);
+
+    printf("json_stream: %s, %u bytes, %d values: %.2f ns/byte, %u bytes; cJSON_Parse %.2f ns/byte, "
+           "%u bytes peak heap plus the body\n",
+           b->name, (unsigned)len, values / BENCH_ROUNDS, stream_ns, (unsigned)sizeof(json_stream_t), cjson_ns,
+           (unsigned)heap_peak);
+    free(body);
+}
+
+static void bench_bodies(void)
+{
+    for (int i = 0; i < (int)(sizeof(bodies) / sizeof(bodies[0])); i++)
+    {
+        bench_body(&bodies[i]);
+    }
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_binance_kline_path);
+    RUN_TEST(test_alltick_path);
+    RUN_TEST(test_etherscan_path);
+    RUN_TEST(test_split_anywhere);
+    RUN_TEST(test_long_key_and_value);
+    RUN_TEST(test_depth);
+    RUN_TEST(test_malformed);
+    RUN_TEST(test_truncated);
+    RUN_TEST(test_root_scalar);
+    bench_bodies();
+    exit(UNITY_END());
+}
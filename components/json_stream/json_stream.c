@@ -0,0 +1,394 @@
+#include <string.h>
+#include "json_stream.h"
+
+/*
+ * Push parser that never holds more than one key and one scalar: keys and
+ * values outside the requested paths are lexed and dropped, so memory use
+ * is fixed by json_stream_t no matter how large the document is.
+ */
+
+enum
+{
+    JS_VALUE,         // a value starts here
+    JS_ARRAY_FIRST,   // right after '[': a value or ']'
+    JS_OBJECT_FIRST,  // right after '{': a key or '}'
+    JS_OBJECT_KEY,    // after ',' in an object
+    JS_COLON,         // after a key
+    JS_AFTER_VALUE,   // ',' or a closing bracket
+    JS_STRING,        // inside a string
+    JS_STRING_ESCAPE, // after '\' inside a string
+    JS_SCALAR,        // inside a number or literal
+    JS_DONE,          // the root value is complete
+    JS_ERROR,
+};
+
+static bool json_stream_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool json_stream_is_scalar(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+static esp_err_t json_stream_compile(json_stream_t *js, int p, const char *spec)
+{
+    int n = 0;
+    while (*spec)
+    {
+        if (n == JSON_STREAM_MAX_SEGMENTS)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        json_stream_segment_t *seg = &js->segments[p][n++];
+        if (*spec == '[')
+        {
+            spec++;
+            seg->key = NULL;
+            if (*spec == '*')
+            {
+                seg->index = JSON_STREAM_ANY;
+                spec++;
+            }
+            else
+            {
+                seg->index = 0;
+                while (*spec >= '0' && *spec <= '9')
+                {
+                    seg->index = seg->index * 10 + (*spec++ - '0');
+                }
+            }
+            if (*spec++ != ']')
+            {
+                return ESP_ERR_INVALID_ARG;
+            }
+        }
+        else
+        {
+            size_t len = strcspn(spec, ".[");
+            if (len == 0 || len > JSON_STREAM_TOKEN_MAX)
+            {
+                return ESP_ERR_INVALID_ARG;
+            }
+            seg->key = spec;
+            seg->key_len = len;
+            spec += len;
+        }
+        if (*spec == '.')
+        {
+            spec++;
+        }
+    }
+    js->segment_count[p] = n;
+    return ESP_OK;
+}
+
+esp_err_t json_stream_init(json_stream_t *js, const char *const *paths, int path_count,
+                           json_stream_cb_t cb, void *ctx)
+{
+    if (path_count > JSON_STREAM_MAX_PATHS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(js, 0, sizeof(*js));
+    for (int p = 0; p < path_count; p++)
+    {
+        esp_err_t ret = json_stream_compile(js, p, paths[p]);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+    js->path_count = path_count;
+    js->cb = cb;
+    js->ctx = ctx;
+    js->state = JS_VALUE;
+    js->value_alive = (1u << path_count) - 1;
+    return ESP_OK;
+}
+
+// Paths of the enclosing container that also match the next value: the
+// current key inside an object, the current index inside an array.
+static uint32_t json_stream_match(const json_stream_t *js)
+{
+    const json_stream_frame_t *frame = &js->stack[js->depth - 1];
+    uint32_t alive = 0;
+    for (int p = 0; p < js->path_count; p++)
+    {
+        if (!(frame->alive & (1u << p)) || js->depth > js->segment_count[p])
+        {
+            continue;
+        }
+        const json_stream_segment_t *seg = &js->segments[p][js->depth - 1];
+        bool match;
+        if (frame->container == '{')
+        {
+            match = seg->key && seg->key_len == js->key_len && memcmp(seg->key, js->key, js->key_len) == 0;
+        }
+        else
+        {
+            match = !seg->key && (seg->index == JSON_STREAM_ANY || seg->index == frame->index);
+        }
+        if (match)
+        {
+            alive |= 1u << p;
+        }
+    }
+    return alive;
+}
+
+static void json_stream_emit(json_stream_t *js)
+{
+    size_t len = js->token_len < JSON_STREAM_TOKEN_MAX ? js->token_len : JSON_STREAM_TOKEN_MAX;
+    js->token[len] = 0;
+    for (int p = 0; p < js->path_count; p++)
+    {
+        if (!(js->value_alive & (1u << p)) || js->segment_count[p] != js->depth)
+        {
+            continue;
+        }
+        int index = -1;
+        for (int s = 0; s < js->segment_count[p]; s++)
+        {
+            if (!js->segments[p][s].key && js->segments[p][s].index == JSON_STREAM_ANY)
+            {
+                index = js->stack[s].index;
+                break;
+            }
+        }
+        js->cb(js->ctx, p, index, js->token, len);
+    }
+}
+
+static void json_stream_token_add(json_stream_t *js, char c)
+{
+    if (js->token_len < JSON_STREAM_TOKEN_MAX)
+    {
+        js->token[js->token_len] = c;
+    }
+    js->token_len++;
+}
+
+static void json_stream_push(json_stream_t *js, char container)
+{
+    if (js->depth == JSON_STREAM_MAX_DEPTH)
+    {
+        js->state = JS_ERROR;
+        return;
+    }
+    json_stream_frame_t *frame = &js->stack[js->depth++];
+    frame->container = container;
+    frame->index = 0;
+    frame->alive = js->value_alive;
+    js->state = container == '{' ? JS_OBJECT_FIRST : JS_ARRAY_FIRST;
+}
+
+static void json_stream_pop(json_stream_t *js, char closing)
+{
+    if (js->depth == 0 || js->stack[js->depth - 1].container != (closing == '}' ? '{' : '['))
+    {
+        js->state = JS_ERROR;
+        return;
+    }
+    js->depth--;
+    js->state = js->depth ? JS_AFTER_VALUE : JS_DONE;
+}
+
+static void json_stream_value_done(json_stream_t *js)
+{
+    js->state = js->depth ? JS_AFTER_VALUE : JS_DONE;
+}
+
+static void json_stream_char(json_stream_t *js, char c)
+{
+    switch (js->state)
+    {
+    case JS_ARRAY_FIRST:
+        if (json_stream_is_space(c))
+        {
+            break;
+        }
+        if (c == ']')
+        {
+            json_stream_pop(js, c);
+            break;
+        }
+        js->value_alive = json_stream_match(js);
+        js->state = JS_VALUE;
+        // fall through
+    case JS_VALUE:
+        if (json_stream_is_space(c))
+        {
+            break;
+        }
+        if (c == '{' || c == '[')
+        {
+            json_stream_push(js, c);
+        }
+        else if (c == '"')
+        {
+            js->string_is_key = false;
+            js->token_len = 0;
+            js->state = JS_STRING;
+        }
+        else if (json_stream_is_scalar(c))
+        {
+            js->token_len = 0;
+            json_stream_token_add(js, c);
+            js->state = JS_SCALAR;
+        }
+        else
+        {
+            js->state = JS_ERROR;
+        }
+        break;
+    case JS_OBJECT_FIRST:
+    case JS_OBJECT_KEY:
+        if (json_stream_is_space(c))
+        {
+            break;
+        }
+        if (c == '"')
+        {
+            js->string_is_key = true;
+            js->token_len = 0;
+            js->state = JS_STRING;
+        }
+        else if (c == '}' && js->state == JS_OBJECT_FIRST)
+        {
+            json_stream_pop(js, c);
+        }
+        else
+        {
+            js->state = JS_ERROR;
+        }
+        break;
+    case JS_COLON:
+        if (json_stream_is_space(c))
+        {
+            break;
+        }
+        if (c == ':')
+        {
+            js->value_alive = json_stream_match(js);
+            js->state = JS_VALUE;
+        }
+        else
+        {
+            js->state = JS_ERROR;
+        }
+        break;
+    case JS_AFTER_VALUE:
+        if (json_stream_is_space(c))
+        {
+            break;
+        }
+        if (c == ',')
+        {
+            json_stream_frame_t *frame = &js->stack[js->depth - 1];
+            if (frame->container == '{')
+            {
+                js->state = JS_OBJECT_KEY;
+            }
+            else
+            {
+                frame->index++;
+                js->value_alive = json_stream_match(js);
+                js->state = JS_VALUE;
+            }
+        }
+        else if (c == '}' || c == ']')
+        {
+            json_stream_pop(js, c);
+        }
+        else
+        {
+            js->state = JS_ERROR;
+        }
+        break;
+    case JS_STRING:
+        if (c == '\\')
+        {
+            js->state = JS_STRING_ESCAPE;
+        }
+        else if (c == '"')
+        {
+            if (js->string_is_key)
+            {
+                // An over-long key gets a length no segment can have
+                js->key_len = js->token_len;
+                memcpy(js->key, js->token, js->token_len < JSON_STREAM_TOKEN_MAX ? js->token_len : JSON_STREAM_TOKEN_MAX);
+                js->state = JS_COLON;
+            }
+            else
+            {
+                if (js->value_alive)
+                {
+                    json_stream_emit(js);
+                }
+                json_stream_value_done(js);
+            }
+        }
+        else
+        {
+            json_stream_token_add(js, c);
+        }
+        break;
+    case JS_STRING_ESCAPE:
+        // Kept as the escaped character; \uXXXX stays as "uXXXX"
+        json_stream_token_add(js, c);
+        js->state = JS_STRING;
+        break;
+    case JS_SCALAR:
+        if (json_stream_is_scalar(c))
+        {
+            json_stream_token_add(js, c);
+            break;
+        }
+        if (js->value_alive)
+        {
+            json_stream_emit(js);
+        }
+        json_stream_value_done(js);
+        if (js->state == JS_AFTER_VALUE)
+        {
+            json_stream_char(js, c);
+        }
+        else if (!json_stream_is_space(c))
+        {
+            js->state = JS_ERROR;
+        }
+        break;
+    case JS_DONE:
+        if (!json_stream_is_space(c))
+        {
+            js->state = JS_ERROR;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+esp_err_t json_stream_feed(json_stream_t *js, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len && js->state != JS_ERROR; i++)
+    {
+        json_stream_char(js, data[i]);
+    }
+    return js->state == JS_ERROR ? ESP_ERR_INVALID_RESPONSE : ESP_OK;
+}
+
+esp_err_t json_stream_finish(json_stream_t *js)
+{
+    if (js->state == JS_SCALAR && js->depth == 0)
+    {
+        if (js->value_alive)
+        {
+            json_stream_emit(js);
+        }
+        js->state = JS_DONE;
+    }
+    return js->state == JS_DONE ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
@@ -0,0 +1,78 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define JSON_STREAM_MAX_PATHS 8
+#define JSON_STREAM_MAX_SEGMENTS 6
+#define JSON_STREAM_MAX_DEPTH 8
+// Longest key or scalar value kept; longer ones never match / are cut
+#define JSON_STREAM_TOKEN_MAX 32
+
+    /*
+     * Called for every scalar whose location matches one of the paths.
+     * `path` is the index into the path list, `index` is the array index at
+     * the path's first [*] (-1 without one). `value` is NUL terminated:
+     * strings without their quotes, numbers, true/false/null as written.
+     */
+    typedef void (*json_stream_cb_t)(void *ctx, int path, int index, const char *value, size_t len);
+
+    typedef struct
+    {
+        const char *key; // not NUL terminated, NULL for an array index
+        uint8_t key_len;
+        int16_t index; // JSON_STREAM_ANY for [*]
+    } json_stream_segment_t;
+
+#define JSON_STREAM_ANY (-1)
+
+    typedef struct
+    {
+        uint8_t container; // '{' or '['
+        int32_t index;     // element index inside arrays
+        uint32_t alive;    // paths still matching down to this container
+    } json_stream_frame_t;
+
+    typedef struct
+    {
+        json_stream_segment_t segments[JSON_STREAM_MAX_PATHS][JSON_STREAM_MAX_SEGMENTS];
+        uint8_t segment_count[JSON_STREAM_MAX_PATHS];
+        uint8_t path_count;
+        json_stream_cb_t cb;
+        void *ctx;
+
+        json_stream_frame_t stack[JSON_STREAM_MAX_DEPTH];
+        uint8_t depth;
+        uint8_t state;
+        uint32_t value_alive; // paths matching the value being parsed
+        bool string_is_key;
+        char token[JSON_STREAM_TOKEN_MAX + 1];
+        size_t token_len; // may exceed JSON_STREAM_TOKEN_MAX, the rest is dropped
+        char key[JSON_STREAM_TOKEN_MAX];
+        size_t key_len;
+    } json_stream_t;
+
+    /*
+     * Prepare a parser for the given path specs, e.g. "[*][1]",
+     * "data.kline_list[*].open_price" or "result.suggestBaseFee". The spec
+     * strings are referenced, not copied.
+     */
+    esp_err_t json_stream_init(json_stream_t *js, const char *const *paths, int path_count,
+                               json_stream_cb_t cb, void *ctx);
+    // Feed the next chunk of the document, chunks may split any token
+    esp_err_t json_stream_feed(json_stream_t *js, const char *data, size_t len);
+    // End of input: fails if the document is incomplete
+    esp_err_t json_stream_finish(json_stream_t *js);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_STREAM_H
@@ -0,0 +1,243 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "kline_chart.h"
+
+#define BENCH_FRAMES 200000
+
+/*
+ * Golden images: the 20x16 chart as text, top row first, '#' for a pixel
+ * that is on. The glyphs are unpacked through the CGRAM layout, so these
+ * also pin down which cell and bit each pixel lands in.
+ */
+typedef char chart_image_t[KLINE_CHART_HEIGHT * (KLINE_CHART_WIDTH + 1) + 1];
+
+static kline_chart_glyphs_t glyphs;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void chart_to_text(const kline_chart_glyphs_t chart, chart_image_t text)
+{
+    char *p = text;
+    for (int y = KLINE_CHART_HEIGHT - 1; y >= 0; y--)
+    {
+        for (int x = 0; x < KLINE_CHART_WIDTH; x++)
+        {
+            int cell = x / 5 + (y < 8 ? 4 : 0);
+            bool on = chart[cell][7 - y % 8] & (1 << (4 - x % 5));
+            *p++ = on ? '#' : '.';
+        }
+        *p++ = '\n';
+    }
+    *p = 0;
+}
+
+static void assert_chart(const char *const golden[KLINE_CHART_HEIGHT], const int64_t *values, int count,
+                         int newest_row)
+{
+    chart_image_t expected;
+    chart_image_t actual;
+    char *p = expected;
+    for (int row = 0; row < KLINE_CHART_HEIGHT; row++)
+    {
+        p += sprintf(p, "%s\n", golden[row]);
+    }
+    TEST_ASSERT_EQUAL_INT(newest_row, kline_chart_render(values, count, glyphs));
+    chart_to_text(glyphs, actual);
+    TEST_ASSERT_EQUAL_STRING(expected, actual);
+}
+
+static void test_ramp(void)
+{
+    static const char *const golden[] = {
+        "...................#", "..................#.", ".................#..", "...............##...",
+        "..............#.....", ".............#......", "............#.......", "..........##........",
+        ".........#..........", "........#...........", "......##............", ".....#..............",
+        "....#...............", "..##................", ".#..................", "#...................",
+    };
+    int64_t values[20];
+    for (int i = 0; i < 20; i++)
+    {
+        values[i] = 100000000LL * i; // 0.00 .. 19.00 in 1e-8 units
+    }
+    assert_chart(golden, values, 20, 15);
+}
+
+// No division by a zero range: a line through the middle
+static void test_flat(void)
+{
+    static const char *const golden[] = {
+        "....................", "....................", "....................", "....................",
+        "....................", "....................", "....................", "....................",
+        "####################", "....................", "....................", "....................",
+        "....................", "....................", "....................", "....................",
+    };
+    int64_t values[20];
+    for (int i = 0; i < 20; i++)
+    {
+        values[i] = 245000000000LL;
+    }
+    assert_chart(golden, values, 20, 7);
+}
+
+static void test_single_value(void)
+{
+    static const char *const golden[] = {
+        "....................", "....................", "....................", "....................",
+        "....................", "....................", "....................", "....................",
+        "...................#", "....................", "....................", "....................",
+        "....................", "....................", "....................", "....................",
+    };
+    int64_t value = 7;
+    assert_chart(golden, &value, 1, 7);
+}
+
+// Fewer values than columns are right aligned; jumps are joined halfway
+static void test_few_values(void)
+{
+    static const char *const golden[] = {
+        "..................#.", "..................#.", "..................#.", "..................#.",
+        "..................##", "..................##", ".................#..", ".................#..",
+        ".................#..", ".................#..", "................##..", "................##..",
+        "................##..", "...............#....", "...............#....", "...............#....",
+    };
+    static const int64_t values[] = {10, 20, 15, 40, 30};
+    assert_chart(golden, values, 5, 10);
+}
+
+static void test_step(void)
+{
+    static const char *const golden[] = {
+        "..........##########", "..........#.........", "..........#.........", "..........#.........",
+        "..........#.........", "..........#.........", "..........#.........", "..........#.........",
+        ".........#..........", ".........#..........", ".........#..........", ".........#..........",
+        ".........#..........", ".........#..........", ".........#..........", "##########..........",
+    };
+    int64_t values[20];
+    for (int i = 0; i < 20; i++)
+    {
+        values[i] = i < 10 ? 0 : 1500;
+    }
+    assert_chart(golden, values, 20, 15);
+}
+
+static void test_spikes(void)
+{
+    static const char *const golden[] = {
+        ".......#............", ".......#............", ".......#............", ".......#............",
+        "......##............", "......#.#...........", "......#.#...........", "......#.#...........",
+        "#######.#####.######", "............#.#.....", "............#.#.....", "............#.#.....",
+        "............##......", ".............#......", ".............#......", ".............#......",
+    };
+    int64_t values[20] = {0};
+    values[7] = 1000;
+    values[13] = -1000;
+    assert_chart(golden, values, 20, 7);
+}
+
+// A range wider than 64 bit signed maths: no overflow, both ends in rows
+static void test_full_int64_range(void)
+{
+    static const char *const golden[] = {
+        ".#.#.#.#.#.#.#.#.#.#", ".#.#.#.#.#.#.#.#.#.#", ".#.#.#.#.#.#.#.#.#.#", ".#.#.#.#.#.#.#.#.#.#",
+        ".#.#.#.#.#.#.#.#.#.#", ".#.#.#.#.#.#.#.#.#.#", ".#.#.#.#.#.#.#.#.#.#", ".#.#.#.#.#.#.#.#.#.#",
+        "###################.", "#.#.#.#.#.#.#.#.#.#.", "#.#.#.#.#.#.#.#.#.#.", "#.#.#.#.#.#.#.#.#.#.",
+        "#.#.#.#.#.#.#.#.#.#.", "#.#.#.#.#.#.#.#.#.#.", "#.#.#.#.#.#.#.#.#.#.", "#.#.#.#.#.#.#.#.#.#.",
+    };
+    int64_t values[20];
+    for (int i = 0; i < 20; i++)
+    {
+        values[i] = i % 2 ? INT64_MAX : INT64_MIN;
+    }
+    assert_chart(golden, values, 20, 15);
+}
+
+// Only the newest KLINE_CHART_WIDTH values count, also for the scale
+static void test_more_values_than_columns(void)
+{
+    static const char *const golden[] = {
+        "...................#", "..................#.", "................##..", "...............#....",
+        "..............#.....", ".............#......", "...........##.......", "..........#.........",
+        ".........#..........", ".......##...........", "......#.............", ".....#..............",
+        "....#...............", "..##................", ".#..................", "#...................",
+    };
+    int64_t values[30];
+    for (int i = 0; i < 30; i++)
+    {
+        values[i] = i < 10 ? 1000000 : (i - 10) * 10;
+    }
+    assert_chart(golden, values, 30, 15);
+}
+
+static void test_empty(void)
+{
+    static const kline_chart_glyphs_t blank = {{0}};
+    memset(glyphs, 0xFF, sizeof(glyphs));
+    TEST_ASSERT_EQUAL_INT(-1, kline_chart_render(NULL, 0, glyphs));
+    TEST_ASSERT_EQUAL_MEMORY(blank, glyphs, sizeof(glyphs));
+}
+
+static void test_pixel_out_of_range(void)
+{
+    static const kline_chart_glyphs_t blank = {{0}};
+    memset(glyphs, 0, sizeof(glyphs));
+    kline_chart_pixel(glyphs, -1, 0, true);
+    kline_chart_pixel(glyphs, KLINE_CHART_WIDTH, 0, true);
+    kline_chart_pixel(glyphs, 0, -1, true);
+    kline_chart_pixel(glyphs, 0, KLINE_CHART_HEIGHT, true);
+    TEST_ASSERT_EQUAL_MEMORY(blank, glyphs, sizeof(glyphs));
+    kline_chart_pixel(glyphs, 19, 15, true);
+    TEST_ASSERT_EQUAL(0x01, glyphs[3][0]);
+    kline_chart_pixel(glyphs, 19, 15, false);
+    TEST_ASSERT_EQUAL(0x00, glyphs[3][0]);
+}
+
+// Not a pass/fail test: the time per frame on this host
+static void bench_render(void)
+{
+    int64_t values[KLINE_CHART_WIDTH];
+    uint32_t seed = 1;
+    for (int i = 0; i < KLINE_CHART_WIDTH; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        values[i] = 245000000000LL + (seed >> 8) % 2000000000;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int sink = 0;
+    for (int frame = 0; frame < BENCH_FRAMES; frame++)
+    {
+        values[frame % KLINE_CHART_WIDTH] += frame & 0xFFFF; // keep the compiler from hoisting the render
+        sink += kline_chart_render(values, KLINE_CHART_WIDTH, glyphs);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("kline_chart_render: %.0f ns per %d column frame (%d)\n", ns / BENCH_FRAMES, KLINE_CHART_WIDTH,
+           sink & 1);
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_ramp);
+    RUN_TEST(test_flat);
+    RUN_TEST(test_single_value);
+    RUN_TEST(test_few_values);
+    RUN_TEST(test_step);
+    RUN_TEST(test_spikes);
+    RUN_TEST(test_full_int64_range);
+    RUN_TEST(test_more_values_than_columns);
+    RUN_TEST(test_empty);
+    RUN_TEST(test_pixel_out_of_range);
+    bench_render();
+    exit(UNITY_END());
+}
@@ -0,0 +1,107 @@
+#include <string.h>
+#include "kline_chart.h"
+
+#define KLINE_CHART_CELL_WIDTH 5
+#define KLINE_CHART_CELL_HEIGHT 8
+#define KLINE_CHART_CELLS_PER_ROW (KLINE_CHART_WIDTH / KLINE_CHART_CELL_WIDTH)
+#define KLINE_CHART_FRAC_BITS 32
+
+void kline_chart_pixel(kline_chart_glyphs_t glyphs, int x, int y, bool on)
+{
+    if (x < 0 || x >= KLINE_CHART_WIDTH || y < 0 || y >= KLINE_CHART_HEIGHT)
+    {
+        return;
+    }
+    int cell = x / KLINE_CHART_CELL_WIDTH;
+    if (y < KLINE_CHART_CELL_HEIGHT)
+    {
+        cell += KLINE_CHART_CELLS_PER_ROW; // Bottom row of cells
+    }
+    uint8_t *line = &glyphs[cell][KLINE_CHART_CELL_HEIGHT - 1 - y % KLINE_CHART_CELL_HEIGHT];
+    uint8_t bit = 1 << (KLINE_CHART_CELL_WIDTH - 1 - x % KLINE_CHART_CELL_WIDTH);
+    if (on)
+    {
+        *line |= bit;
+    }
+    else
+    {
+        *line &= ~bit;
+    }
+}
+
+// Fill column x from row `from` to `to`, both included
+static void kline_chart_span(kline_chart_glyphs_t glyphs, int x, int from, int to)
+{
+    int step = from <= to ? 1 : -1;
+    for (int y = from;; y += step)
+    {
+        kline_chart_pixel(glyphs, x, y, true);
+        if (y == to)
+        {
+            break;
+        }
+    }
+}
+
+int kline_chart_render(const int64_t *values, int count, kline_chart_glyphs_t glyphs)
+{
+    memset(glyphs, 0, sizeof(kline_chart_glyphs_t));
+    if (count <= 0)
+    {
+        return -1;
+    }
+    if (count > KLINE_CHART_WIDTH)
+    {
+        values += count - KLINE_CHART_WIDTH;
+        count = KLINE_CHART_WIDTH;
+    }
+
+    int64_t low = values[0];
+    int64_t high = values[0];
+    for (int i = 1; i < count; i++)
+    {
+        low = values[i] < low ? values[i] : low;
+        high = values[i] > high ? values[i] : high;
+    }
+    // (height - 1) / range as 32.32 fixed point: the only division. A range
+    // that does not fit 32 bits is shifted down with the values, so the
+    // products below stay within 64 bits.
+    uint64_t range = (uint64_t)high - (uint64_t)low;
+    int shift = 0;
+    while (range >> shift > UINT32_MAX)
+    {
+        shift++;
+    }
+    uint64_t scaled_range = range >> shift;
+    uint64_t scale = scaled_range ? ((uint64_t)(KLINE_CHART_HEIGHT - 1) << KLINE_CHART_FRAC_BITS) / scaled_range : 0;
+
+    int x0 = KLINE_CHART_WIDTH - count;
+    int prev = -1;
+    for (int i = 0; i < count; i++)
+    {
+        int y;
+        if (scale == 0)
+        {
+            y = (KLINE_CHART_HEIGHT - 1) / 2;
+        }
+        else
+        {
+            uint64_t offset = ((uint64_t)values[i] - (uint64_t)low) >> shift;
+            y = (int)((offset * scale + (1ULL << (KLINE_CHART_FRAC_BITS - 1))) >> KLINE_CHART_FRAC_BITS);
+            y = y < KLINE_CHART_HEIGHT ? y : KLINE_CHART_HEIGHT - 1;
+        }
+        int x = x0 + i;
+        if (prev >= 0 && (y - prev > 1 || prev - y > 1))
+        {
+            // Join the columns: the previous one climbs to halfway, this
+            // one covers the rest
+            int mid = (prev + y) / 2;
+            int step = y > prev ? 1 : -1;
+            kline_chart_span(glyphs, x - 1, prev + step, mid);
+            kline_chart_span(glyphs, x, mid + step, y);
+        }
+        kline_chart_pixel(glyphs, x, y, true);
+        prev = y;
+    }
+    return prev;
+}
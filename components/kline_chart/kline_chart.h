@@ -0,0 +1,40 @@
+#ifndef KLINE_CHART_H
+#define KLINE_CHART_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 4x2 character cells of 5x8 pixels
+#define KLINE_CHART_WIDTH 20
+#define KLINE_CHART_HEIGHT 16
+#define KLINE_CHART_GLYPHS 8
+
+    /*
+     * Glyph i is the cell at column i % 4, top row for 0-3 and bottom row
+     * for 4-7, in the HD44780 CGRAM layout: one byte per pixel row, top row
+     * first, the leftmost pixel in bit 4.
+     */
+    typedef uint8_t kline_chart_glyphs_t[KLINE_CHART_GLYPHS][8];
+
+    /*
+     * Draw the newest KLINE_CHART_WIDTH of `count` values as a line, one
+     * value per pixel column, right aligned when there are fewer. Any fixed
+     * point unit works: the series is scaled to the chart height with one
+     * division per call, rounded to the nearest pixel row. A flat series is
+     * drawn as a line through the middle. Returns the row of the newest
+     * value, -1 when there is none.
+     */
+    int kline_chart_render(const int64_t *values, int count, kline_chart_glyphs_t glyphs);
+    // Set or clear one pixel, y counts up from the bottom
+    void kline_chart_pixel(kline_chart_glyphs_t glyphs, int x, int y, bool on);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KLINE_CHART_H
@@ -0,0 +1,49 @@
+#include <string.h>
+#include "mailbox.h"
+
+void mailbox_init(mailbox_t *mailbox, void *slots, size_t size)
+{
+    memset(mailbox, 0, sizeof(*mailbox));
+    mailbox->slots = slots;
+    mailbox->size = size;
+    atomic_init(&mailbox->middle, 1);
+    mailbox->back = 0;
+    mailbox->front = 2;
+}
+
+void mailbox_set_notify(mailbox_t *mailbox, EventGroupHandle_t events, EventBits_t bit)
+{
+    mailbox->events = events;
+    mailbox->bit = bit;
+}
+
+void *mailbox_back(mailbox_t *mailbox)
+{
+    return mailbox->slots + mailbox->back * mailbox->size;
+}
+
+void mailbox_publish(mailbox_t *mailbox)
+{
+    mailbox->seq[mailbox->back] = ++mailbox->published;
+    unsigned old = atomic_exchange(&mailbox->middle, mailbox->back | MAILBOX_FRESH);
+    mailbox->back = old & ~MAILBOX_FRESH;
+    if (mailbox->events)
+    {
+        xEventGroupSetBits(mailbox->events, mailbox->bit);
+    }
+}
+
+const void *mailbox_take(mailbox_t *mailbox, uint32_t *seq)
+{
+    if (!(atomic_load(&mailbox->middle) & MAILBOX_FRESH))
+    {
+        return NULL;
+    }
+    unsigned old = atomic_exchange(&mailbox->middle, mailbox->front);
+    mailbox->front = old & ~MAILBOX_FRESH;
+    if (seq)
+    {
+        *seq = mailbox->seq[mailbox->front];
+    }
+    return mailbox->slots + mailbox->front * mailbox->size;
+}
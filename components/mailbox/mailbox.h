@@ -0,0 +1,66 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+    /*
+     * Single producer, single consumer snapshot mailbox. Three slots: the
+     * producer fills `back`, the consumer reads `front`, and the latest
+     * complete snapshot waits in the middle. Publishing and taking are one
+     * atomic exchange each, so neither side ever blocks or sees a half
+     * written snapshot, and an unread snapshot is replaced by a newer one.
+     */
+    typedef struct
+    {
+        uint8_t *slots; // 3 * size bytes
+        size_t size;
+        uint32_t seq[3];         // sequence number of the snapshot in each slot
+        atomic_uint middle;      // slot index, MAILBOX_FRESH when not yet taken
+        uint8_t back;            // producer side
+        uint8_t front;           // consumer side
+        uint32_t published;      // producer side
+        EventGroupHandle_t events;
+        EventBits_t bit;
+    } mailbox_t;
+
+#define MAILBOX_FRESH 0x4u
+
+// Static storage plus mailbox for snapshots of `type`
+#define MAILBOX_DEFINE(name, type)             \
+    static type name##_slots[3];               \
+    static mailbox_t name = {                  \
+        .slots = (uint8_t *)name##_slots,      \
+        .size = sizeof(type),                  \
+        .middle = 1,                           \
+        .back = 0,                             \
+        .front = 2,                            \
+    }
+
+    // For mailboxes that MAILBOX_DEFINE cannot declare, e.g. arrays of
+    // them: `slots` holds three snapshots of `size` bytes each
+    void mailbox_init(mailbox_t *mailbox, void *slots, size_t size);
+    // Optional: set `bit` in `events` whenever a snapshot is published
+    void mailbox_set_notify(mailbox_t *mailbox, EventGroupHandle_t events, EventBits_t bit);
+
+    // Producer: the slot to fill, then publish it
+    void *mailbox_back(mailbox_t *mailbox);
+    void mailbox_publish(mailbox_t *mailbox);
+
+    // Consumer: the newest snapshot if one arrived since the last call,
+    // NULL otherwise. It stays valid until the next mailbox_take().
+    const void *mailbox_take(mailbox_t *mailbox, uint32_t *seq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MAILBOX_H
@@ -0,0 +1,261 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "metrics.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_system.h"
+#endif
+
+#define TAG "METRICS"
+
+#define METRICS_RENDER_BUF 512
+#define METRICS_TASKS_MAX 8
+#define METRICS_LABELS_MAX 32
+
+static const uint16_t s_bounds[METRICS_BUCKETS] = {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000};
+
+static metrics_metric_t *s_head;
+static metrics_metric_t **s_tail = &s_head;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Appended, so metrics render in the order they registered
+void metrics_register(metrics_metric_t *metric)
+{
+    taskENTER_CRITICAL(&s_lock);
+    metric->next = NULL;
+    *s_tail = metric;
+    s_tail = &metric->next;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+void metrics_counter_add(metrics_counter_t *counter, uint32_t n)
+{
+    atomic_fetch_add_explicit(&counter->value, n, memory_order_relaxed);
+}
+
+void metrics_gauge_set(metrics_gauge_t *gauge, int32_t value)
+{
+    atomic_store_explicit(&gauge->value, value, memory_order_relaxed);
+}
+
+void metrics_histogram_observe(metrics_histogram_t *histogram, int64_t us)
+{
+    if (us < 0)
+    {
+        us = 0;
+    }
+    int bucket = 0;
+    while (bucket < METRICS_BUCKETS && (uint64_t)us > (uint64_t)s_bounds[bucket] * histogram->unit_us)
+    {
+        bucket++;
+    }
+    taskENTER_CRITICAL(&s_lock);
+    histogram->counts[bucket]++;
+    histogram->count++;
+    histogram->sum_us += us;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static int32_t metrics_read_heap_free(void *ctx)
+{
+    return esp_get_free_heap_size();
+}
+
+static int32_t metrics_read_heap_min_free(void *ctx)
+{
+    return esp_get_minimum_free_heap_size();
+}
+
+static metrics_gauge_t s_heap_free = {
+    .base = {"heap_free_bytes", "Free heap", NULL, METRICS_GAUGE},
+    .read = metrics_read_heap_free,
+};
+static metrics_gauge_t s_heap_min_free = {
+    .base = {"heap_min_free_bytes", "Lowest free heap since boot", NULL, METRICS_GAUGE},
+    .read = metrics_read_heap_min_free,
+};
+METRICS_AUTO_REGISTER(s_heap_free)
+METRICS_AUTO_REGISTER(s_heap_min_free)
+#endif
+
+typedef struct
+{
+    metrics_gauge_t gauge;
+    char labels[METRICS_LABELS_MAX];
+    const char *task_name;
+} metrics_task_t;
+
+static metrics_task_t s_tasks[METRICS_TASKS_MAX];
+static int s_task_count;
+
+// IDF counts stacks in bytes; -1 while the task does not exist
+static int32_t metrics_read_task_stack(void *ctx)
+{
+    const metrics_task_t *task = ctx;
+    TaskHandle_t handle = xTaskGetHandle(task->task_name);
+    return handle ? (int32_t)uxTaskGetStackHighWaterMark(handle) : -1;
+}
+
+esp_err_t metrics_watch_task(const char *task_name)
+{
+    taskENTER_CRITICAL(&s_lock);
+    metrics_task_t *task = s_task_count < METRICS_TASKS_MAX ? &s_tasks[s_task_count++] : NULL;
+    taskEXIT_CRITICAL(&s_lock);
+    if (task == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(task->labels, sizeof(task->labels), "task=\"%s\"", task_name);
+    task->task_name = task_name;
+    task->gauge.base = (metrics_metric_t){"task_stack_free_bytes", "Unused stack of a task at its deepest", task->labels,
+                                          METRICS_GAUGE};
+    task->gauge.read = metrics_read_task_stack;
+    task->gauge.ctx = task;
+    metrics_register(&task->gauge.base);
+    return ESP_OK;
+}
+
+typedef struct
+{
+    char buf[METRICS_RENDER_BUF];
+    size_t len;
+    metrics_write_cb_t write;
+    void *ctx;
+} metrics_out_t;
+
+static void metrics_printf(metrics_out_t *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Lines never straddle two writes
+static void metrics_printf(metrics_out_t *out, const char *fmt, ...)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(out->buf + out->len, sizeof(out->buf) - out->len, fmt, args);
+        va_end(args);
+        if (n >= 0 && out->len + n < sizeof(out->buf))
+        {
+            out->len += n;
+            return;
+        }
+        if (out->len == 0)
+        {
+            break; // a line longer than the buffer: dropped
+        }
+        out->write(out->ctx, out->buf, out->len);
+        out->len = 0;
+    }
+}
+
+// "{labels}" or "{labels,extra}" or "" for a sample line
+static void metrics_labels(char *buf, size_t size, const char *labels, const char *extra)
+{
+    if (labels && extra)
+    {
+        snprintf(buf, size, "{%s,%s}", labels, extra);
+    }
+    else if (labels || extra)
+    {
+        snprintf(buf, size, "{%s}", labels ? labels : extra);
+    }
+    else
+    {
+        buf[0] = 0;
+    }
+}
+
+static void metrics_render_histogram(metrics_out_t *out, metrics_histogram_t *histogram)
+{
+    uint32_t counts[METRICS_BUCKETS + 1];
+    taskENTER_CRITICAL(&s_lock);
+    memcpy(counts, histogram->counts, sizeof(counts));
+    uint32_t count = histogram->count;
+    uint64_t sum_us = histogram->sum_us;
+    taskEXIT_CRITICAL(&s_lock);
+
+    const metrics_metric_t *m = &histogram->base;
+    char labels[METRICS_LABELS_MAX * 2];
+    char le[24];
+    uint32_t cumulative = 0;
+    for (int b = 0; b <= METRICS_BUCKETS; b++)
+    {
+        cumulative += counts[b];
+        if (b < METRICS_BUCKETS)
+        {
+            snprintf(le, sizeof(le), "le=\"%g\"", s_bounds[b] * histogram->unit_us / 1e6);
+        }
+        else
+        {
+            snprintf(le, sizeof(le), "le=\"+Inf\"");
+        }
+        metrics_labels(labels, sizeof(labels), m->labels, le);
+        metrics_printf(out, "%s_bucket%s %lu\n", m->name, labels, (unsigned long)cumulative);
+    }
+    metrics_labels(labels, sizeof(labels), m->labels, NULL);
+    metrics_printf(out, "%s_sum%s %.6f\n", m->name, labels, sum_us / 1e6);
+    metrics_printf(out, "%s_count%s %lu\n", m->name, labels, (unsigned long)count);
+}
+
+void metrics_render(metrics_write_cb_t write, void *ctx)
+{
+    static const char *const types[] = {"counter", "gauge", "histogram"};
+    metrics_out_t out = {
+        .write = write,
+        .ctx = ctx,
+    };
+    // Registration only appends, so the list can be walked without the lock
+    for (metrics_metric_t *m = s_head; m; m = m->next)
+    {
+        // One HELP and TYPE per family, however many label sets it has
+        bool seen = false;
+        for (metrics_metric_t *prev = s_head; prev != m && !seen; prev = prev->next)
+        {
+            seen = strcmp(prev->name, m->name) == 0;
+        }
+        if (!seen)
+        {
+            metrics_printf(&out, "# HELP %s %s\n# TYPE %s %s\n", m->name, m->help, m->name, types[m->type]);
+        }
+
+        char labels[METRICS_LABELS_MAX + 2];
+        metrics_labels(labels, sizeof(labels), m->labels, NULL);
+        if (m->type == METRICS_COUNTER)
+        {
+            metrics_counter_t *counter = (metrics_counter_t *)m;
+            metrics_printf(&out, "%s%s %u\n", m->name, labels,
+                           atomic_load_explicit(&counter->value, memory_order_relaxed));
+        }
+        else if (m->type == METRICS_GAUGE)
+        {
+            metrics_gauge_t *gauge = (metrics_gauge_t *)m;
+            int32_t value = gauge->read ? gauge->read(gauge->ctx)
+                                        : atomic_load_explicit(&gauge->value, memory_order_relaxed);
+            metrics_printf(&out, "%s%s %ld\n", m->name, labels, (long)value);
+        }
+        else
+        {
+            metrics_render_histogram(&out, (metrics_histogram_t *)m);
+        }
+    }
+    if (out.len)
+    {
+        write(ctx, out.buf, out.len);
+    }
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+esp_err_t metrics_server_start(uint16_t port)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t metrics_server_add(const char *uri, const char *content_type, metrics_render_fn_t render)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
@@ -0,0 +1,113 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+    /*
+     * Registry of counters, gauges and latency histograms, rendered in
+     * Prometheus text format. Metrics are static objects that add
+     * themselves to the registry before app_main() runs; recording is an
+     * atomic add, or a short critical section for histograms.
+     *
+     * Instrument with the macros at the bottom: with CONFIG_METRICS_ENABLE
+     * off they compile to nothing and their arguments are not evaluated.
+     */
+
+    typedef enum
+    {
+        METRICS_COUNTER,
+        METRICS_GAUGE,
+        METRICS_HISTOGRAM,
+    } metrics_type_t;
+
+    typedef struct metrics_metric
+    {
+        const char *name;
+        const char *help;
+        const char *labels; // e.g. "task=\"main\"", NULL for none
+        metrics_type_t type;
+        struct metrics_metric *next;
+    } metrics_metric_t;
+
+    typedef struct
+    {
+        metrics_metric_t base;
+        atomic_uint value; // wraps, which Prometheus reads as a reset
+    } metrics_counter_t;
+
+    typedef struct
+    {
+        metrics_metric_t base;
+        atomic_int value;
+        int32_t (*read)(void *ctx); // sampled at scrape time when set
+        void *ctx;
+    } metrics_gauge_t;
+
+// Bucket bounds run 10, 25, 50, 100 ... 10000 times the histogram's unit
+#define METRICS_BUCKETS 10
+#define METRICS_UNIT_CPU_US 1        // 10us .. 10ms
+#define METRICS_UNIT_NETWORK_US 1000 // 10ms .. 10s
+
+    typedef struct
+    {
+        metrics_metric_t base;
+        uint32_t unit_us;
+        uint32_t counts[METRICS_BUCKETS + 1]; // per bucket, the last is +Inf
+        uint32_t count;
+        uint64_t sum_us;
+    } metrics_histogram_t;
+
+    void metrics_register(metrics_metric_t *metric);
+    void metrics_counter_add(metrics_counter_t *counter, uint32_t n);
+    void metrics_gauge_set(metrics_gauge_t *gauge, int32_t value);
+    void metrics_histogram_observe(metrics_histogram_t *histogram, int64_t us);
+
+    // Render every metric, handing the text out in pieces of up to 512 bytes
+    typedef void (*metrics_write_cb_t)(void *ctx, const char *text, size_t len);
+    void metrics_render(metrics_write_cb_t write, void *ctx);
+
+    // Export the free stack of a task as task_stack_free_bytes{task="..."}
+    esp_err_t metrics_watch_task(const char *task_name);
+    // Serve GET /metrics. Call once the network is up.
+    esp_err_t metrics_server_start(uint16_t port);
+    // Serve another text document from the same server, e.g. a trace dump;
+    // uri must stay valid. Works before and after metrics_server_start().
+    typedef void (*metrics_render_fn_t)(metrics_write_cb_t write, void *ctx);
+    esp_err_t metrics_server_add(const char *uri, const char *content_type, metrics_render_fn_t render);
+
+#define METRICS_AUTO_REGISTER(var)                                   \
+    __attribute__((constructor)) static void var##_register(void) \
+    {                                                                \
+        metrics_register(&(var).base);                               \
+    }
+
+#if CONFIG_METRICS_ENABLE
+#define METRICS_COUNTER_DEFINE(var, name, help)                                   \
+    static metrics_counter_t var = {.base = {name, help, NULL, METRICS_COUNTER}}; \
+    METRICS_AUTO_REGISTER(var)
+#define METRICS_HISTOGRAM_DEFINE(var, name, help, unit)                                                    \
+    static metrics_histogram_t var = {.base = {name, help, NULL, METRICS_HISTOGRAM}, .unit_us = (unit)}; \
+    METRICS_AUTO_REGISTER(var)
+#define METRICS_ADD(var, n) metrics_counter_add(&(var), (n))
+#define METRICS_OBSERVE(var, us) metrics_histogram_observe(&(var), (us))
+#else
+#define METRICS_COUNTER_DEFINE(var, name, help)
+#define METRICS_HISTOGRAM_DEFINE(var, name, help, unit)
+#define METRICS_ADD(var, n) ((void)sizeof(n))
+#define METRICS_OBSERVE(var, us) ((void)sizeof(us))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
@@ -0,0 +1,90 @@
+#include "metrics.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+
+#define TAG "METRICS"
+
+#define METRICS_ROUTES_MAX 4
+
+typedef struct
+{
+    httpd_uri_t uri;
+    const char *content_type;
+    metrics_render_fn_t render;
+} metrics_route_t;
+
+static esp_err_t metrics_get_handler(httpd_req_t *req);
+
+static httpd_handle_t s_server;
+static metrics_route_t s_metrics_route = {
+    .uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_get_handler,
+        .user_ctx = &s_metrics_route,
+    },
+    .content_type = "text/plain; version=0.0.4",
+    .render = metrics_render,
+};
+static metrics_route_t s_routes[METRICS_ROUTES_MAX];
+static int s_route_count;
+
+static void metrics_send(void *ctx, const char *text, size_t len)
+{
+    httpd_resp_send_chunk((httpd_req_t *)ctx, text, len);
+}
+
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+    const metrics_route_t *route = req->user_ctx;
+    httpd_resp_set_type(req, route->content_type);
+    route->render(metrics_send, req);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t metrics_server_add(const char *uri, const char *content_type, metrics_render_fn_t render)
+{
+    if (s_route_count == METRICS_ROUTES_MAX)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    metrics_route_t *route = &s_routes[s_route_count++];
+    route->uri = (httpd_uri_t){
+        .uri = uri,
+        .method = HTTP_GET,
+        .handler = metrics_get_handler,
+        .user_ctx = route,
+    };
+    route->content_type = content_type;
+    route->render = render;
+    return s_server ? httpd_register_uri_handler(s_server, &route->uri) : ESP_OK;
+}
+
+esp_err_t metrics_server_start(uint16_t port)
+{
+    if (s_server)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = port;
+    config.max_uri_handlers = METRICS_ROUTES_MAX + 1;
+    config.max_open_sockets = 2; // a scraper, plus one lingering connection
+    config.lru_purge_enable = true;
+    esp_err_t ret = httpd_start(&s_server, &config);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start the server: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = httpd_register_uri_handler(s_server, &s_metrics_route.uri);
+    for (int i = 0; i < s_route_count && ret == ESP_OK; i++)
+    {
+        ret = httpd_register_uri_handler(s_server, &s_routes[i].uri);
+    }
+    if (ret == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Serving http://<device>:%u/metrics", port);
+    }
+    return ret;
+}
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+#include "nvs_record.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+
+#define TAG "NVS_RECORD"
+#define NVS_RECORD_NAMESPACE "records"
+
+typedef struct
+{
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t size; // of the payload that follows
+    uint32_t crc;  // esp_rom_crc32_le() of the payload
+} nvs_record_header_t;
+
+esp_err_t nvs_record_init(void)
+{
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_LOGW(TAG, "Erasing NVS: %s", esp_err_to_name(ret));
+        ret = nvs_flash_erase();
+        if (ret == ESP_OK)
+        {
+            ret = nvs_flash_init();
+        }
+    }
+    return ret;
+}
+
+// Header and payload as one blob, allocated by the caller's size
+static esp_err_t nvs_record_read(nvs_handle_t nvs, const char *key, nvs_record_header_t *blob, size_t blob_size)
+{
+    size_t length = 0;
+    esp_err_t ret = nvs_get_blob(nvs, key, NULL, &length);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    if (length != blob_size)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return nvs_get_blob(nvs, key, blob, &length);
+}
+
+esp_err_t nvs_record_load(const char *key, uint16_t version, void *data, size_t size)
+{
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(NVS_RECORD_NAMESPACE, NVS_READONLY, &nvs);
+    if (ret != ESP_OK)
+    {
+        return ret == ESP_ERR_NVS_NOT_FOUND ? ESP_ERR_NOT_FOUND : ret;
+    }
+    size_t blob_size = sizeof(nvs_record_header_t) + size;
+    nvs_record_header_t *blob = malloc(blob_size);
+    if (blob == NULL)
+    {
+        nvs_close(nvs);
+        return ESP_ERR_NO_MEM;
+    }
+    ret = nvs_record_read(nvs, key, blob, blob_size);
+    nvs_close(nvs);
+    if (ret == ESP_ERR_NVS_NOT_FOUND)
+    {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    else if (ret == ESP_OK)
+    {
+        if (blob->version != version || blob->size != size)
+        {
+            ESP_LOGI(TAG, "%s: version %u, expected %u; ignored", key, blob->version, version);
+            ret = ESP_ERR_NOT_FOUND;
+        }
+        else if (esp_rom_crc32_le(0, (const uint8_t *)(blob + 1), size) != blob->crc)
+        {
+            ESP_LOGW(TAG, "%s: CRC mismatch; ignored", key);
+            ret = ESP_ERR_NOT_FOUND;
+        }
+        else
+        {
+            memcpy(data, blob + 1, size);
+        }
+    }
+    free(blob);
+    return ret;
+}
+
+esp_err_t nvs_record_save(const char *key, uint16_t version, const void *data, size_t size)
+{
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(NVS_RECORD_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    size_t blob_size = sizeof(nvs_record_header_t) + size;
+    nvs_record_header_t *blob = malloc(blob_size);
+    if (blob == NULL)
+    {
+        nvs_close(nvs);
+        return ESP_ERR_NO_MEM;
+    }
+    uint32_t crc = esp_rom_crc32_le(0, data, size);
+    // Reading is free as far as wear goes, so an unchanged record costs no erase cycles
+    if (nvs_record_read(nvs, key, blob, blob_size) == ESP_OK && blob->version == version && blob->size == size &&
+        blob->crc == crc && memcmp(blob + 1, data, size) == 0)
+    {
+        ret = ESP_OK;
+    }
+    else
+    {
+        *blob = (nvs_record_header_t){
+            .version = version,
+            .size = size,
+            .crc = crc,
+        };
+        memcpy(blob + 1, data, size);
+        ret = nvs_set_blob(nvs, key, blob, blob_size);
+        if (ret == ESP_OK)
+        {
+            ret = nvs_commit(nvs);
+        }
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "%s: write failed: %s", key, esp_err_to_name(ret));
+        }
+    }
+    free(blob);
+    nvs_close(nvs);
+    return ret;
+}
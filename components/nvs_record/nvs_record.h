@@ -0,0 +1,32 @@
+#ifndef NVS_RECORD_H
+#define NVS_RECORD_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+    /*
+     * Fixed-size binary records in NVS, one blob per key. Each blob starts
+     * with a header holding the layout version, the length and a CRC of
+     * the payload, so a record written by older firmware, or cut short by
+     * a reset, is reported as missing instead of being loaded.
+     */
+
+    // nvs_flash_init(), erasing the partition when it is full or from a
+    // newer NVS format. Safe to call again later.
+    esp_err_t nvs_record_init(void);
+    // ESP_ERR_NOT_FOUND unless a record with this version and size is stored
+    esp_err_t nvs_record_load(const char *key, uint16_t version, void *data, size_t size);
+    // Leaves flash untouched when the stored record is the same
+    esp_err_t nvs_record_save(const char *key, uint16_t version, const void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NVS_RECORD_H
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "price_stream_priv.h"
+
+static const char kline[] =
+    "{\"e\":\"kline\",\"E\":1672515782136,\"s\":\"ETHUSDT\",\"k\":{\"t\":1672515780000,\"T\":1672516079999,"
+    "\"s\":\"ETHUSDT\",\"i\":\"5m\",\"o\":\"3591.35\",\"c\":\"3592.10\",\"h\":\"3593.00\",\"l\":\"3590.80\","
+    "\"v\":\"120.5\",\"x\":false}}";
+static const char trade[] =
+    "{\"e\":\"aggTrade\",\"E\":1672515782136,\"s\":\"BTCUSDT\",\"a\":12,\"p\":\"16541.77\",\"q\":\"0.1\","
+    "\"T\":1672515782136,\"m\":true}";
+
+static price_frame_t frame;
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Feed text in pieces of `piece` bytes, as the WebSocket client hands over
+// frames larger than its buffer
+static bool parse(const char *text, size_t piece)
+{
+    size_t len = strlen(text);
+    price_frame_begin(&frame);
+    for (size_t off = 0; off < len; off += piece)
+    {
+        price_frame_feed(&frame, text + off, len - off < piece ? len - off : piece);
+    }
+    return price_frame_end(&frame);
+}
+
+static void test_kline(void)
+{
+    TEST_ASSERT_TRUE(parse(kline, sizeof(kline)));
+    TEST_ASSERT_EQUAL(PRICE_FRAME_KLINE, frame.event);
+    TEST_ASSERT_EQUAL_STRING("ETHUSDT", frame.tick.symbol);
+    TEST_ASSERT_EQUAL_INT64(1672515780000LL, frame.tick.open_time_ms);
+    TEST_ASSERT_EQUAL_DOUBLE(3591.35, frame.tick.open);
+    TEST_ASSERT_EQUAL_DOUBLE(3593.00, frame.tick.high);
+    TEST_ASSERT_EQUAL_DOUBLE(3590.80, frame.tick.low);
+    TEST_ASSERT_EQUAL_DOUBLE(3592.10, frame.tick.close);
+}
+
+// A trade has no candle: every price is the traded one
+static void test_trade(void)
+{
+    TEST_ASSERT_TRUE(parse(trade, sizeof(trade)));
+    TEST_ASSERT_EQUAL(PRICE_FRAME_TRADE, frame.event);
+    TEST_ASSERT_EQUAL_STRING("BTCUSDT", frame.tick.symbol);
+    TEST_ASSERT_EQUAL_INT64(0, frame.tick.open_time_ms);
+    TEST_ASSERT_EQUAL_DOUBLE(16541.77, frame.tick.open);
+    TEST_ASSERT_EQUAL_DOUBLE(16541.77, frame.tick.high);
+    TEST_ASSERT_EQUAL_DOUBLE(16541.77, frame.tick.low);
+    TEST_ASSERT_EQUAL_DOUBLE(16541.77, frame.tick.close);
+}
+
+static void test_split_anywhere(void)
+{
+    for (size_t piece = 1; piece < sizeof(kline); piece++)
+    {
+        TEST_ASSERT_TRUE(parse(kline, piece));
+        TEST_ASSERT_EQUAL_INT64(1672515780000LL, frame.tick.open_time_ms);
+        TEST_ASSERT_EQUAL_DOUBLE(3592.10, frame.tick.close);
+    }
+}
+
+// The frame that follows a kline must not see its fields
+static void test_frames_independent(void)
+{
+    TEST_ASSERT_TRUE(parse(kline, sizeof(kline)));
+    TEST_ASSERT_FALSE(parse("{\"result\":null,\"id\":1}", 64));
+    TEST_ASSERT_EQUAL(PRICE_FRAME_NONE, frame.event);
+    TEST_ASSERT_EQUAL_INT64(0, frame.tick.open_time_ms);
+}
+
+static void test_broken_frame(void)
+{
+    char cut[sizeof(kline)];
+    memcpy(cut, kline, sizeof(kline));
+    cut[sizeof(kline) / 2] = 0;
+    TEST_ASSERT_FALSE(parse(cut, sizeof(cut)));
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_kline);
+    RUN_TEST(test_trade);
+    RUN_TEST(test_split_anywhere);
+    RUN_TEST(test_frames_independent);
+    RUN_TEST(test_broken_frame);
+    exit(UNITY_END());
+}
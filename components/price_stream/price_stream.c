@@ -0,0 +1,129 @@
+#include <string.h>
+#include "price_stream.h"
+#include "price_stream_priv.h"
+#include "esp_websocket_client.h"
+#include "esp_crt_bundle.h"
+#include "esp_log.h"
+
+#define TAG "PRICE_STREAM"
+
+#define WS_OPCODE_TEXT 0x1
+
+static price_stream_config_t s_config;
+static esp_websocket_client_handle_t s_client;
+static volatile bool s_up;
+
+static bool s_in_text; // frames larger than the client buffer arrive in parts
+static price_frame_t s_frame;
+
+static void price_stream_set_up(bool up)
+{
+    if (s_up == up)
+    {
+        return;
+    }
+    s_up = up;
+    ESP_LOGI(TAG, "stream %s", up ? "up" : "down");
+    if (s_config.on_state)
+    {
+        s_config.on_state(s_config.ctx, up);
+    }
+}
+
+static void price_stream_on_data(const esp_websocket_event_data_t *data)
+{
+    if (data->payload_offset == 0)
+    {
+        // Pings are answered by the client, pongs and binary frames ignored
+        s_in_text = data->op_code == WS_OPCODE_TEXT;
+        if (!s_in_text)
+        {
+            return;
+        }
+        price_frame_begin(&s_frame);
+    }
+    else if (!s_in_text)
+    {
+        return;
+    }
+    price_frame_feed(&s_frame, data->data_ptr, data->data_len);
+    if (data->payload_offset + data->data_len >= data->payload_len && price_frame_end(&s_frame))
+    {
+        price_stream_set_up(true);
+        if (s_config.on_tick)
+        {
+            s_config.on_tick(s_config.ctx, &s_frame.tick);
+        }
+    }
+}
+
+static void price_stream_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)event_data;
+    switch (event_id)
+    {
+    case WEBSOCKET_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "connected to %s", s_config.uri);
+        // A reconnect starts a new session: subscribe again
+        if (s_config.subscribe &&
+            esp_websocket_client_send_text(s_client, s_config.subscribe, strlen(s_config.subscribe), pdMS_TO_TICKS(1000)) < 0)
+        {
+            ESP_LOGE(TAG, "subscribe failed");
+        }
+        break;
+    case WEBSOCKET_EVENT_DATA:
+        price_stream_on_data(data);
+        break;
+    case WEBSOCKET_EVENT_DISCONNECTED:
+    case WEBSOCKET_EVENT_CLOSED:
+        ESP_LOGW(TAG, "disconnected, reconnecting in %lu ms", (unsigned long)s_config.reconnect_ms);
+        price_stream_set_up(false);
+        break;
+    case WEBSOCKET_EVENT_ERROR:
+        ESP_LOGE(TAG, "websocket error");
+        price_stream_set_up(false);
+        break;
+    default:
+        break;
+    }
+}
+
+esp_err_t price_stream_start(const price_stream_config_t *config)
+{
+    if (s_client)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_config = *config;
+    esp_websocket_client_config_t ws_config = {
+        .uri = config->uri,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .buffer_size = 1024,
+        .task_stack = 4 * 1024,
+        .reconnect_timeout_ms = config->reconnect_ms,
+        .network_timeout_ms = 10 * 1000,
+        .ping_interval_sec = config->ping_interval_s,
+        .pingpong_timeout_sec = config->pong_timeout_s,
+    };
+    s_client = esp_websocket_client_init(&ws_config);
+    if (s_client == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t ret = esp_websocket_register_events(s_client, WEBSOCKET_EVENT_ANY, price_stream_event_handler, NULL);
+    if (ret == ESP_OK)
+    {
+        ret = esp_websocket_client_start(s_client);
+    }
+    if (ret != ESP_OK)
+    {
+        esp_websocket_client_destroy(s_client);
+        s_client = NULL;
+    }
+    return ret;
+}
+
+bool price_stream_is_up(void)
+{
+    return s_up;
+}
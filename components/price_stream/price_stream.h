@@ -0,0 +1,58 @@
+#ifndef PRICE_STREAM_H
+#define PRICE_STREAM_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+    // One push from the stream: a kline update or a single trade
+#define PRICE_STREAM_SYMBOL_MAX 16
+
+    typedef struct
+    {
+        char symbol[PRICE_STREAM_SYMBOL_MAX]; // as sent, e.g. "ETHUSDT"
+        int64_t open_time_ms; // candle the prices belong to, 0 for a trade
+        double open;
+        double high;
+        double low;
+        double close; // last traded price
+    } price_tick_t;
+
+    typedef void (*price_stream_tick_cb_t)(void *ctx, const price_tick_t *tick);
+    // up: pushes are arriving, down: the connection dropped
+    typedef void (*price_stream_state_cb_t)(void *ctx, bool up);
+
+    typedef struct
+    {
+        // ws:// or wss:// endpoint, e.g. "wss://stream.binance.com:9443/ws"
+        // or a local server replaying recorded frames
+        const char *uri;
+        // Sent after every (re)connect, NULL when the URI already selects
+        // the streams
+        const char *subscribe;
+        uint32_t ping_interval_s;
+        uint32_t pong_timeout_s; // reconnect when a ping goes unanswered this long
+        uint32_t reconnect_ms;
+        price_stream_tick_cb_t on_tick;
+        price_stream_state_cb_t on_state;
+        void *ctx;
+    } price_stream_config_t;
+
+    /*
+     * Keep one WebSocket subscription open in the background. Binance
+     * "kline" and "aggTrade" events are understood; the callbacks run on
+     * the WebSocket client's task.
+     */
+    esp_err_t price_stream_start(const price_stream_config_t *config);
+    bool price_stream_is_up(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PRICE_STREAM_H
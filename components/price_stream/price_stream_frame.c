@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "price_stream_priv.h"
+
+#define TAG "PRICE_STREAM"
+
+/*
+    {"e":"kline","E":1672515782136,"s":"ETHUSDT","k":{"t":1672515780000,
+     "o":"3591.35","c":"3592.10","h":"3593.00","l":"3590.80",...}}
+    {"e":"aggTrade","E":1672515782136,"s":"ETHUSDT","p":"3592.10",...}
+*/
+enum
+{
+    PATH_EVENT,
+    PATH_SYMBOL,
+    PATH_OPEN_TIME,
+    PATH_OPEN,
+    PATH_HIGH,
+    PATH_LOW,
+    PATH_CLOSE,
+    PATH_TRADE_PRICE,
+};
+static const char *const s_paths[] = {"e", "s", "k.t", "k.o", "k.h", "k.l", "k.c", "p"};
+
+static void price_frame_on_value(void *ctx, int path, int index, const char *value, size_t len)
+{
+    price_frame_t *frame = (price_frame_t *)ctx;
+    price_tick_t *tick = &frame->tick;
+    switch (path)
+    {
+    case PATH_EVENT:
+        frame->event = strcmp(value, "kline") == 0      ? PRICE_FRAME_KLINE
+                       : strcmp(value, "aggTrade") == 0 ? PRICE_FRAME_TRADE
+                                                        : PRICE_FRAME_NONE;
+        break;
+    case PATH_SYMBOL:
+        snprintf(tick->symbol, sizeof(tick->symbol), "%s", value);
+        break;
+    case PATH_OPEN_TIME:
+        tick->open_time_ms = strtoll(value, NULL, 10);
+        break;
+    case PATH_OPEN:
+        tick->open = strtod(value, NULL);
+        break;
+    case PATH_HIGH:
+        tick->high = strtod(value, NULL);
+        break;
+    case PATH_LOW:
+        tick->low = strtod(value, NULL);
+        break;
+    case PATH_CLOSE:
+    case PATH_TRADE_PRICE:
+        tick->close = strtod(value, NULL);
+        break;
+    default:
+        break;
+    }
+}
+
+void price_frame_begin(price_frame_t *frame)
+{
+    json_stream_init(&frame->js, s_paths, sizeof(s_paths) / sizeof(s_paths[0]), price_frame_on_value, frame);
+    frame->err = ESP_OK;
+    frame->event = PRICE_FRAME_NONE;
+    memset(&frame->tick, 0, sizeof(frame->tick));
+}
+
+void price_frame_feed(price_frame_t *frame, const char *data, size_t len)
+{
+    if (frame->err == ESP_OK)
+    {
+        frame->err = json_stream_feed(&frame->js, data, len);
+    }
+}
+
+bool price_frame_end(price_frame_t *frame)
+{
+    if (frame->err == ESP_OK)
+    {
+        frame->err = json_stream_finish(&frame->js);
+    }
+    if (frame->err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "unparsable frame: %s", esp_err_to_name(frame->err));
+        return false;
+    }
+    if (frame->event == PRICE_FRAME_TRADE)
+    {
+        frame->tick.open_time_ms = 0;
+        frame->tick.open = frame->tick.high = frame->tick.low = frame->tick.close;
+    }
+    return frame->event != PRICE_FRAME_NONE; // Subscription replies and anything else
+}
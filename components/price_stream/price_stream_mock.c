@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "price_stream.h"
+#include "price_stream_priv.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TAG "PRICE_STREAM"
+
+/*
+ * Linux builds replay recorded frames instead of opening a WebSocket.
+ * ws[s]://host[:port]/path is served from $CRYPTOTAG_FIXTURES/host/path
+ * ("fixtures" when unset), one frame per line, each after the number of
+ * milliseconds it starts with:
+ *
+ *   2000 {"e":"kline","E":1760009100000,"s":"ETHUSDT","k":{...}}
+ *
+ * The stream goes down after the last frame and, reconnect_ms later,
+ * plays the file again from the top, like a dropped connection. Without
+ * the file there is no stream and prices come from REST polling.
+ */
+
+#define PRICE_STREAM_PATH_MAX 256
+#define PRICE_STREAM_LINE_MAX 1024
+#define PRICE_STREAM_TASK_STACK_SIZE 4096
+
+static price_stream_config_t s_config;
+static char s_path[PRICE_STREAM_PATH_MAX];
+static TaskHandle_t s_task;
+static volatile bool s_up;
+
+static void price_stream_set_up(bool up)
+{
+    if (s_up == up)
+    {
+        return;
+    }
+    s_up = up;
+    ESP_LOGI(TAG, "stream %s", up ? "up" : "down");
+    if (s_config.on_state)
+    {
+        s_config.on_state(s_config.ctx, up);
+    }
+}
+
+static void price_stream_replay(FILE *f)
+{
+    static char line[PRICE_STREAM_LINE_MAX];
+    static price_frame_t frame;
+    while (fgets(line, sizeof(line), f))
+    {
+        char *text;
+        long delay_ms = strtol(line, &text, 10);
+        if (text == line || strspn(text, " \t\r\n") == strlen(text))
+        {
+            continue; // blank line
+        }
+        vTaskDelay(pdMS_TO_TICKS(delay_ms));
+        price_frame_begin(&frame);
+        price_frame_feed(&frame, text, strlen(text));
+        if (price_frame_end(&frame))
+        {
+            price_stream_set_up(true);
+            if (s_config.on_tick)
+            {
+                s_config.on_tick(s_config.ctx, &frame.tick);
+            }
+        }
+    }
+}
+
+static void price_stream_task(void *arg)
+{
+    for (;;)
+    {
+        FILE *f = fopen(s_path, "r");
+        if (f == NULL)
+        {
+            ESP_LOGE(TAG, "No recorded frames in %s", s_path);
+            break;
+        }
+        ESP_LOGI(TAG, "replaying %s", s_path);
+        price_stream_replay(f);
+        fclose(f);
+        price_stream_set_up(false);
+        vTaskDelay(pdMS_TO_TICKS(s_config.reconnect_ms));
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t price_stream_start(const price_stream_config_t *config)
+{
+    if (s_task)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_config = *config;
+    const char *dir = getenv("CRYPTOTAG_FIXTURES");
+    const char *host = strstr(config->uri, "://");
+    host = host ? host + 3 : config->uri;
+    size_t host_len = strcspn(host, ":/?");
+    const char *path = host + host_len;
+    path += strcspn(path, "/?"); // past the port
+    snprintf(s_path, sizeof(s_path), "%s/%.*s%.*s", dir ? dir : "fixtures", (int)host_len, host,
+             (int)strcspn(path, "?"), path);
+    if (xTaskCreate(price_stream_task, "price_stream", PRICE_STREAM_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 2,
+                    &s_task) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool price_stream_is_up(void)
+{
+    return s_up;
+}
@@ -0,0 +1,36 @@
+#ifndef PRICE_STREAM_PRIV_H
+#define PRICE_STREAM_PRIV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "json_stream.h"
+#include "price_stream.h"
+
+typedef enum
+{
+    PRICE_FRAME_NONE,
+    PRICE_FRAME_KLINE,
+    PRICE_FRAME_TRADE,
+} price_frame_event_t;
+
+/*
+ * One text frame being parsed. The WebSocket client hands frames larger
+ * than its buffer over in parts, so a frame is fed piece by piece. The
+ * linux build replays recorded frames through the same parser.
+ */
+typedef struct
+{
+    json_stream_t js;
+    esp_err_t err;
+    price_frame_event_t event;
+    price_tick_t tick;
+} price_frame_t;
+
+void price_frame_begin(price_frame_t *frame);
+void price_frame_feed(price_frame_t *frame, const char *data, size_t len);
+// True for a kline or trade event, which is then in frame->tick. Logs
+// frames that do not parse.
+bool price_frame_end(price_frame_t *frame);
+
+#endif // PRICE_STREAM_PRIV_H
@@ -0,0 +1,209 @@
+#include "scheduler.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "metrics.h"
+#include "trace.h"
+
+#define TAG "SCHEDULER"
+
+#define SCHED_TASK_STACK_SIZE 2048
+
+struct sched_source
+{
+    sched_source_config_t config;
+    int64_t deadline_us; // esp_timer time of the next run, INT64_MAX while busy
+    uint32_t backoff_ms; // current retry delay, 0 while healthy
+    uint32_t failures;   // consecutive
+    bool busy;           // queued or being fetched
+};
+
+METRICS_COUNTER_DEFINE(m_fetches, "sched_fetches_total", "Fetches run by the scheduler")
+METRICS_COUNTER_DEFINE(m_failures, "sched_fetch_failures_total", "Fetches that failed and were retried with backoff")
+METRICS_COUNTER_DEFINE(m_overruns, "sched_fetch_overruns_total", "Fetches that took longer than their timeout")
+
+static sched_source_t s_sources[SCHED_MAX_SOURCES];
+static int s_source_count;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t s_task;
+static StaticTask_t s_task_tcb;
+static StackType_t s_task_stack[SCHED_TASK_STACK_SIZE];
+
+static QueueHandle_t s_work_queue;
+static StaticQueue_t s_work_queue_buf;
+static uint8_t s_work_queue_storage[SCHED_MAX_SOURCES * sizeof(sched_source_t *)];
+static StaticTask_t s_worker_tcb[SCHED_WORKER_COUNT];
+static StackType_t s_worker_stack[SCHED_WORKER_COUNT][SCHED_WORKER_STACK_SIZE];
+
+static uint32_t sched_jitter(const sched_source_t *source)
+{
+    return source->config.jitter_ms ? esp_random() % (source->config.jitter_ms + 1) : 0;
+}
+
+sched_source_t *scheduler_register(const sched_source_config_t *config)
+{
+    sched_source_t *source = NULL;
+    taskENTER_CRITICAL(&s_lock);
+    if (s_source_count < SCHED_MAX_SOURCES)
+    {
+        source = &s_sources[s_source_count];
+        source->config = *config;
+        source->deadline_us = esp_timer_get_time() + config->first_delay_ms * 1000LL;
+        s_source_count++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (source == NULL)
+    {
+        ESP_LOGE(TAG, "No room for source %s", config->name);
+        return NULL;
+    }
+    if (s_task)
+    {
+        xTaskNotifyGive(s_task);
+    }
+    return source;
+}
+
+void scheduler_trigger(sched_source_t *source)
+{
+    scheduler_trigger_in(source, 0);
+}
+
+void scheduler_trigger_in(sched_source_t *source, uint32_t delay_ms)
+{
+    int64_t deadline_us = delay_ms ? esp_timer_get_time() + delay_ms * 1000LL : 0;
+    taskENTER_CRITICAL(&s_lock);
+    source->deadline_us = deadline_us;
+    source->backoff_ms = 0;
+    taskEXIT_CRITICAL(&s_lock);
+    if (s_task)
+    {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+static void sched_worker(void *arg)
+{
+    for (;;)
+    {
+        sched_source_t *source;
+        if (xQueueReceive(s_work_queue, &source, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        int64_t start = esp_timer_get_time();
+        TRACE_BEGIN(source->config.name);
+        esp_err_t err = source->config.fetch(source->config.ctx, source->config.timeout_ms);
+        TRACE_END(source->config.name);
+        int64_t now = esp_timer_get_time();
+        METRICS_ADD(m_fetches, 1);
+        if ((now - start) / 1000 > source->config.timeout_ms)
+        {
+            METRICS_ADD(m_overruns, 1);
+            ESP_LOGW(TAG, "%s took %lld ms, over its %lu ms budget", source->config.name,
+                     (now - start) / 1000, (unsigned long)source->config.timeout_ms);
+        }
+
+        taskENTER_CRITICAL(&s_lock);
+        uint32_t delay_ms;
+        if (err == ESP_OK)
+        {
+            source->backoff_ms = 0;
+            source->failures = 0;
+            delay_ms = source->config.interval_ms;
+        }
+        else
+        {
+            source->backoff_ms = source->backoff_ms ? source->backoff_ms * 2 : source->config.backoff_min_ms;
+            if (source->backoff_ms > source->config.backoff_max_ms)
+            {
+                source->backoff_ms = source->config.backoff_max_ms;
+            }
+            source->failures++;
+            delay_ms = source->backoff_ms;
+        }
+        // A trigger that came in while fetching keeps its own deadline
+        if (source->deadline_us == INT64_MAX)
+        {
+            source->deadline_us = now + (delay_ms + sched_jitter(source)) * 1000LL;
+        }
+        source->busy = false;
+        taskEXIT_CRITICAL(&s_lock);
+
+        if (err != ESP_OK)
+        {
+            METRICS_ADD(m_failures, 1);
+            ESP_LOGW(TAG, "%s failed (%s), %lu in a row, retry in %lu ms", source->config.name,
+                     esp_err_to_name(err), (unsigned long)source->failures, (unsigned long)delay_ms);
+        }
+        xTaskNotifyGive(s_task);
+    }
+}
+
+static void sched_task(void *arg)
+{
+    for (;;)
+    {
+        sched_source_t *due[SCHED_MAX_SOURCES];
+        int due_count = 0;
+        int64_t now = esp_timer_get_time();
+        int64_t next_us = INT64_MAX;
+
+        taskENTER_CRITICAL(&s_lock);
+        for (int i = 0; i < s_source_count; i++)
+        {
+            sched_source_t *source = &s_sources[i];
+            if (source->busy)
+            {
+                continue;
+            }
+            if (source->deadline_us <= now)
+            {
+                source->busy = true;
+                source->deadline_us = INT64_MAX; // the worker sets the next one
+
+                due[due_count++] = source;
+            }
+            else if (source->deadline_us < next_us)
+            {
+                next_us = source->deadline_us;
+            }
+        }
+        taskEXIT_CRITICAL(&s_lock);
+
+        for (int i = 0; i < due_count; i++)
+        {
+            // Never blocks: the queue has room for every source
+            xQueueSend(s_work_queue, &due[i], 0);
+        }
+
+        TickType_t wait = portMAX_DELAY;
+        if (next_us != INT64_MAX)
+        {
+            wait = pdMS_TO_TICKS((next_us - now) / 1000) + 1;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+esp_err_t scheduler_start(UBaseType_t priority, BaseType_t core_id)
+{
+    if (s_task)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_work_queue = xQueueCreateStatic(SCHED_MAX_SOURCES, sizeof(sched_source_t *), s_work_queue_storage,
+                                      &s_work_queue_buf);
+    for (int i = 0; i < SCHED_WORKER_COUNT; i++)
+    {
+        xTaskCreateStaticPinnedToCore(sched_worker, "sched_worker", SCHED_WORKER_STACK_SIZE, NULL, priority,
+                                      s_worker_stack[i], &s_worker_tcb[i], core_id);
+    }
+    // Above the workers so a finished fetch is rescheduled at once
+    s_task = xTaskCreateStaticPinnedToCore(sched_task, "scheduler", SCHED_TASK_STACK_SIZE, NULL, priority + 1,
+                                           s_task_stack, &s_task_tcb, core_id);
+    return s_task ? ESP_OK : ESP_FAIL;
+}
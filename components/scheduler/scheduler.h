@@ -0,0 +1,56 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifndef SCHED_MAX_SOURCES
+#define SCHED_MAX_SOURCES 8
+#endif
+// Sources fetched at the same time
+#ifndef SCHED_WORKER_COUNT
+#define SCHED_WORKER_COUNT 2
+#endif
+#ifndef SCHED_WORKER_STACK_SIZE
+#define SCHED_WORKER_STACK_SIZE (5 * 1024)
+#endif
+
+    // Fetch once; timeout_ms is the source's budget for the whole request
+    typedef esp_err_t (*sched_fetch_fn_t)(void *ctx, uint32_t timeout_ms);
+
+    typedef struct
+    {
+        const char *name;
+        sched_fetch_fn_t fetch;
+        void *ctx;
+        uint32_t interval_ms;    // between successful fetches
+        uint32_t jitter_ms;      // random 0..jitter_ms added to every delay
+        uint32_t backoff_min_ms; // first retry delay after a failure, doubled per failure
+        uint32_t backoff_max_ms;
+        uint32_t timeout_ms;
+        uint32_t first_delay_ms; // from scheduler_start() or registration to the first run
+    } sched_source_config_t;
+
+    typedef struct sched_source sched_source_t;
+
+    // Sources may be registered before or after scheduler_start()
+    sched_source_t *scheduler_register(const sched_source_config_t *config);
+    // Workers run fetches in parallel, a scheduler task sleeps until the
+    // next deadline. Both are pinned to core_id, or tskNO_AFFINITY.
+    esp_err_t scheduler_start(UBaseType_t priority, BaseType_t core_id);
+    // Run the source as soon as a worker is free, and clear its backoff
+    void scheduler_trigger(sched_source_t *source);
+    // Same, but not before delay_ms from now; spreads sources out
+    void scheduler_trigger_in(sched_source_t *source, uint32_t delay_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCHEDULER_H
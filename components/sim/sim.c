@@ -0,0 +1,122 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "sim.h"
+#include "sim_priv.h"
+#include "trace.h"
+
+#define TAG "SIM"
+
+#define SIM_TASK_STACK_SIZE 4096
+#define SIM_FRAME_POLL_MS 20 // virtual; a render pass takes a few ms of bus time
+
+static int64_t s_run_us; // 0: run until killed
+static atomic_uint s_failures;
+
+static void sim_write_file(void *ctx, const char *text, size_t len)
+{
+    fwrite(text, 1, len, (FILE *)ctx);
+}
+
+// Chrome trace JSON of the run, when CRYPTOTAG_TRACE names a file
+static void sim_save_trace(void)
+{
+    const char *path = getenv("CRYPTOTAG_TRACE");
+    FILE *f = path ? fopen(path, "w") : NULL;
+    if (f)
+    {
+        trace_dump(sim_write_file, f);
+        fclose(f);
+    }
+    else if (path)
+    {
+        ESP_LOGE(TAG, "Can't write the trace to %s", path);
+    }
+}
+
+static void sim_print_frame(const sim_screen_t screen, const sim_lcd_stats_t *stats, const sim_lcd_stats_t *prev,
+                            int frame)
+{
+    char border[LCD_COLS + 1];
+    memset(border, '-', LCD_COLS);
+    border[LCD_COLS] = 0;
+    printf("+%s+ %.3f s, frame %d: %lu bytes in %lu transfers, %.2f ms bus\n", border,
+           sim_clock_now_us() / 1e6, frame, (unsigned long)(stats->bytes - prev->bytes),
+           (unsigned long)(stats->transactions - prev->transactions), (stats->bus_ns - prev->bus_ns) / 1e6);
+    for (int row = 0; row < LCD_ROWS; row++)
+    {
+        printf("|%s|\n", screen[row]);
+    }
+    printf("+%s+\n", border);
+    fflush(stdout);
+}
+
+// A frame is whatever changed on screen since the last one; bytes spent on
+// writes that changed nothing visible (CGRAM blinks) go to the next frame
+static void sim_task(void *arg)
+{
+    sim_screen_t last = {{0}};
+    sim_lcd_stats_t prev = {0};
+    int frame = 0;
+    for (;;)
+    {
+        vTaskDelay(pdMS_TO_TICKS(SIM_FRAME_POLL_MS));
+        sim_screen_t screen;
+        sim_lcd_stats_t stats;
+        sim_lcd_snapshot(0, screen, &stats);
+        if (memcmp(screen, last, sizeof(screen)) != 0)
+        {
+            sim_print_frame(screen, &stats, &prev, ++frame);
+            memcpy(last, screen, sizeof(last));
+            prev = stats;
+        }
+        if (s_run_us && sim_clock_now_us() >= s_run_us)
+        {
+            unsigned failures = atomic_load(&s_failures);
+            printf("%d frames, %lu bytes in %lu transfers, %.1f ms bus, %lu timing violations, %u failed checks\n",
+                   frame, (unsigned long)stats.bytes, (unsigned long)stats.transactions, stats.bus_ns / 1e6,
+                   (unsigned long)stats.violations, failures);
+            fflush(stdout);
+            sim_save_trace();
+            exit(stats.violations || failures ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+    }
+}
+
+void sim_start(uint32_t scl_speed_hz)
+{
+    const char *seconds = getenv("CRYPTOTAG_SIM_SECONDS");
+    if (seconds)
+    {
+        s_run_us = atoll(seconds) * 1000000LL;
+    }
+    sim_lcd_attach(scl_speed_hz, 1);
+    if (xTaskCreate(sim_task, "sim", SIM_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to start the screen task");
+        return;
+    }
+    ESP_LOGI(TAG, "Simulating at %lux real time, I2C at %lu Hz", (unsigned long)sim_clock_speed(),
+             (unsigned long)scl_speed_hz);
+}
+
+size_t sim_heap_used(void)
+{
+#ifdef __GLIBC__
+    return mallinfo2().uordblks; // summed over every thread's arena
+#else
+    return 0;
+#endif
+}
+
+void sim_fail(void)
+{
+    atomic_fetch_add(&s_failures, 1);
+}
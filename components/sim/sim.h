@@ -0,0 +1,42 @@
+#ifndef SIM_H
+#define SIM_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+    /*
+     * Linux builds only. The I2C writes of the LCD driver are decoded by an
+     * emulated HD44780 and the screen is printed as text whenever it
+     * changes, with the I2C bytes and bus time spent on that frame.
+     *
+     * Environment:
+     *   CRYPTOTAG_SIM_SPEED    run the clock this many times faster (1)
+     *   CRYPTOTAG_SIM_SECONDS  exit after this much virtual time, with a
+     *                          non-zero status if the LCD timing was violated
+     *                          or a check failed
+     *   CRYPTOTAG_SIM_FOSC_KHZ HD44780 oscillator, which scales its execution
+     *                          times (190, the datasheet's slowest)
+     *   CRYPTOTAG_FIXTURES     recorded HTTP responses, see http_request_mock.c
+     *   CRYPTOTAG_TRACE        file to write the trace buffer to on exit
+     */
+
+    // Call before lcd_init(). scl_speed_hz prices the emulated bus time.
+    void sim_start(uint32_t scl_speed_hz);
+    // Virtual time in microseconds, also returned by esp_timer_get_time()
+    int64_t sim_clock_now_us(void);
+    // Bytes allocated and not freed yet, 0 where the C library can't tell
+    size_t sim_heap_used(void);
+    // Count a failed check, which the caller has logged; a timed run then
+    // exits with a non-zero status
+    void sim_fail(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIM_H
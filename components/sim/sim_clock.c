@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sim.h"
+#include "sim_priv.h"
+
+/*
+ * Virtual clock. CMakeLists.txt links the app with --wrap for the calls
+ * below, so esp_timer_get_time() reads this clock and every blocking wait
+ * sleeps 1/speed of the ticks it asked for. Both run off the host's
+ * monotonic clock, which keeps the app's deadlines and its timeouts in
+ * step at any speed. Tick counts from xTaskGetTickCount() are left alone:
+ * FreeRTOS uses them internally.
+ */
+
+static uint32_t s_speed = 1;
+static int64_t s_origin_us;
+
+void __real_vTaskDelay(const TickType_t ticks);
+EventBits_t __real_xEventGroupWaitBits(EventGroupHandle_t group, const EventBits_t bits, const BaseType_t clear,
+                                       const BaseType_t all, TickType_t ticks);
+uint32_t __real_ulTaskGenericNotifyTake(UBaseType_t index, BaseType_t clear, TickType_t ticks);
+BaseType_t __real_xQueueReceive(QueueHandle_t queue, void *const buffer, TickType_t ticks);
+BaseType_t __real_xQueueSemaphoreTake(QueueHandle_t queue, TickType_t ticks);
+
+static int64_t sim_clock_host_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// Before app_main(), so no task ever sees the clock jump
+__attribute__((constructor)) static void sim_clock_init(void)
+{
+    const char *speed = getenv("CRYPTOTAG_SIM_SPEED");
+    if (speed && atoi(speed) > 1)
+    {
+        s_speed = atoi(speed);
+    }
+    s_origin_us = sim_clock_host_us();
+}
+
+uint32_t sim_clock_speed(void)
+{
+    return s_speed;
+}
+
+int64_t sim_clock_now_us(void)
+{
+    return (sim_clock_host_us() - s_origin_us) * s_speed;
+}
+
+// A wait of at least one tick stays at least one tick long
+static TickType_t sim_clock_ticks(TickType_t ticks)
+{
+    if (ticks == 0 || ticks == portMAX_DELAY)
+    {
+        return ticks;
+    }
+    return ticks / s_speed ? ticks / s_speed : 1;
+}
+
+int64_t __wrap_esp_timer_get_time(void)
+{
+    return sim_clock_now_us();
+}
+
+void __wrap_vTaskDelay(const TickType_t ticks)
+{
+    __real_vTaskDelay(sim_clock_ticks(ticks));
+}
+
+EventBits_t __wrap_xEventGroupWaitBits(EventGroupHandle_t group, const EventBits_t bits, const BaseType_t clear,
+                                       const BaseType_t all, TickType_t ticks)
+{
+    return __real_xEventGroupWaitBits(group, bits, clear, all, sim_clock_ticks(ticks));
+}
+
+uint32_t __wrap_ulTaskGenericNotifyTake(UBaseType_t index, BaseType_t clear, TickType_t ticks)
+{
+    return __real_ulTaskGenericNotifyTake(index, clear, sim_clock_ticks(ticks));
+}
+
+BaseType_t __wrap_xQueueReceive(QueueHandle_t queue, void *const buffer, TickType_t ticks)
+{
+    return __real_xQueueReceive(queue, buffer, sim_clock_ticks(ticks));
+}
+
+BaseType_t __wrap_xQueueSemaphoreTake(QueueHandle_t queue, TickType_t ticks)
+{
+    return __real_xQueueSemaphoreTake(queue, sim_clock_ticks(ticks));
+}
@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "lcd_bus_mock.h"
+#include "i2c_lcd_priv.h"
+#include "sim.h"
+#include "sim_priv.h"
+
+#define TAG "SIM_LCD"
+
+/*
+ * HD44780s behind PCF8574s, fed the bytes lcd_bus_mock.c receives. The
+ * first one answers at LCD_I2C_ADDRESS, any others at the addresses below
+ * it. Every byte is placed on one wire timeline for the whole bus (9 SCL clocks per byte, the address
+ * byte included) so commands can be checked against the controller's
+ * execution times: a byte clocked in while busy is counted as a violation,
+ * the way it would be lost on the real chip. The controller runs at the
+ * slowest clock the datasheet allows unless CRYPTOTAG_SIM_FOSC_KHZ says
+ * otherwise.
+ *
+ * Only status reads are modelled on the read side, which is all the driver
+ * does; DDRAM reads return zeros.
+ */
+
+#define SIM_LCD_EXEC_NS 37000LL        // datasheet, fosc = 270kHz
+#define SIM_LCD_EXEC_SLOW_NS 1520000LL // clear display, return home
+#define SIM_LCD_FOSC_KHZ 270
+#define SIM_LCD_FOSC_MIN_KHZ 190 // the datasheet's worst case, the default
+#define SIM_LCD_LINE_LEN 40            // DDRAM columns per line
+#define SIM_LCD_VIOLATION_LOGS 8
+
+typedef struct
+{
+    uint8_t ddram[2][SIM_LCD_LINE_LEN];
+    uint8_t cgram[64];
+    uint8_t ac;        // address counter, into DDRAM or CGRAM
+    bool ac_cgram;     // the last address set was a CGRAM one
+    bool increment;    // entry mode I/D
+    bool shift_write;  // entry mode S: shift the display on every write
+    bool display_on;
+    bool eight_bit;    // interface width, 8 bits after power-on
+    int shift;         // DDRAM column shown in the first screen column
+    bool low_nibble;   // 4-bit mode: the next EN pulse carries bits 3..0
+    uint8_t high;      // bits 7..4 of the transfer in progress
+    uint8_t port;      // last byte written to the expander
+    int64_t en_rise_ns; // start of the EN pulse in progress
+    int64_t busy_until_ns;
+} sim_hd44780_t;
+
+static sim_hd44780_t s_lcds[LCD_MAX];
+static int s_lcd_count;
+static int64_t s_wire_ns; // when the last byte finished on the bus
+static int64_t s_byte_ns;
+static int64_t s_exec_ns; // SIM_LCD_EXEC_NS at the emulated fosc
+static int64_t s_exec_slow_ns;
+static int64_t s_early_ns; // how early the last violating byte came
+static sim_lcd_stats_t s_stats;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// DDRAM addresses run 0x00..0x27 on line 1 and 0x40..0x67 on line 2; AC
+// steps from the end of one line to the start of the other
+static void sim_lcd_step_ac(sim_hd44780_t *lcd, int delta)
+{
+    if (lcd->ac_cgram)
+    {
+        lcd->ac = (lcd->ac + delta) & 0x3F;
+        return;
+    }
+    int line = lcd->ac >= 0x40;
+    int col = (lcd->ac & 0x3F) + delta;
+    if (col >= SIM_LCD_LINE_LEN)
+    {
+        line ^= 1;
+        col = 0;
+    }
+    else if (col < 0)
+    {
+        line ^= 1;
+        col = SIM_LCD_LINE_LEN - 1;
+    }
+    lcd->ac = line * 0x40 + col;
+}
+
+static void sim_lcd_write_data(sim_hd44780_t *lcd, uint8_t value)
+{
+    if (lcd->ac_cgram)
+    {
+        lcd->cgram[lcd->ac & 0x3F] = value & 0x1F;
+    }
+    else
+    {
+        int col = lcd->ac & 0x3F;
+        lcd->ddram[lcd->ac >= 0x40][col < SIM_LCD_LINE_LEN ? col : 0] = value;
+        if (lcd->shift_write)
+        {
+            lcd->shift += lcd->increment ? 1 : -1;
+        }
+    }
+    sim_lcd_step_ac(lcd, lcd->increment ? 1 : -1);
+}
+
+static void sim_lcd_execute(sim_hd44780_t *lcd, uint8_t value, bool rs, int64_t now_ns)
+{
+    int64_t exec_ns = s_exec_ns;
+    if (rs)
+    {
+        sim_lcd_write_data(lcd, value);
+    }
+    else if (value & 0x80) // set DDRAM address
+    {
+        lcd->ac = value & 0x7F;
+        lcd->ac_cgram = false;
+    }
+    else if (value & 0x40) // set CGRAM address
+    {
+        lcd->ac = value & 0x3F;
+        lcd->ac_cgram = true;
+    }
+    else if (value & 0x20) // function set
+    {
+        lcd->eight_bit = value & 0x10;
+        lcd->low_nibble = false;
+    }
+    else if (value & 0x10) // cursor or display shift
+    {
+        int delta = value & 0x04 ? 1 : -1;
+        if (value & 0x08)
+        {
+            lcd->shift -= delta; // shifting right shows earlier columns
+        }
+        else
+        {
+            sim_lcd_step_ac(lcd, delta);
+        }
+    }
+    else if (value & 0x08) // display on/off
+    {
+        lcd->display_on = value & 0x04;
+    }
+    else if (value & 0x04) // entry mode set
+    {
+        lcd->increment = value & 0x02;
+        lcd->shift_write = value & 0x01;
+    }
+    else if (value & 0x02) // return home
+    {
+        lcd->ac = 0;
+        lcd->ac_cgram = false;
+        lcd->shift = 0;
+        exec_ns = s_exec_slow_ns;
+    }
+    else if (value & 0x01) // clear display
+    {
+        memset(lcd->ddram, ' ', sizeof(lcd->ddram));
+        lcd->ac = 0;
+        lcd->ac_cgram = false;
+        lcd->shift = 0;
+        lcd->increment = true;
+        exec_ns = s_exec_slow_ns;
+    }
+    lcd->busy_until_ns = now_ns + exec_ns;
+}
+
+// The controller latches DB7..DB4 on the falling edge of EN. A write has to
+// wait for the busy flag to clear before its pulse starts.
+static void sim_lcd_strobe(sim_hd44780_t *lcd, uint8_t port, int64_t now_ns)
+{
+    if (port & LCD_RW)
+    {
+        // A status read: in 4-bit mode it still takes two EN pulses
+        lcd->low_nibble = !lcd->eight_bit && !lcd->low_nibble;
+        return;
+    }
+    // Either nibble of a write is lost while the controller is busy
+    if (lcd->en_rise_ns < lcd->busy_until_ns)
+    {
+        s_stats.violations++;
+        s_early_ns = lcd->busy_until_ns - lcd->en_rise_ns;
+    }
+    bool rs = port & LCD_RS;
+    uint8_t nibble = port & 0xF0;
+    if (lcd->eight_bit)
+    {
+        sim_lcd_execute(lcd, nibble, rs, now_ns); // DB3..DB0 are not wired
+    }
+    else if (!lcd->low_nibble)
+    {
+        lcd->high = nibble;
+        lcd->low_nibble = true;
+    }
+    else
+    {
+        lcd->low_nibble = false;
+        sim_lcd_execute(lcd, lcd->high | nibble >> 4, rs, now_ns);
+    }
+}
+
+// Transfers start when the bus is free and the driver has asked for them
+static int64_t sim_lcd_bus_start(void)
+{
+    int64_t now_ns = sim_clock_now_us() * 1000;
+    return now_ns > s_wire_ns ? now_ns : s_wire_ns;
+}
+
+// The mock bus completes transfers before it returns, so the driver must
+// not go on before the last byte is off the wire: its waits for the
+// controller start from there, as they do behind lcd_bus_wait() on the chip
+static void sim_lcd_wire_wait(int64_t end_ns)
+{
+    while (sim_clock_now_us() * 1000 < end_ns)
+    {
+    }
+}
+
+// The controller behind an address, NULL when nothing answers there
+static sim_hd44780_t *sim_lcd_at(uint8_t address)
+{
+    int index = LCD_I2C_ADDRESS - address;
+    return index >= 0 && index < s_lcd_count ? &s_lcds[index] : NULL;
+}
+
+static esp_err_t sim_lcd_sink(uint8_t address, const uint8_t *data, size_t len, void *ctx)
+{
+    sim_hd44780_t *lcd = sim_lcd_at(address);
+    if (lcd == NULL)
+    {
+        return ESP_ERR_NOT_FOUND; // no ACK
+    }
+    taskENTER_CRITICAL(&s_lock);
+    uint32_t violations = s_stats.violations;
+    int64_t start = sim_lcd_bus_start();
+    int64_t t = start + s_byte_ns; // address byte
+    for (size_t i = 0; i < len; i++)
+    {
+        t += s_byte_ns;
+        if (!(lcd->port & LCD_EN) && (data[i] & LCD_EN))
+        {
+            lcd->en_rise_ns = t;
+        }
+        if ((lcd->port & LCD_EN) && !(data[i] & LCD_EN))
+        {
+            sim_lcd_strobe(lcd, lcd->port, t);
+        }
+        lcd->port = data[i];
+    }
+    s_stats.transactions++;
+    s_stats.bytes += len + 1;
+    s_stats.bus_ns += t - start;
+    s_wire_ns = t;
+    bool violated = s_stats.violations != violations;
+    violations = s_stats.violations;
+    int64_t early_ns = s_early_ns;
+    taskEXIT_CRITICAL(&s_lock);
+    sim_lcd_wire_wait(t);
+
+    if (violated && violations <= SIM_LCD_VIOLATION_LOGS)
+    {
+        ESP_LOGW(TAG, "Byte written %lld ns before the controller was ready (%lu so far)", early_ns,
+                 (unsigned long)violations);
+    }
+    return ESP_OK;
+}
+
+// The read that follows a write in lcd_bus_transmit_receive(): a repeated
+// start, the address and one byte from the expander
+static esp_err_t sim_lcd_source(uint8_t address, uint8_t *data, void *ctx)
+{
+    sim_hd44780_t *lcd = sim_lcd_at(address);
+    if (lcd == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    taskENTER_CRITICAL(&s_lock);
+    int64_t t = s_wire_ns + 2 * s_byte_ns;
+    uint8_t port = lcd->port;
+    if ((port & (LCD_RW | LCD_EN)) == (LCD_RW | LCD_EN) && !(port & LCD_RS))
+    {
+        uint8_t status = (t < lcd->busy_until_ns ? 0x80 : 0) | (lcd->ac & 0x7F);
+        uint8_t nibble = lcd->low_nibble ? status << 4 : status & 0xF0;
+        port = (port & 0x0F) | nibble;
+    }
+    else if ((port & (LCD_RW | LCD_EN)) == (LCD_RW | LCD_EN))
+    {
+        port &= 0x0F;
+    }
+    *data = port;
+    s_stats.bytes += 1;
+    s_stats.bus_ns += t - s_wire_ns;
+    s_wire_ns = t;
+    taskEXIT_CRITICAL(&s_lock);
+    sim_lcd_wire_wait(t);
+    return ESP_OK;
+}
+
+void sim_lcd_attach(uint32_t scl_speed_hz, int count)
+{
+    const char *fosc = getenv("CRYPTOTAG_SIM_FOSC_KHZ");
+    int fosc_khz = fosc && atoi(fosc) > 0 ? atoi(fosc) : SIM_LCD_FOSC_MIN_KHZ;
+    s_exec_ns = SIM_LCD_EXEC_NS * SIM_LCD_FOSC_KHZ / fosc_khz;
+    s_exec_slow_ns = SIM_LCD_EXEC_SLOW_NS * SIM_LCD_FOSC_KHZ / fosc_khz;
+    sim_lcd_set_speed(scl_speed_hz);
+    s_lcd_count = count < LCD_MAX ? count : LCD_MAX;
+    for (int i = 0; i < s_lcd_count; i++)
+    {
+        s_lcds[i] = (sim_hd44780_t){
+            .increment = true,
+            .eight_bit = true,
+        };
+        memset(s_lcds[i].ddram, ' ', sizeof(s_lcds[i].ddram));
+    }
+    lcd_bus_mock_set_sink(sim_lcd_sink, NULL);
+    lcd_bus_mock_set_source(sim_lcd_source, NULL);
+}
+
+void sim_lcd_set_speed(uint32_t scl_speed_hz)
+{
+    taskENTER_CRITICAL(&s_lock);
+    s_byte_ns = 9 * 1000000000LL / scl_speed_hz;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+// Rows 3 and 4 of a 4-line module continue lines 1 and 2
+void sim_lcd_snapshot(int display, sim_screen_t screen, sim_lcd_stats_t *stats)
+{
+    const sim_hd44780_t *lcd = &s_lcds[display];
+    taskENTER_CRITICAL(&s_lock);
+    for (int row = 0; row < LCD_ROWS; row++)
+    {
+        const uint8_t *line = lcd->ddram[row & 1];
+        int first = (row >= 2 ? LCD_COLS : 0) + lcd->shift;
+        for (int col = 0; col < LCD_COLS; col++)
+        {
+            int index = (first + col) % SIM_LCD_LINE_LEN;
+            uint8_t c = line[index < 0 ? index + SIM_LCD_LINE_LEN : index];
+            if (!lcd->display_on)
+            {
+                c = ' ';
+            }
+            else if (c < 0x10)
+            {
+                c = '0' + (c & 0x07);
+            }
+            else if (c < 0x20 || c > 0x7E)
+            {
+                c = '?';
+            }
+            screen[row][col] = c;
+        }
+        screen[row][LCD_COLS] = 0;
+    }
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_lock);
+}
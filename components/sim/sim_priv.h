@@ -0,0 +1,29 @@
+#ifndef SIM_PRIV_H
+#define SIM_PRIV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c_lcd.h"
+
+typedef struct
+{
+    uint32_t transactions;
+    uint32_t bytes;     // address bytes included
+    int64_t bus_ns;     // time the bus was busy
+    uint32_t violations; // bytes written while the controller was busy
+} sim_lcd_stats_t;
+
+// Visible characters, one NUL terminated line per row. CGRAM characters
+// show as their slot number '0'..'7'.
+typedef char sim_screen_t[LCD_ROWS][LCD_COLS + 1];
+
+// Emulate `count` displays, at LCD_I2C_ADDRESS and the addresses below it
+void sim_lcd_attach(uint32_t scl_speed_hz, int count);
+// Price the bus time of the bytes from now on at another clock
+void sim_lcd_set_speed(uint32_t scl_speed_hz);
+// Screen of one display; the stats cover the whole bus
+void sim_lcd_snapshot(int display, sim_screen_t screen, sim_lcd_stats_t *stats);
+
+uint32_t sim_clock_speed(void);
+
+#endif // SIM_PRIV_H
@@ -0,0 +1,170 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "stream_pipe.h"
+
+#define PIPE_PRIORITY 8
+#define BENCH_BYTES (16 * 1024 * 1024)
+#define BENCH_HANDOFFS 2000
+
+// What the consumer saw; only read by the test after stream_pipe_close()
+typedef struct
+{
+    size_t offset;
+    size_t calls;
+    bool mismatch;
+    int64_t consumed_us; // when the last chunk arrived
+} consumer_t;
+
+static char data[3 * STREAM_PIPE_CHUNK_SIZE + 17];
+static consumer_t consumer;
+
+void setUp(void)
+{
+    consumer = (consumer_t){0};
+}
+
+void tearDown(void)
+{
+}
+
+// Byte k of a test stream, so order and completeness can be checked
+static char stream_byte(size_t k)
+{
+    return (char)(k * 31 + 7);
+}
+
+static void consume_check(void *ctx, const char *chunk, size_t len)
+{
+    consumer_t *c = ctx;
+    for (size_t i = 0; i < len; i++)
+    {
+        c->mismatch |= chunk[i] != stream_byte(c->offset + i);
+    }
+    c->offset += len;
+    c->calls++;
+}
+
+static void consume_stamp(void *ctx, const char *chunk, size_t len)
+{
+    consumer_t *c = ctx;
+    c->offset += len;
+    c->calls++;
+    c->consumed_us = esp_timer_get_time();
+}
+
+// Writes of every awkward size, around and across the chunk size. Returns
+// the bytes written.
+static size_t write_stream(stream_pipe_t *pipe)
+{
+    static const size_t sizes[] = {
+        1, 7, STREAM_PIPE_CHUNK_SIZE - 1, STREAM_PIPE_CHUNK_SIZE, STREAM_PIPE_CHUNK_SIZE + 1, sizeof(data), 0, 3,
+    };
+    size_t offset = 0;
+    for (int round = 0; round < 20; round++)
+    {
+        for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+        {
+            for (size_t i = 0; i < sizes[s]; i++)
+            {
+                data[i] = stream_byte(offset + i);
+            }
+            stream_pipe_write(pipe, data, sizes[s]);
+            offset += sizes[s];
+        }
+    }
+    return offset;
+}
+
+// Before stream_pipe_start() writes are consumed in place, one call each
+static void test_not_started(void)
+{
+    stream_pipe_t pipe;
+    stream_pipe_open(&pipe, consume_check, &consumer);
+    data[0] = stream_byte(0);
+    stream_pipe_write(&pipe, data, 1);
+    TEST_ASSERT_EQUAL(1, consumer.offset);
+    TEST_ASSERT_EQUAL(1, consumer.calls);
+    stream_pipe_close(&pipe);
+}
+
+static void test_start(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, stream_pipe_start(PIPE_PRIORITY, tskNO_AFFINITY));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, stream_pipe_start(PIPE_PRIORITY, tskNO_AFFINITY));
+}
+
+// Everything written arrives, in order, by the time close returns
+static void test_in_order(void)
+{
+    stream_pipe_t pipe;
+    stream_pipe_open(&pipe, consume_check, &consumer);
+    size_t written = write_stream(&pipe);
+    stream_pipe_close(&pipe);
+    TEST_ASSERT_FALSE(consumer.mismatch);
+    TEST_ASSERT_EQUAL(written, consumer.offset);
+}
+
+// Close of a pipe nothing was written to does not wait for anything else
+static void test_empty_stream(void)
+{
+    stream_pipe_t pipe;
+    stream_pipe_open(&pipe, consume_check, &consumer);
+    stream_pipe_close(&pipe);
+    TEST_ASSERT_EQUAL(0, consumer.calls);
+}
+
+/*
+ * Not pass/fail tests: on this host, the rate at which one producer gets
+ * full chunks to a consumer that does nothing with them, and the time
+ * from a write to its consumption when the pipe is idle.
+ */
+static void bench_throughput(void)
+{
+    stream_pipe_t pipe;
+    stream_pipe_open(&pipe, consume_stamp, &consumer);
+    int64_t start_us = esp_timer_get_time();
+    for (size_t sent = 0; sent < BENCH_BYTES; sent += STREAM_PIPE_CHUNK_SIZE)
+    {
+        stream_pipe_write(&pipe, data, STREAM_PIPE_CHUNK_SIZE);
+    }
+    stream_pipe_close(&pipe);
+    int64_t us = esp_timer_get_time() - start_us;
+    TEST_ASSERT_EQUAL(BENCH_BYTES, consumer.offset);
+    printf("stream_pipe: %.1f MB/s in %d byte chunks, %d buffers\n", (double)BENCH_BYTES / us,
+           STREAM_PIPE_CHUNK_SIZE, STREAM_PIPE_CHUNKS);
+}
+
+static void bench_handoff(void)
+{
+    int64_t total_us = 0;
+    int64_t max_us = 0;
+    for (int i = 0; i < BENCH_HANDOFFS; i++)
+    {
+        stream_pipe_t pipe;
+        stream_pipe_open(&pipe, consume_stamp, &consumer);
+        int64_t start_us = esp_timer_get_time();
+        stream_pipe_write(&pipe, data, 64);
+        stream_pipe_close(&pipe);
+        int64_t us = consumer.consumed_us - start_us;
+        total_us += us;
+        max_us = us > max_us ? us : max_us;
+    }
+    printf("stream_pipe: write to consume %.1f us mean, %lld us max over %d writes\n",
+           (double)total_us / BENCH_HANDOFFS, (long long)max_us, BENCH_HANDOFFS);
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_not_started);
+    RUN_TEST(test_start);
+    RUN_TEST(test_in_order);
+    RUN_TEST(test_empty_stream);
+    bench_throughput();
+    bench_handoff();
+    exit(UNITY_END());
+}
@@ -0,0 +1,145 @@
+#include <string.h>
+#include "stream_pipe.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "trace.h"
+
+#define TAG "STREAM_PIPE"
+
+#define STREAM_PIPE_STACK_SIZE (4 * 1024)
+
+typedef struct
+{
+    stream_pipe_t *pipe;
+    int64_t queued_us;
+    size_t len; // 0 marks the end of the pipe's stream
+    char data[STREAM_PIPE_CHUNK_SIZE];
+} stream_pipe_chunk_t;
+
+/*
+ * Chunks cycle from the free queue to the producer, through the full queue
+ * to the pipe task and back, so nothing is allocated per chunk.
+ */
+static stream_pipe_chunk_t s_chunks[STREAM_PIPE_CHUNKS];
+static QueueHandle_t s_free;
+static QueueHandle_t s_full;
+static StaticQueue_t s_free_buf;
+static StaticQueue_t s_full_buf;
+static uint8_t s_free_storage[STREAM_PIPE_CHUNKS * sizeof(stream_pipe_chunk_t *)];
+static uint8_t s_full_storage[STREAM_PIPE_CHUNKS * sizeof(stream_pipe_chunk_t *)];
+static StaticTask_t s_task_buf;
+static StackType_t s_task_stack[STREAM_PIPE_STACK_SIZE];
+static TaskHandle_t s_task;
+
+METRICS_COUNTER_DEFINE(m_bytes, "stream_pipe_bytes_total", "Bytes passed to the consumer task")
+METRICS_HISTOGRAM_DEFINE(m_queued, "stream_pipe_queued_seconds", "From a chunk's write to the start of its consumption",
+                         METRICS_UNIT_CPU_US)
+METRICS_HISTOGRAM_DEFINE(m_consume, "stream_pipe_consume_seconds", "Consuming one chunk", METRICS_UNIT_CPU_US)
+METRICS_HISTOGRAM_DEFINE(m_stall, "stream_pipe_stall_seconds", "Writers waiting for a free buffer, per chunk",
+                         METRICS_UNIT_CPU_US)
+
+static void stream_pipe_task(void *arg)
+{
+    for (;;)
+    {
+        stream_pipe_chunk_t *chunk;
+        if (xQueueReceive(s_full, &chunk, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        stream_pipe_t *pipe = chunk->pipe;
+        if (chunk->len == 0)
+        {
+            xQueueSend(s_free, &chunk, 0);
+            xSemaphoreGive(pipe->done);
+            continue;
+        }
+        int64_t start_us = esp_timer_get_time();
+        METRICS_OBSERVE(m_queued, start_us - chunk->queued_us);
+        {
+            TRACE_SCOPE("stream_pipe_consume");
+            pipe->consume(pipe->ctx, chunk->data, chunk->len);
+        }
+        METRICS_OBSERVE(m_consume, esp_timer_get_time() - start_us);
+        METRICS_ADD(m_bytes, chunk->len);
+        // Never blocks: the free queue has room for every chunk
+        xQueueSend(s_free, &chunk, 0);
+    }
+}
+
+esp_err_t stream_pipe_start(UBaseType_t priority, BaseType_t core_id)
+{
+    if (s_task)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_free = xQueueCreateStatic(STREAM_PIPE_CHUNKS, sizeof(stream_pipe_chunk_t *), s_free_storage, &s_free_buf);
+    s_full = xQueueCreateStatic(STREAM_PIPE_CHUNKS, sizeof(stream_pipe_chunk_t *), s_full_storage, &s_full_buf);
+    for (int i = 0; i < STREAM_PIPE_CHUNKS; i++)
+    {
+        stream_pipe_chunk_t *chunk = &s_chunks[i];
+        xQueueSend(s_free, &chunk, 0);
+    }
+    s_task = xTaskCreateStaticPinnedToCore(stream_pipe_task, "stream_pipe", STREAM_PIPE_STACK_SIZE, NULL, priority,
+                                           s_task_stack, &s_task_buf, core_id);
+    if (s_task == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to start the pipe task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void stream_pipe_open(stream_pipe_t *pipe, stream_pipe_consume_fn_t consume, void *ctx)
+{
+    pipe->consume = consume;
+    pipe->ctx = ctx;
+    pipe->done = xSemaphoreCreateBinaryStatic(&pipe->done_buf);
+}
+
+static stream_pipe_chunk_t *stream_pipe_take(void)
+{
+    int64_t start_us = esp_timer_get_time();
+    stream_pipe_chunk_t *chunk;
+    xQueueReceive(s_free, &chunk, portMAX_DELAY);
+    METRICS_OBSERVE(m_stall, esp_timer_get_time() - start_us);
+    return chunk;
+}
+
+void stream_pipe_write(void *ctx, const char *data, size_t len)
+{
+    stream_pipe_t *pipe = (stream_pipe_t *)ctx;
+    if (s_task == NULL)
+    {
+        pipe->consume(pipe->ctx, data, len); // not started: consumed in place
+        return;
+    }
+    while (len > 0)
+    {
+        stream_pipe_chunk_t *chunk = stream_pipe_take();
+        chunk->pipe = pipe;
+        chunk->len = len < STREAM_PIPE_CHUNK_SIZE ? len : STREAM_PIPE_CHUNK_SIZE;
+        memcpy(chunk->data, data, chunk->len);
+        data += chunk->len;
+        len -= chunk->len;
+        chunk->queued_us = esp_timer_get_time();
+        xQueueSend(s_full, &chunk, portMAX_DELAY);
+    }
+}
+
+void stream_pipe_close(stream_pipe_t *pipe)
+{
+    if (s_task != NULL)
+    {
+        // The end marker queues behind the pipe's last chunk
+        stream_pipe_chunk_t *chunk = stream_pipe_take();
+        chunk->pipe = pipe;
+        chunk->len = 0;
+        xQueueSend(s_full, &chunk, portMAX_DELAY);
+        xSemaphoreTake(pipe->done, portMAX_DELAY);
+    }
+    vSemaphoreDelete(pipe->done);
+}
@@ -0,0 +1,51 @@
+#ifndef STREAM_PIPE_H
+#define STREAM_PIPE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Buffers in flight between the producers and the consumer task
+#ifndef STREAM_PIPE_CHUNKS
+#define STREAM_PIPE_CHUNKS 4
+#endif
+#ifndef STREAM_PIPE_CHUNK_SIZE
+#define STREAM_PIPE_CHUNK_SIZE 1024 // one HTTP client read
+#endif
+
+    /*
+     * Hands byte streams from the tasks that receive them to one consumer
+     * task, so a download goes on while the chunks before it are being
+     * processed, possibly on the other core. Chunks are copied into a fixed
+     * pool of buffers; a producer blocks while all of them are queued.
+     * Chunks of one stream are consumed in order.
+     */
+    typedef void (*stream_pipe_consume_fn_t)(void *ctx, const char *data, size_t len);
+
+    typedef struct
+    {
+        stream_pipe_consume_fn_t consume;
+        void *ctx;
+        SemaphoreHandle_t done;
+        StaticSemaphore_t done_buf;
+    } stream_pipe_t;
+
+    esp_err_t stream_pipe_start(UBaseType_t priority, BaseType_t core_id);
+    // consume(ctx, ...) is called on the pipe task for everything written
+    void stream_pipe_open(stream_pipe_t *pipe, stream_pipe_consume_fn_t consume, void *ctx);
+    // Takes a stream_pipe_t *, so it can be an http_stream_cb_t
+    void stream_pipe_write(void *pipe, const char *data, size_t len);
+    // Block until everything written has been consumed
+    void stream_pipe_close(stream_pipe_t *pipe);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STREAM_PIPE_H
@@ -0,0 +1,150 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#define TRACE_TASKS_MAX 16 // rows in the dump; further tasks share the last
+#define TRACE_LINE_MAX 160
+
+typedef struct
+{
+    atomic_uint seq; // claim number + 1 once written, 0 while being written
+    char phase;      // 'B', 'E' or 'i'
+    uint8_t core;
+    const char *name;
+    const char *task;
+    int64_t ts_us;
+} trace_event_t;
+
+#if CONFIG_TRACE_ENABLE
+static trace_event_t s_events[CONFIG_TRACE_EVENTS];
+static atomic_uint s_claimed;
+
+void trace_record(const char *name, char phase)
+{
+    uint32_t seq = atomic_fetch_add_explicit(&s_claimed, 1, memory_order_relaxed);
+    trace_event_t *event = &s_events[seq % CONFIG_TRACE_EVENTS];
+    atomic_store_explicit(&event->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    event->ts_us = esp_timer_get_time();
+    event->name = name;
+    event->phase = phase;
+#if CONFIG_IDF_TARGET_LINUX
+    event->core = 0;
+#else
+    event->core = xPortGetCoreID();
+#endif
+    event->task = pcTaskGetName(NULL); // lives in the TCB, and tasks here are never deleted
+    atomic_store_explicit(&event->seq, seq + 1, memory_order_release);
+}
+#else
+void trace_record(const char *name, char phase)
+{
+}
+#endif
+
+const char *trace_scope_begin(const char *name)
+{
+    trace_record(name, 'B');
+    return name;
+}
+
+void trace_scope_end(const char **name)
+{
+    trace_record(*name, 'E');
+}
+
+typedef struct
+{
+    char buf[512];
+    size_t len;
+    trace_write_cb_t write;
+    void *ctx;
+    const char *tasks[TRACE_TASKS_MAX];
+    int task_count;
+} trace_out_t;
+
+static void trace_out(trace_out_t *out, const char *text, size_t len)
+{
+    if (out->len + len > sizeof(out->buf))
+    {
+        out->write(out->ctx, out->buf, out->len);
+        out->len = 0;
+    }
+    memcpy(out->buf + out->len, text, len);
+    out->len += len;
+}
+
+// snprintf() result of a line, cut to what fitted
+static void trace_out_line(trace_out_t *out, const char *line, int n)
+{
+    trace_out(out, line, n < TRACE_LINE_MAX ? (size_t)n : TRACE_LINE_MAX - 1);
+}
+
+// Row of a task in the dump, announced with a thread_name record the
+// first time it shows up
+static int trace_tid(trace_out_t *out, const char *task)
+{
+    for (int i = 0; i < out->task_count; i++)
+    {
+        if (out->tasks[i] == task)
+        {
+            return i + 1;
+        }
+    }
+    if (out->task_count == TRACE_TASKS_MAX)
+    {
+        return TRACE_TASKS_MAX;
+    }
+    out->tasks[out->task_count++] = task;
+    char line[TRACE_LINE_MAX];
+    int n = snprintf(line, sizeof(line),
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                     out->task_count, task ? task : "?");
+    trace_out_line(out, line, n);
+    return out->task_count;
+}
+
+void trace_dump(trace_write_cb_t write, void *ctx)
+{
+    static trace_out_t out; // too big for a server task's stack; one dump at a time
+    out.len = 0;
+    out.write = write;
+    out.ctx = ctx;
+    out.task_count = 0;
+
+    static const char head[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    trace_out(&out, head, sizeof(head) - 1);
+#if CONFIG_TRACE_ENABLE
+    uint32_t end = atomic_load_explicit(&s_claimed, memory_order_acquire);
+    uint32_t start = end > CONFIG_TRACE_EVENTS ? end - CONFIG_TRACE_EVENTS : 0;
+    for (uint32_t seq = start; seq != end; seq++)
+    {
+        trace_event_t *slot = &s_events[seq % CONFIG_TRACE_EVENTS];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != seq + 1)
+        {
+            continue; // still being written, or already overwritten
+        }
+        trace_event_t event = *slot;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq + 1)
+        {
+            continue;
+        }
+        int tid = trace_tid(&out, event.task);
+        char line[TRACE_LINE_MAX];
+        int n = snprintf(line, sizeof(line),
+                         "{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%lld,\"pid\":1,\"tid\":%d,\"args\":{\"core\":%d}},\n",
+                         event.name, event.phase, event.phase == 'i' ? "\"s\":\"t\"," : "", (long long)event.ts_us,
+                         tid, event.core);
+        trace_out_line(&out, line, n);
+    }
+#endif
+    // Names the process, and leaves no trailing comma before the ]
+    static const char tail[] = "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CryptoTag\"}}\n]}\n";
+    trace_out(&out, tail, sizeof(tail) - 1);
+    write(ctx, out.buf, out.len);
+}
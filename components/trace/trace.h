@@ -0,0 +1,57 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include "sdkconfig.h"
+
+    /*
+     * Timeline of begin/end and instant events, each stamped with the
+     * esp_timer time, core and task, kept in a fixed ring buffer that
+     * overwrites its oldest events. Writers never block or lock: a slot is
+     * claimed with one atomic add. Call from tasks only, not from ISRs.
+     *
+     * Names must be string literals (they are stored as pointers and
+     * written to JSON unescaped). Instrument with the macros at the bottom,
+     * which compile to nothing with CONFIG_TRACE_ENABLE off.
+     */
+
+    void trace_record(const char *name, char phase);
+
+    // Chrome / Perfetto trace JSON of the events in the buffer, oldest
+    // first, one row per task with the core in each event's args.
+    // Recording goes on meanwhile; slots overwritten mid-dump are skipped.
+    typedef void (*trace_write_cb_t)(void *ctx, const char *text, size_t len);
+    void trace_dump(trace_write_cb_t write, void *ctx);
+
+    // For TRACE_SCOPE
+    const char *trace_scope_begin(const char *name);
+    void trace_scope_end(const char **name);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if CONFIG_TRACE_ENABLE
+#define TRACE_BEGIN(name) trace_record(name, 'B')
+#define TRACE_END(name) trace_record(name, 'E')
+#define TRACE_INSTANT(name) trace_record(name, 'i')
+// Begin now, end when the enclosing block is left
+#define TRACE_SCOPE(name)                                                                            \
+    const char *TRACE_CONCAT(trace_scope_, __LINE__) __attribute__((cleanup(trace_scope_end), unused)) = \
+        trace_scope_begin(name)
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H
@@ -4,11 +4,178 @@
 #include <ssid_manager.h>
 #include <wifi_connect.h>
 #include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs_record.h"
+#include <string.h>
+
+#define TAG "WIFI_CONNECT"
+
+#define WIFI_AP_KEY "wifi_ap"
+#define WIFI_AP_VERSION 1
+// A direct join takes well under a second when the AP is still there
+#define WIFI_FAST_TIMEOUT_MS 5000
+// Disconnects a direct join rides out before it gives up early
+#define WIFI_FAST_RETRIES 3
+
+/*
+ * WifiStation scans every channel before it joins, which takes about two
+ * seconds. The AP that gave us an address last is saved, and the next boot
+ * joins it directly on its channel and BSSID. A disconnect, which a busy AP
+ * or a lost handshake frame can cause, joins the same BSSID again. Once
+ * that has failed WIFI_FAST_RETRIES times in a row, or there is no address
+ * within WIFI_FAST_TIMEOUT_MS of the first join or of a later drop, the
+ * station is torn down and WifiStation takes over with a full scan, as it
+ * would have done from the start.
+ */
+typedef struct
+{
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_ap_t;
+
+static EventGroupHandle_t s_notify_events;
+static EventBits_t s_notify_bit;
+static esp_timer_handle_t s_save_timer;
+static esp_timer_handle_t s_fallback_timer;
+static esp_netif_t *s_fast_netif;
+static esp_event_handler_instance_t s_fast_wifi_handler;
+static esp_event_handler_instance_t s_fast_ip_handler;
+static bool s_fell_back;
+static int s_fast_failures; // disconnects since the last address
+static wifi_connect_ip_cb_t s_on_ip;
+static void *s_on_ip_ctx;
+
+// On the esp_timer task, which has the stack for a flash write that the
+// event task lacks
+static void wifi_ap_save(void *arg)
+{
+    wifi_ap_record_t info;
+    if (esp_wifi_sta_get_ap_info(&info) != ESP_OK)
+    {
+        return;
+    }
+    wifi_ap_t ap = {};
+    memcpy(ap.ssid, info.ssid, sizeof(ap.ssid) - 1);
+    memcpy(ap.bssid, info.bssid, sizeof(ap.bssid));
+    ap.channel = info.primary;
+    if (nvs_record_save(WIFI_AP_KEY, WIFI_AP_VERSION, &ap, sizeof(ap)) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to save the AP");
+    }
+}
+
+static void wifi_ap_on_got_ip(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    esp_timer_start_once(s_save_timer, 0);
+}
+
+static void wifi_fast_fallback(void *arg)
+{
+    if (s_fell_back)
+    {
+        return;
+    }
+    s_fell_back = true;
+    ESP_LOGW(TAG, "Direct join failed, scanning");
+    esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, s_fast_wifi_handler);
+    esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, s_fast_ip_handler);
+    esp_wifi_disconnect();
+    esp_wifi_stop();
+    esp_wifi_deinit();
+    esp_netif_destroy_default_wifi(s_fast_netif);
+    WifiStation::GetInstance().Start();
+}
+
+static void wifi_fast_on_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (base == WIFI_EVENT && id == WIFI_EVENT_STA_START)
+    {
+        esp_wifi_connect();
+    }
+    else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED)
+    {
+        if (++s_fast_failures > WIFI_FAST_RETRIES)
+        {
+            esp_timer_stop(s_fallback_timer);
+            esp_timer_start_once(s_fallback_timer, 0);
+            return;
+        }
+        // A drop after an address gets a new window
+        if (!esp_timer_is_active(s_fallback_timer))
+        {
+            esp_timer_start_once(s_fallback_timer, WIFI_FAST_TIMEOUT_MS * 1000LL);
+        }
+        ESP_LOGI(TAG, "Disconnected, joining again (%d/%d)", s_fast_failures, WIFI_FAST_RETRIES);
+        esp_wifi_connect();
+    }
+    else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP)
+    {
+        esp_timer_stop(s_fallback_timer);
+        s_fast_failures = 0;
+    }
+}
+
+static bool wifi_fast_start(const wifi_ap_t *ap)
+{
+    const char *password = NULL;
+    for (auto &item : SsidManager::GetInstance().GetSsidList())
+    {
+        if (item.ssid == ap->ssid)
+        {
+            password = item.password.c_str();
+        }
+    }
+    if (password == NULL)
+    {
+        return false;
+    }
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = wifi_fast_fallback;
+    timer_args.name = "wifi_fallback";
+    if (esp_timer_create(&timer_args, &s_fallback_timer) != ESP_OK)
+    {
+        return false;
+    }
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    s_fast_netif = esp_netif_create_default_wifi_sta();
+    wifi_init_config_t init_config = WIFI_INIT_CONFIG_DEFAULT();
+    init_config.nvs_enable = false;
+    ESP_ERROR_CHECK(esp_wifi_init(&init_config));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_fast_on_event, NULL,
+                                                        &s_fast_wifi_handler));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_fast_on_event, NULL,
+                                                        &s_fast_ip_handler));
+
+    wifi_config_t config = {};
+    strncpy((char *)config.sta.ssid, ap->ssid, sizeof(config.sta.ssid));
+    strncpy((char *)config.sta.password, password, sizeof(config.sta.password));
+    memcpy(config.sta.bssid, ap->bssid, sizeof(config.sta.bssid));
+    config.sta.bssid_set = true;
+    config.sta.channel = ap->channel;
+    config.sta.scan_method = WIFI_FAST_SCAN;
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &config));
+    ESP_ERROR_CHECK(esp_wifi_start());
+    esp_timer_start_once(s_fallback_timer, WIFI_FAST_TIMEOUT_MS * 1000LL);
+    ESP_LOGI(TAG, "Joining %s on channel %d", ap->ssid, ap->channel);
+    return true;
+}
+
+// The default event loop, created by whichever call needs it first
+static esp_err_t wifi_connect_event_loop(void)
+{
+    esp_err_t ret = esp_event_loop_create_default();
+    return ret == ESP_ERR_INVALID_STATE ? ESP_OK : ret;
+}
 
 extern "C" void wifi_connect_start()
 {
-    // Initialize the default event loop
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    ESP_ERROR_CHECK(wifi_connect_event_loop());
 
     // Initialize NVS flash for Wi-Fi configuration
     esp_err_t ret = nvs_flash_init();
@@ -30,7 +197,20 @@ extern "C" void wifi_connect_start()
         return;
     }
 
-    // Otherwise, connect to the Wi-Fi network
+    // Otherwise, connect to the Wi-Fi network, directly to the last AP if
+    // it is still one of ours
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = wifi_ap_save;
+    timer_args.name = "wifi_ap_save";
+    if (esp_timer_create(&timer_args, &s_save_timer) == ESP_OK)
+    {
+        esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_ap_on_got_ip, NULL);
+    }
+    wifi_ap_t ap;
+    if (nvs_record_load(WIFI_AP_KEY, WIFI_AP_VERSION, &ap, sizeof(ap)) == ESP_OK && wifi_fast_start(&ap))
+    {
+        return;
+    }
     WifiStation::GetInstance().Start();
 }
 
@@ -52,4 +232,46 @@ extern "C" int check_wifi_status(void)
         // ESP_LOGI(TAG, "Not connected to any AP");
         return 0;
     }
-}
\ No newline at end of file
+}
+
+static void wifi_connect_on_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    xEventGroupSetBits(s_notify_events, s_notify_bit);
+}
+
+extern "C" esp_err_t wifi_connect_notify(EventGroupHandle_t events, EventBits_t bit)
+{
+    s_notify_events = events;
+    s_notify_bit = bit;
+    esp_err_t ret = wifi_connect_event_loop();
+    if (ret == ESP_OK)
+    {
+        ret = esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, wifi_connect_on_event, NULL);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, wifi_connect_on_event, NULL);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_connect_on_event, NULL);
+    }
+    return ret;
+}
+
+static void wifi_connect_on_ip_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    s_on_ip(s_on_ip_ctx);
+}
+
+extern "C" esp_err_t wifi_connect_on_ip(wifi_connect_ip_cb_t on_ip, void *ctx)
+{
+    s_on_ip = on_ip;
+    s_on_ip_ctx = ctx;
+    esp_err_t ret = wifi_connect_event_loop();
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    return esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_connect_on_ip_event, NULL);
+}
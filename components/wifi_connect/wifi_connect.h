@@ -6,8 +6,19 @@ extern "C"
 {
 #endif
 
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
     void wifi_connect_start(void);
     int check_wifi_status(void);
+    // Set `bit` in `events` whenever the station connects, gets an address
+    // or drops. Call before wifi_connect_start() to see the first events.
+    esp_err_t wifi_connect_notify(EventGroupHandle_t events, EventBits_t bit);
+    // Call on_ip(ctx) from the event task each time the station gets an
+    // address. Keep it short. Same as above: before wifi_connect_start().
+    typedef void (*wifi_connect_ip_cb_t)(void *ctx);
+    esp_err_t wifi_connect_on_ip(wifi_connect_ip_cb_t on_ip, void *ctx);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,24 @@
+#include "wifi_connect.h"
+
+// Linux builds use the host's network, which is always up
+
+void wifi_connect_start(void)
+{
+}
+
+int check_wifi_status(void)
+{
+    return 1;
+}
+
+esp_err_t wifi_connect_notify(EventGroupHandle_t events, EventBits_t bit)
+{
+    xEventGroupSetBits(events, bit);
+    return ESP_OK;
+}
+
+esp_err_t wifi_connect_on_ip(wifi_connect_ip_cb_t on_ip, void *ctx)
+{
+    on_ip(ctx);
+    return ESP_OK;
+}
@@ -1,21 +1,98 @@
-#include "esp_chip_info.h"
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "sim.h"
+#else
 #include "esp_system.h"
-#include "driver/i2c.h"
+#include "esp_heap_caps.h"
+#include "driver/i2c_master.h"
+#endif
 #include "i2c_lcd.h"
 #include "esp_log.h"
 #include "wifi_connect.h"
-#include "cJSON.h"
-#include "esp_timer.h"
+#include "json_stream.h"
 #include "config.h"
 #include "http_request.h"
+#include "scheduler.h"
+#include "mailbox.h"
+#include "price_stream.h"
+#include "candle_ring.h"
+#include "kline_chart.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "trace.h"
+#include "nvs_record.h"
+#include "stream_pipe.h"
+#include "downsample.h"
+#include "indicators.h"
+#include "hedge.h"
+#include <ctype.h>
+#include <stdatomic.h>
+#include <math.h>
 #include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
 
 static const char *TAG = "Crypto Tag";
 
+#define KLINE_WINDOW 20                    // candles drawn
+#define KLINE_INTERVAL_MS (5 * 60 * 1000) // one candle
+// Time the chart covers, e.g. (24 * 60 * 60 * 1000LL) for a day. Beyond
+// KLINE_WINDOW candles every refresh downloads the whole span and
+// downsamples it to the chart width as it is parsed.
+#ifndef KLINE_SPAN_MS
+#define KLINE_SPAN_MS ((long long)KLINE_WINDOW * KLINE_INTERVAL_MS)
+#endif
+#ifndef KLINE_DOWNSAMPLE
+#define KLINE_DOWNSAMPLE DOWNSAMPLE_LTTB
+#endif
+#define KLINE_SPAN ((int)(KLINE_SPAN_MS / KLINE_INTERVAL_MS)) // candles
+_Static_assert(KLINE_SPAN >= KLINE_WINDOW && KLINE_SPAN <= 1000, "KLINE_SPAN_MS out of range");
+// Chart points are fixed point, so drawing needs no floating point
+#define PRICE_CHART_SCALE 100000000LL
+
+// Symbols shown on rotating pages, e.g. "BTCUSDT", "ETHUSDT", "SOLUSDT"
+#ifndef SYMBOLS
+#define SYMBOLS "ETHUSDT"
+#endif
+#define SYMBOL_MAX 4
+#define PAGE_ROTATE_MS (8 * 1000)
+// Scroll every symbol past as a ticker instead of rotating pages, one
+// column per step, e.g. #define MARQUEE_STEP_MS 300. No chart then: the
+// display shift moves both rows.
+#ifdef MARQUEE_STEP_MS
+#define MARQUEE_ENABLED 1
+#else
+#define MARQUEE_ENABLED 0
+#define MARQUEE_STEP_MS DISPLAY_TICK_MS
+#endif
+
+// The top row shows the gas fee, or an indicator of the page's symbol,
+// e.g. INDICATOR_RSI
+#define TOP_FIELD_GAS -1
+#ifndef TOP_FIELD
+#define TOP_FIELD TOP_FIELD_GAS
+#endif
+// Candles the first fetch asks for; indicators need a full window
+#define KLINE_BACKFILL \
+    (TOP_FIELD != TOP_FIELD_GAS && INDICATORS_WINDOW + 1 > KLINE_WINDOW ? INDICATORS_WINDOW + 1 : KLINE_WINDOW)
+_Static_assert(KLINE_BACKFILL <= 1000, "INDICATORS_WINDOW too long for one request");
+// A request the best provider has not answered within this long is sent to
+// the next one as well, and the first answer is used. 0 asks one at a time.
+#ifndef FETCH_HEDGE_MS
+#define FETCH_HEDGE_MS 1500
+#endif
+// Kline refreshes of up to this many candles are hedged; longer ones, like
+// the first backfill, are too big to download twice
+#define KLINE_HEDGE_CANDLES 8
+
 typedef struct
 {
     bool Ok;
-    double open[20];
+    int64_t open[KLINE_WINDOW]; // in 1/PRICE_CHART_SCALE units
+    int64_t last_open_ms; // open time of the newest candle
+    double last_price;
+    indicators_base_t indicators; // with TOP_FIELD an indicator
+    candle_t candle;              // the open candle they are evaluated with
 } Kline;
 
 typedef struct
@@ -24,260 +101,1569 @@ typedef struct
     double suggestBaseFee;
 } GasFee;
 
-static uint8_t klineBitMap[8][8];
+// Spot prices of every symbol, from one batched request
+typedef struct
+{
+    bool Ok;
+    double price[SYMBOL_MAX]; // 0 when missing from the response
+} Prices;
+
+static const char *const symbol_names[] = {SYMBOLS};
+#define SYMBOL_COUNT ((int)(sizeof(symbol_names) / sizeof(symbol_names[0])))
+_Static_assert(SYMBOL_COUNT <= SYMBOL_MAX, "too many SYMBOLS");
+
+typedef struct
+{
+    const char *name; // as the exchanges spell it, "ETHUSDT"
+    char label[5];    // as the LCD shows it, "ETH"
+    candle_ring_t ring; // owned by the symbol's kline fetch
+    indicators_t *indicators; // same, NULL when TOP_FIELD is the gas fee
+    int64_t fetched_us; // esp_timer time of the last successful kline fetch
+    sched_source_t *source;
+    mailbox_t mailbox; // Kline snapshots for the display
+    Kline slots[3];
+} symbol_t;
+
+static symbol_t symbols[SYMBOL_MAX];
+static indicators_t symbol_indicators[SYMBOL_MAX]; // behind symbol_t.indicators
+
+// Fetch workers publish results here and app_main takes the newest one.
+// Results are written in place into the mailbox slots, so nothing is
+// allocated or freed across tasks.
+MAILBOX_DEFINE(gas_mailbox, GasFee);
+MAILBOX_DEFINE(prices_mailbox, Prices);
+
+// What wakes the display loop besides its blink tick
+#define DISPLAY_GAS BIT0
+#define DISPLAY_KLINE BIT1
+#define DISPLAY_WIFI BIT2
+#define DISPLAY_PRICES BIT3
+#define DISPLAY_STREAM BIT4
+#define DISPLAY_TICK_MS 500
+// Not a display event: net_boot has NVS ready
+#define BOOT_NVS_READY BIT5
+// Nor this: the fetch sources exist, so the first address may trigger them
+#define BOOT_FETCH_READY BIT6
+
+static EventGroupHandle_t display_events;
+
+/*
+ * Fetches run as a pipeline. Scheduler workers download on the core the
+ * Wi-Fi stack runs on and pass the bodies through a stream_pipe to the
+ * parse task on the other core, which runs json_stream over each chunk
+ * while the next one is still being received. The display loop (app_main,
+ * on CPU1 per sdkconfig) rasterizes, and the LCD render task clocks the
+ * frames out. Override any of these in config.h.
+ */
+#if CONFIG_FREERTOS_NUMBER_OF_CORES > 1
+#define STAGE_CORE_WIFI 0
+#define STAGE_CORE_APP 1
+#else
+#define STAGE_CORE_WIFI tskNO_AFFINITY
+#define STAGE_CORE_APP tskNO_AFFINITY
+#endif
+#ifndef FETCH_STAGE_CORE
+#define FETCH_STAGE_CORE STAGE_CORE_WIFI
+#endif
+#ifndef FETCH_STAGE_PRIORITY
+#define FETCH_STAGE_PRIORITY 10
+#endif
+#ifndef PARSE_STAGE_CORE
+#define PARSE_STAGE_CORE STAGE_CORE_APP
+#endif
+#ifndef PARSE_STAGE_PRIORITY
+#define PARSE_STAGE_PRIORITY 8
+#endif
+#ifndef RENDER_STAGE_CORE
+#define RENDER_STAGE_CORE STAGE_CORE_APP
+#endif
+#ifndef RENDER_STAGE_PRIORITY
+#define RENDER_STAGE_PRIORITY 5
+#endif
 
-static void i2c_master_init(void)
+#if CONFIG_IDF_TARGET_LINUX
+// The emulated LCD in components/sim sits on lcd_bus_mock.c
+static lcd_bus_handle_t i2c_master_init(void)
+{
+    sim_start(I2C_MASTER_FREQ_HZ);
+    return NULL;
+}
+#else
+static i2c_master_bus_handle_t i2c_master_init(void)
 {
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
+    i2c_master_bus_config_t conf = {
+        .i2c_port = I2C_MASTER_NUM,
         .sda_io_num = I2C_MASTER_SDA_IO,
         .scl_io_num = I2C_MASTER_SCL_IO,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        //.master.clk_speed = I2C_MASTER_FREQ_HZ,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .trans_queue_depth = LCD_MAX, // Lets the LCD render task queue a transfer per display
+        .flags.enable_internal_pullup = true,
     };
-    conf.master.clk_speed = I2C_MASTER_FREQ_HZ;
-    i2c_param_config(I2C_MASTER_NUM, &conf);
-    i2c_driver_install(I2C_MASTER_NUM, conf.mode, 0, 0, 0);
+    i2c_master_bus_handle_t bus = NULL;
+    ESP_ERROR_CHECK(i2c_new_master_bus(&conf, &bus));
+    return bus;
+}
+#endif
+
+/*
+ * The responses are parsed as they arrive: json_stream hands over only the
+ * fields named in the paths below, which are written straight into the
+ * result, so no body buffer or JSON tree is ever built. Parsing happens on
+ * the stream_pipe task.
+ */
+typedef struct
+{
+    json_stream_t js;
+    esp_err_t err;
+    int64_t parse_us; // time spent in json_stream_feed()
+} json_fetch_t;
+
+METRICS_HISTOGRAM_DEFINE(m_parse, "json_parse_seconds", "Parsing one response, summed over its chunks",
+                         METRICS_UNIT_CPU_US)
+METRICS_HISTOGRAM_DEFINE(m_chart, "chart_render_seconds", "Rasterizing the k-line chart", METRICS_UNIT_CPU_US)
+
+static void json_fetch_on_data(void *ctx, const char *data, size_t len)
+{
+    json_fetch_t *fetch = (json_fetch_t *)ctx;
+    if (fetch->err == ESP_OK)
+    {
+        int64_t start_us = esp_timer_get_time();
+        fetch->err = json_stream_feed(&fetch->js, data, len);
+        fetch->parse_us += esp_timer_get_time() - start_us;
+    }
+}
+
+// GET url and feed the body through the fetch's json_stream, until *cancel
+// is set when cancel is not NULL
+static esp_err_t json_fetch(const char *url, uint32_t timeout_ms, const atomic_bool *cancel, json_fetch_t *fetch)
+{
+    fetch->err = ESP_OK;
+    fetch->parse_us = 0;
+    stream_pipe_t pipe;
+    stream_pipe_open(&pipe, json_fetch_on_data, fetch);
+    esp_err_t err = http_get_stream_cancellable(url, timeout_ms, cancel, stream_pipe_write, &pipe);
+    stream_pipe_close(&pipe); // the fetch's fields are final from here on
+    METRICS_OBSERVE(m_parse, fetch->parse_us);
+    if (err == ESP_OK)
+    {
+        err = fetch->err;
+    }
+    if (err == ESP_OK)
+    {
+        err = json_stream_finish(&fetch->js);
+    }
+    return err;
+}
+
+static void symbols_init(void)
+{
+    for (int i = 0; i < SYMBOL_COUNT; i++)
+    {
+        symbol_t *symbol = &symbols[i];
+        symbol->name = symbol_names[i];
+        // "ETHUSDT" -> "ETH"
+        size_t len = strlen(symbol->name);
+        if (len > 4 && strcmp(symbol->name + len - 4, "USDT") == 0)
+        {
+            len -= 4;
+        }
+        snprintf(symbol->label, sizeof(symbol->label), "%.*s", (int)len, symbol->name);
+        mailbox_init(&symbol->mailbox, symbol->slots, sizeof(Kline));
+        if (TOP_FIELD != TOP_FIELD_GAS)
+        {
+            symbol->indicators = &symbol_indicators[i];
+        }
+    }
+}
+
+static int symbol_find(const char *name)
+{
+    for (int i = 0; i < SYMBOL_COUNT; i++)
+    {
+        if (strcmp(symbols[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
 }
 
-static void klineBitMapClear()
+/*
+ * Candles are kept between fetches, so after the first backfill a refresh
+ * only asks for the still-open candle plus the ones opened since the last
+ * fetch, updates the open one in place and appends the rest.
+ */
+enum
+{
+    KLINE_FIELD_TIME = 1 << 0,
+    KLINE_FIELD_OPEN = 1 << 1,
+    KLINE_FIELD_CLOSE = 1 << 2,
+    KLINE_FIELD_HIGH = 1 << 3,
+    KLINE_FIELD_LOW = 1 << 4,
+    KLINE_FIELD_VOLUME = 1 << 5,
+    KLINE_FIELDS_ALL = KLINE_FIELD_TIME | KLINE_FIELD_OPEN | KLINE_FIELD_CLOSE | KLINE_FIELD_HIGH | KLINE_FIELD_LOW |
+                       KLINE_FIELD_VOLUME,
+};
+
+typedef struct
+{
+    json_fetch_t fetch;
+    candle_ring_t *ring; // stored into as they arrive, unless out is set
+    indicators_t *indicators;
+    candle_t *out; // collected here instead, up to out_max
+    int out_max;
+    int count;
+    int ret;
+    int index; // array element the fields in candle belong to
+    candle_t candle;
+    uint8_t fields;
+    downsample_t ds; // when KLINE_SPAN > KLINE_WINDOW
+} kline_fetch_t;
+
+// Store the candle collected so far once all its fields arrived
+static void kline_fetch_flush(kline_fetch_t *fetch)
 {
-    for (int i = 0; i < 8; i++)
-        for (int j = 0; j < 8; j++)
-            klineBitMap[i][j] = 0;
+    if (fetch->fields == KLINE_FIELDS_ALL && fetch->out != NULL)
+    {
+        if (fetch->count < fetch->out_max)
+        {
+            fetch->out[fetch->count++] = fetch->candle;
+        }
+    }
+    else if (fetch->fields == KLINE_FIELDS_ALL)
+    {
+        candle_ring_put(fetch->ring, &fetch->candle);
+        if (fetch->indicators)
+        {
+            indicators_put(fetch->indicators, &fetch->candle);
+        }
+        if (KLINE_SPAN > KLINE_WINDOW)
+        {
+            downsample_push(&fetch->ds, llround(fetch->candle.open * PRICE_CHART_SCALE));
+        }
+        fetch->count++;
+    }
+    fetch->fields = 0;
 }
 
-static void klineSetPixel(int x /*time*/, int y /*price*/)
+static void kline_fetch_field(kline_fetch_t *fetch, int index, int field, const char *value)
 {
-    if (x >= 20)
-        x = 19;
-    if (y >= 16)
-        y = 15;
-    // if (y > 15 || y < 0)
-    //     return;
+    if (index != fetch->index)
+    {
+        kline_fetch_flush(fetch);
+        fetch->index = index;
+    }
+    switch (field)
+    {
+    case KLINE_FIELD_TIME:
+        fetch->candle.open_time_ms = strtoll(value, NULL, 10);
+        break;
+    case KLINE_FIELD_OPEN:
+        fetch->candle.open = strtod(value, NULL);
+        break;
+    case KLINE_FIELD_HIGH:
+        fetch->candle.high = strtod(value, NULL);
+        break;
+    case KLINE_FIELD_LOW:
+        fetch->candle.low = strtod(value, NULL);
+        break;
+    case KLINE_FIELD_VOLUME:
+        fetch->candle.volume = strtod(value, NULL);
+        break;
+    default:
+        fetch->candle.close = strtod(value, NULL);
+        break;
+    }
+    fetch->fields |= field;
+}
 
-    int _index = 4;
-    if (y > 7)
-        _index = 0;
+// Candles to ask for: the whole backfill until the window is filled, otherwise
+// the open candle plus the ones that can have opened since
+static int kline_fetch_count(const symbol_t *symbol)
+{
+    if (KLINE_SPAN > KLINE_WINDOW)
+    {
+        return KLINE_SPAN; // nothing but the chart points is kept between fetches
+    }
+    if (candle_ring_count(&symbol->ring) < KLINE_WINDOW || symbol->fetched_us == 0)
+    {
+        return KLINE_BACKFILL;
+    }
+    int64_t elapsed_ms = (esp_timer_get_time() - symbol->fetched_us) / 1000;
+    int64_t count = elapsed_ms / KLINE_INTERVAL_MS + 2;
+    return count < KLINE_BACKFILL ? count : KLINE_BACKFILL;
+}
 
-    int index = (x / 5) + _index;
+typedef struct
+{
+    json_fetch_t fetch;
+    Prices *prices;
+    int ret;
+    int index;  // array element `symbol` was read from
+    int symbol; // index into symbols, -1 for one not shown
+    int count;
+} prices_fetch_t;
 
-    int _x = x % 5;
-    int _y = y % 8;
+static void prices_fetch_symbol(prices_fetch_t *fetch, int index, const char *value)
+{
+    fetch->index = index;
+    fetch->symbol = symbol_find(value);
+}
 
-    (klineBitMap[index][7 - _y]) |= (1 << (4 - _x));
+static void prices_fetch_price(prices_fetch_t *fetch, int index, const char *value)
+{
+    if (index == fetch->index && fetch->symbol >= 0)
+    {
+        fetch->prices->price[fetch->symbol] = strtod(value, NULL);
+        fetch->count++;
+    }
 }
 
-static void klineClearPixel(int x /*time*/, int y /*price*/)
+/*
+ * Market data providers. Each one knows how to ask for candles and prices
+ * and which fields of its answers to pick up, and fills the same
+ * kline_fetch_t and prices_fetch_t. Every provider whose credentials are in
+ * config.h is registered; hedge_run() sends each request to the one that
+ * has been answering fastest, and asks the next one too when it is slow.
+ */
+typedef struct
 {
-    if (x >= 20)
-        x = 19;
-    if (y >= 16)
-        y = 15;
-    // if (y > 15 || y < 0)
-    //     return;
+    const char *name;
+    const char *host; // looked up as soon as there is an address
+    // The newest `count` candles; the ring may say which ones are needed
+    void (*kline_url)(char *url, size_t size, const symbol_t *symbol, int count);
+    const char *const *kline_paths;
+    int kline_path_count;
+    json_stream_cb_t kline_on_value;
+    // The price of every symbol
+    void (*prices_url)(char *url, size_t size);
+    const char *const *prices_paths;
+    int prices_path_count;
+    json_stream_cb_t prices_on_value;
+} provider_t;
 
-    int _index = 4;
-    if (y > 7)
-        _index = 0;
+// [[open time, open, high, low, close, volume, ...], ...], in KLINE_FIELD_* order
+static const char *const binance_kline_paths[] = {"[*][0]", "[*][1]", "[*][4]", "[*][2]", "[*][3]", "[*][5]"};
 
-    int index = (x / 5) + _index;
+static void binance_kline_on_value(void *ctx, int path, int index, const char *value, size_t len)
+{
+    kline_fetch_field((kline_fetch_t *)ctx, index, 1 << path, value);
+}
+
+static void binance_kline_url(char *url, size_t size, const symbol_t *symbol, int count)
+{
+    const candle_t *last = candle_ring_last(&symbol->ring);
+    if (count < KLINE_WINDOW && last)
+    {
+        snprintf(url, size, "https://api.binance.com/api/v3/klines?symbol=%s&interval=5m&startTime=%lld&limit=%d",
+                 symbol->name, (long long)last->open_time_ms, count);
+    }
+    else
+    {
+        snprintf(url, size, "https://api.binance.com/api/v3/klines?symbol=%s&interval=5m&limit=%d", symbol->name,
+                 count);
+    }
+}
 
-    int _x = x % 5;
-    int _y = y % 8;
+// [{"symbol":"ETHUSDT","price":"3588.60"}, ...]
+static const char *const binance_prices_paths[] = {"[*].symbol", "[*].price"};
 
-    int mask = 0b11111 ^ (1 << (4 - _x));
-    (klineBitMap[index][7 - _y]) &= mask;
+static void binance_prices_on_value(void *ctx, int path, int index, const char *value, size_t len)
+{
+    prices_fetch_t *fetch = (prices_fetch_t *)ctx;
+    if (path == 0)
+    {
+        prices_fetch_symbol(fetch, index, value);
+    }
+    else
+    {
+        prices_fetch_price(fetch, index, value);
+    }
 }
 
-#ifdef USE_ALLTICK
-static Kline *get_kline()
+// One request for every symbol: ticker/price?symbols=["BTCUSDT","ETHUSDT"]
+static void binance_prices_url(char *url, size_t size)
 {
-    char *buffer = http_get("https://quote.alltick.io/quote-b-api/kline?token=" ALLTICK_TOKEN "&query={%22data%22:{%22code%22:%22ETHUSDT%22,%22kline_type%22:%221%22,%22kline_timestamp_end%22:%220%22,%22query_kline_num%22:%22100%22,%22adjust_type%22:%220%22}}");
-    ESP_LOGI(TAG, "get_kline end");
-    if (buffer == NULL)
+    int len = snprintf(url, size, "https://api.binance.com/api/v3/ticker/price?symbols=%%5B");
+    for (int i = 0; i < SYMBOL_COUNT; i++)
+    {
+        len += snprintf(url + len, size - len, "%s%%22%s%%22", i ? "," : "", symbols[i].name);
+    }
+    snprintf(url + len, size - len, "%%5D");
+}
+
+#ifdef ALLTICK_TOKEN
+/*
     {
-        return NULL;
+        "ret": 200,
+        "data": {
+            "kline_list": [
+                {
+                    "timestamp": "1677829200",
+                    "open_price": "3591.35",
+                    "close_price": "3588.60",
+                    "high_price": "3595.00",
+                    "low_price": "3580.10",
+                    "volume": "1520.7"
+                }
+            ]
+        }
     }
-    /*
+*/
+static const char *const alltick_kline_paths[] = {"ret", "data.kline_list[*].timestamp",
+                                                  "data.kline_list[*].open_price", "data.kline_list[*].close_price",
+                                                  "data.kline_list[*].high_price", "data.kline_list[*].low_price",
+                                                  "data.kline_list[*].volume"};
+
+static void alltick_kline_on_value(void *ctx, int path, int index, const char *value, size_t len)
+{
+    kline_fetch_t *fetch = (kline_fetch_t *)ctx;
+    if (path == 0)
+    {
+        fetch->ret = atoi(value);
+        return;
+    }
+    kline_fetch_field(fetch, index, 1 << (path - 1), value);
+    if (path == 1)
+    {
+        fetch->candle.open_time_ms *= 1000; // AllTick counts seconds
+    }
+}
+
+// kline_timestamp_end 0 means "up to now", so the newest `count` candles
+// are exactly the ones that changed
+static void alltick_kline_url(char *url, size_t size, const symbol_t *symbol, int count)
+{
+    snprintf(url, size,
+             "https://quote.alltick.io/quote-b-api/kline?token=" ALLTICK_TOKEN "&query={%%22data%%22:{%%22code%%22:%%22%s%%22,%%22kline_type%%22:%%222%%22,%%22kline_timestamp_end%%22:%%220%%22,%%22query_kline_num%%22:%%22%d%%22,%%22adjust_type%%22:%%220%%22}}",
+             symbol->name, count);
+}
+
+/*
+    {
+        "ret": 200,
+        "data": {
+            "tick_list": [
+                {
+                    "code": "ETHUSDT",
+                    "price": "3588.60"
+                }
+            ]
+        }
+    }
+*/
+static const char *const alltick_prices_paths[] = {"ret", "data.tick_list[*].code", "data.tick_list[*].price"};
+
+static void alltick_prices_on_value(void *ctx, int path, int index, const char *value, size_t len)
+{
+    prices_fetch_t *fetch = (prices_fetch_t *)ctx;
+    if (path == 0)
+    {
+        fetch->ret = atoi(value);
+    }
+    else if (path == 1)
+    {
+        prices_fetch_symbol(fetch, index, value);
+    }
+    else
+    {
+        prices_fetch_price(fetch, index, value);
+    }
+}
+
+static void alltick_prices_url(char *url, size_t size)
+{
+    int len = snprintf(url, size,
+                       "https://quote.alltick.io/quote-b-api/trade-tick?token=" ALLTICK_TOKEN "&query={%%22trace%%22:%%22cryptotag%%22,%%22data%%22:{%%22symbol_list%%22:[");
+    for (int i = 0; i < SYMBOL_COUNT; i++)
+    {
+        len += snprintf(url + len, size - len, "%s{%%22code%%22:%%22%s%%22}", i ? "," : "", symbols[i].name);
+    }
+    snprintf(url + len, size - len, "]}}");
+}
+#endif
+
+// In registration order, which breaks ties before any latency is known
+static const provider_t providers[] = {
+    {
+        .name = "binance",
+        .host = "api.binance.com",
+        .kline_url = binance_kline_url,
+        .kline_paths = binance_kline_paths,
+        .kline_path_count = 6,
+        .kline_on_value = binance_kline_on_value,
+        .prices_url = binance_prices_url,
+        .prices_paths = binance_prices_paths,
+        .prices_path_count = 2,
+        .prices_on_value = binance_prices_on_value,
+    },
+#ifdef ALLTICK_TOKEN
+    {
+        .name = "alltick",
+        .host = "quote.alltick.io",
+        .kline_url = alltick_kline_url,
+        .kline_paths = alltick_kline_paths,
+        .kline_path_count = 7,
+        .kline_on_value = alltick_kline_on_value,
+        .prices_url = alltick_prices_url,
+        .prices_paths = alltick_prices_paths,
+        .prices_path_count = 3,
+        .prices_on_value = alltick_prices_on_value,
+    },
+#endif
+};
+#define PROVIDER_COUNT ((int)(sizeof(providers) / sizeof(providers[0])))
+_Static_assert(PROVIDER_COUNT <= HEDGE_BACKENDS_MAX, "too many providers");
+
+/*
+ * One kline request, as it is handed to each provider's attempt. Short
+ * refreshes are hedged: every attempt collects its candles in its own copy
+ * of candles[], and only the winner's are stored. Longer requests go to
+ * one provider at a time and are stored (and downsampled) as they arrive.
+ */
+typedef struct
+{
+    symbol_t *symbol;
+    Kline *kline; // downsampled into, when direct
+    int count;
+    bool direct;
+    int got;    // candles received
+    int points; // downsample_finish(), when direct
+    candle_t candles[KLINE_HEDGE_CANDLES];
+} kline_request_t;
+_Static_assert(sizeof(kline_request_t) <= HEDGE_RESULT_MAX, "KLINE_HEDGE_CANDLES too many for HEDGE_RESULT_MAX");
+
+static kline_request_t kline_requests[SYMBOL_MAX]; // a symbol's fetches never overlap
+
+static esp_err_t kline_attempt(int backend, void *result, const atomic_bool *cancel, uint32_t timeout_ms)
+{
+    kline_request_t *req = (kline_request_t *)result;
+    const provider_t *provider = &providers[backend];
+    kline_fetch_t fetch = {
+        .ret = 200, // for providers that send no status
+    };
+    if (req->direct)
+    {
+        fetch.ring = &req->symbol->ring;
+        fetch.indicators = req->symbol->indicators;
+        downsample_init(&fetch.ds, KLINE_DOWNSAMPLE, req->count, req->kline->open, KLINE_WINDOW);
+    }
+    else
+    {
+        fetch.out = req->candles;
+        fetch.out_max = KLINE_HEDGE_CANDLES;
+    }
+    char url[320];
+    provider->kline_url(url, sizeof(url), req->symbol, req->count);
+    json_stream_init(&fetch.fetch.js, provider->kline_paths, provider->kline_path_count, provider->kline_on_value,
+                     &fetch);
+    esp_err_t err = json_fetch(url, timeout_ms, cancel, &fetch.fetch);
+    kline_fetch_flush(&fetch);
+    req->got = fetch.count;
+    req->points = req->direct && KLINE_SPAN > KLINE_WINDOW ? downsample_finish(&fetch.ds) : 0;
+    return err == ESP_OK && fetch.ret != 200 ? ESP_ERR_INVALID_RESPONSE : err;
+}
+
+// False when nothing usable arrived, the display then keeps what it shows
+static bool get_kline(symbol_t *symbol, uint32_t timeout_ms, Kline *kline)
+{
+    kline_request_t *req = &kline_requests[symbol - symbols];
+    req->symbol = symbol;
+    req->kline = kline;
+    req->count = kline_fetch_count(symbol);
+    req->direct = req->count > KLINE_HEDGE_CANDLES;
+    req->got = 0;
+    int64_t start_us = esp_timer_get_time();
+    int provider = -1;
+    esp_err_t err =
+        hedge_run(kline_attempt, req, sizeof(*req), req->direct ? 0 : FETCH_HEDGE_MS, timeout_ms, &provider);
+    if (!req->direct)
+    {
+        for (int i = 0; i < req->got; i++)
         {
-            "ret": 200,
-            "data": {
-                "kline_list": [
-                    {
-                        "open_price": "3591.35"
-                    },
-                    {
-                        "open_price": "3588.60"
-                    }
-                ]
+            candle_ring_put(&symbol->ring, &req->candles[i]);
+            if (symbol->indicators)
+            {
+                indicators_put(symbol->indicators, &req->candles[i]);
             }
         }
-    */
+    }
+    ESP_LOGI(TAG, "get_kline %s end: asked %s for %d candles, got %d", symbol->name,
+             provider >= 0 ? providers[provider].name : "every provider", req->count, req->got);
+    if (err == ESP_OK)
+    {
+        symbol->fetched_us = start_us;
+    }
+    if (err != ESP_OK && req->got == 0)
+    {
+        return false;
+    }
 
-    Kline *kline = malloc(sizeof(Kline));
-    kline->Ok = false;
-    cJSON *root = cJSON_Parse(buffer);
-    if (root)
+    if (KLINE_SPAN > KLINE_WINDOW)
     {
-        if (cJSON_GetObjectItem(root, "ret")->valueint != 200)
+        // Downsampled into kline->open while the candles came in
+        kline->Ok = err == ESP_OK && req->points == KLINE_WINDOW;
+        if (!kline->Ok)
         {
-            cJSON_Delete(root);
-            free(buffer);
-            return kline;
+            return true;
         }
-        cJSON *data = cJSON_GetObjectItem(root, "data");
-        cJSON *kline_list = cJSON_GetObjectItem(data, "kline_list");
-        int array_size = cJSON_GetArraySize(kline_list);
-        int _i = 0;
-        for (int i = 0; i < array_size; i += 5)
+    }
+    else
+    {
+        int stored = candle_ring_count(&symbol->ring);
+        kline->Ok = err == ESP_OK && stored >= KLINE_WINDOW;
+        if (stored < KLINE_WINDOW)
         {
-            cJSON *item = cJSON_GetArrayItem(kline_list, i);
-            // get open_price
-            const char *open_price = cJSON_GetObjectItem(item, "open_price")->valuestring;
-            double open_price_num = strtod(open_price, NULL);
-            kline->open[_i] = open_price_num;
-            _i++;
+            return true;
         }
-        kline->Ok = true;
-        cJSON_Delete(root);
+        for (int i = 0; i < KLINE_WINDOW; i++)
+        {
+            kline->open[i] =
+                llround(candle_ring_at(&symbol->ring, stored - KLINE_WINDOW + i)->open * PRICE_CHART_SCALE);
+        }
+    }
+    const candle_t *last = candle_ring_last(&symbol->ring);
+    kline->last_open_ms = last->open_time_ms;
+    kline->last_price = last->close;
+    if (symbol->indicators)
+    {
+        kline->indicators = symbol->indicators->base;
+        kline->candle = symbol->indicators->open;
     }
-    free(buffer);
-    return kline;
+    return true;
 }
-#else
-static Kline *get_kline()
+
+static esp_err_t prices_attempt(int backend, void *result, const atomic_bool *cancel, uint32_t timeout_ms)
+{
+    const provider_t *provider = &providers[backend];
+    prices_fetch_t fetch = {
+        .prices = (Prices *)result,
+        .ret = 200,
+        .symbol = -1,
+    };
+    memset(fetch.prices, 0, sizeof(*fetch.prices));
+    char url[384];
+    provider->prices_url(url, sizeof(url));
+    json_stream_init(&fetch.fetch.js, provider->prices_paths, provider->prices_path_count, provider->prices_on_value,
+                     &fetch);
+    esp_err_t err = json_fetch(url, timeout_ms, cancel, &fetch.fetch);
+    return err == ESP_OK && fetch.ret != 200 ? ESP_ERR_INVALID_RESPONSE : err;
+}
+
+static bool get_prices(uint32_t timeout_ms, Prices *prices)
 {
-    char *buffer = http_get("https://api.binance.com/api/v3/klines?symbol=ETHUSDT&interval=5m&limit=25");
-    ESP_LOGI(TAG, "get_kline end");
-    if (buffer == NULL)
+    memset(prices, 0, sizeof(*prices));
+    int provider = -1;
+    esp_err_t err = hedge_run(prices_attempt, prices, sizeof(*prices), FETCH_HEDGE_MS, timeout_ms, &provider);
+    prices->Ok = err == ESP_OK;
+    if (err == ESP_OK)
     {
-        return NULL;
+        ESP_LOGI(TAG, "get_prices end: from %s", providers[provider].name);
+        return true;
     }
-    Kline *kline = malloc(sizeof(Kline));
-    kline->Ok = false;
-    cJSON *root = cJSON_Parse(buffer);
-    if (root)
+    // A failed attempt that ran on this task may still have left a few prices
+    for (int i = 0; i < SYMBOL_COUNT; i++)
     {
-        kline->Ok = true;
-        int array_size = cJSON_GetArraySize(root);
-        for (int i = array_size - 1; i >= 0; i--)
+        if (prices->price[i] != 0)
         {
-            cJSON *line = cJSON_GetArrayItem(root, i);
-            if (!cJSON_IsArray(line))
-                continue;
-            const char *open = cJSON_GetArrayItem(line, 1)->valuestring;
-            double open_num = strtod(open, NULL);
-            int index = i - (array_size - 20);
-            kline->open[index] = open_num;
-            if (index == 0)
-            {
-                break;
-            }
+            return true;
         }
-        cJSON_Delete(root);
     }
-    free(buffer);
-    return kline;
+    return false;
 }
-#endif
 
-static GasFee *get_basefee()
+typedef struct
+{
+    json_fetch_t fetch;
+    GasFee *gas_fee;
+    bool status_ok;
+} gas_fetch_t;
+
+static const char *const gas_paths[] = {"status", "result.suggestBaseFee"};
+
+static void gas_on_value(void *ctx, int path, int index, const char *value, size_t len)
 {
-    char *buffer = http_get("https://api.etherscan.io/v2/api?chainid=1&module=gastracker&action=gasoracle&apikey=" ETHERSCAN_API_KEY);
-    if (buffer == NULL)
+    gas_fetch_t *fetch = (gas_fetch_t *)ctx;
+    if (path == 0)
+    {
+        fetch->status_ok = strcmp(value, "1") == 0;
+    }
+    else
     {
-        return NULL;
+        fetch->gas_fee->suggestBaseFee = strtod(value, NULL);
     }
-    cJSON *root = cJSON_Parse(buffer);
+}
 
-    GasFee *gas_fee = malloc(sizeof(GasFee));
+static bool get_basefee(uint32_t timeout_ms, GasFee *gas_fee)
+{
+    gas_fetch_t fetch = {0};
     gas_fee->Ok = false;
-    if (root)
+    fetch.gas_fee = gas_fee;
+    json_stream_init(&fetch.fetch.js, gas_paths, 2, gas_on_value, &fetch);
+    esp_err_t err = json_fetch("https://api.etherscan.io/v2/api?chainid=1&module=gastracker&action=gasoracle&apikey=" ETHERSCAN_API_KEY, timeout_ms, NULL, &fetch.fetch);
+    if (err != ESP_OK && !fetch.status_ok)
+    {
+        return false;
+    }
+    gas_fee->Ok = err == ESP_OK && fetch.status_ok;
+    return true;
+}
+
+// One batched request covers every symbol's price
+#define PRICE_UPDATE_INTERVAL_MS (30 * 1000)
+// The chart only moves when a candle opens; the symbols take turns
+#define KLINE_UPDATE_INTERVAL_MS (60 * 1000)
+#define KLINE_STAGGER_MS (3 * 1000)
+#define GAS_UPDATE_INTERVAL_MS (30 * 1000)
+
+// Streamed candles are matched to the REST ones by open time, which every
+// provider aligns to the same 5 minute boundaries
+#ifdef PRICE_STREAM_URI
+#define PRICE_STREAM_ENABLED
+#endif
+
+static sched_source_t *gas_source;
+static sched_source_t *prices_source;
+
+// Once the first fetches have set up their connections the heap in use
+// should stay flat; anything that keeps growing it is a leak or
+// fragmentation. The host build runs the same fetch and parse code on
+// recorded responses, so a timed simulation fails on a leak there too.
+#define HEAP_WARMUP_FETCHES 4
+#define HEAP_DRIFT_TOLERANCE 2048 // TLS reconnects come and go
+
+static size_t heap_used(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return sim_heap_used();
+#else
+    return heap_caps_get_total_size(MALLOC_CAP_DEFAULT) - esp_get_free_heap_size();
+#endif
+}
+
+// Called by every fetch, from any of the scheduler workers
+static void heap_check(void)
+{
+    static atomic_int fetches;
+    static atomic_size_t baseline;
+    size_t used = heap_used();
+    size_t base = atomic_load(&baseline);
+    if (atomic_fetch_add(&fetches, 1) + 1 == HEAP_WARMUP_FETCHES)
+    {
+        atomic_store(&baseline, used);
+        ESP_LOGI(TAG, "heap baseline: %lu bytes in use", (unsigned long)used);
+    }
+    else if (base != 0 && used > base + HEAP_DRIFT_TOLERANCE)
+    {
+        ESP_LOGW(TAG, "heap drift: %lu bytes in use, baseline %lu", (unsigned long)used, (unsigned long)base);
+#if CONFIG_IDF_TARGET_LINUX
+        sim_fail();
+#endif
+    }
+}
+
+static esp_err_t fetch_gas(void *ctx, uint32_t timeout_ms)
+{
+    ESP_LOGI(TAG, "fetch-gas");
+    GasFee *gas = mailbox_back(&gas_mailbox);
+    bool got = get_basefee(timeout_ms, gas);
+    bool ok = gas->Ok; // The slot belongs to the display once published
+    if (got)
+    {
+        mailbox_publish(&gas_mailbox);
+        TRACE_INSTANT("gas_published");
+    }
+    heap_check();
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t fetch_prices(void *ctx, uint32_t timeout_ms)
+{
+    ESP_LOGI(TAG, "fetch-prices");
+    Prices *prices = mailbox_back(&prices_mailbox);
+    bool got = get_prices(timeout_ms, prices);
+    bool ok = prices->Ok;
+    if (got)
+    {
+        mailbox_publish(&prices_mailbox);
+        TRACE_INSTANT("prices_published");
+    }
+    heap_check();
+
+    http_stats_t stats;
+    http_get_stats(&stats);
+    ESP_LOGI(TAG, "http: %lu/%lu requests reused a connection, %lu handshakes, avg %lld ms",
+             (unsigned long)stats.reused, (unsigned long)stats.requests, (unsigned long)stats.connects,
+             stats.connects ? stats.connect_us_total / stats.connects / 1000 : 0);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t fetch_kline(void *ctx, uint32_t timeout_ms)
+{
+    symbol_t *symbol = (symbol_t *)ctx;
+    ESP_LOGI(TAG, "fetch-kline %s", symbol->name);
+    Kline *kline = mailbox_back(&symbol->mailbox);
+    bool got = get_kline(symbol, timeout_ms, kline);
+    bool ok = kline->Ok;
+    if (got)
+    {
+        mailbox_publish(&symbol->mailbox);
+        TRACE_INSTANT("kline_published");
+    }
+    heap_check();
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+/*
+ * The last charts and gas fee are kept in flash, so after a reset the
+ * screen shows them at once, marked stale, instead of staying blank until
+ * Wi-Fi is up and the first fetches are in.
+ */
+#define HISTORY_KEY "history"
+#define HISTORY_VERSION 1 // bump when history_t changes
+// Every save rewrites the ~750 byte blob somewhere else in NVS. At one save
+// per 15 minutes each flash sector is erased a few times a day, which
+// sectors rated for 100k cycles stand for decades.
+#define HISTORY_SAVE_INTERVAL_MS (15 * 60 * 1000)
+
+typedef struct
+{
+    char symbol[16]; // "" for an empty entry
+    int64_t open[KLINE_WINDOW];
+    int64_t last_open_ms;
+    double last_price;
+} history_chart_t;
+
+typedef struct
+{
+    double gas; // 0 when not known
+    history_chart_t charts[SYMBOL_MAX];
+} history_t;
+
+// What the next save writes; filled in by app_main, written by a fetch worker
+static history_t history;
+static bool history_dirty;
+static portMUX_TYPE history_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void history_note_chart(int s, const Kline *kline)
+{
+    history_chart_t *chart = &history.charts[s];
+    taskENTER_CRITICAL(&history_lock);
+    snprintf(chart->symbol, sizeof(chart->symbol), "%s", symbols[s].name);
+    memcpy(chart->open, kline->open, sizeof(chart->open));
+    chart->last_open_ms = kline->last_open_ms;
+    chart->last_price = kline->last_price;
+    history_dirty = true;
+    taskEXIT_CRITICAL(&history_lock);
+}
+
+static void history_note_gas(double gas)
+{
+    taskENTER_CRITICAL(&history_lock);
+    history.gas = gas;
+    history_dirty = true;
+    taskEXIT_CRITICAL(&history_lock);
+}
+
+static esp_err_t fetch_history(void *ctx, uint32_t timeout_ms)
+{
+    static history_t record; // too big for a worker's stack
+    taskENTER_CRITICAL(&history_lock);
+    bool dirty = history_dirty;
+    record = history;
+    history_dirty = false;
+    taskEXIT_CRITICAL(&history_lock);
+    if (!dirty)
+    {
+        return ESP_OK;
+    }
+    TRACE_SCOPE("history_save");
+    esp_err_t err = nvs_record_save(HISTORY_KEY, HISTORY_VERSION, &record, sizeof(record));
+    if (err != ESP_OK)
+    {
+        taskENTER_CRITICAL(&history_lock);
+        history_dirty = true;
+        taskEXIT_CRITICAL(&history_lock);
+    }
+    return err;
+}
+
+static void fetch_start(void)
+{
+    sched_source_config_t gas = {
+        .name = "gas",
+        .fetch = fetch_gas,
+        .interval_ms = GAS_UPDATE_INTERVAL_MS,
+        .jitter_ms = 2000,
+        .backoff_min_ms = 2000,
+        .backoff_max_ms = 2 * 60 * 1000,
+        .timeout_ms = 10 * 1000,
+    };
+    sched_source_config_t prices = {
+        .name = "prices",
+        .fetch = fetch_prices,
+        .interval_ms = PRICE_UPDATE_INTERVAL_MS,
+        .jitter_ms = 2000,
+        .backoff_min_ms = 2000,
+        .backoff_max_ms = 5 * 60 * 1000,
+        .timeout_ms = 10 * 1000,
+    };
+    if (TOP_FIELD == TOP_FIELD_GAS)
+    {
+        gas_source = scheduler_register(&gas);
+    }
+    prices_source = scheduler_register(&prices);
+    for (int i = 0; i < SYMBOL_COUNT; i++)
+    {
+        sched_source_config_t kline = {
+            .name = symbols[i].name,
+            .fetch = fetch_kline,
+            .ctx = &symbols[i],
+            .interval_ms = KLINE_UPDATE_INTERVAL_MS,
+            .jitter_ms = 2000,
+            .backoff_min_ms = 2000,
+            .backoff_max_ms = 5 * 60 * 1000,
+            .timeout_ms = 10 * 1000,
+            .first_delay_ms = i * KLINE_STAGGER_MS,
+        };
+        symbols[i].source = scheduler_register(&kline);
+    }
+    sched_source_config_t history_save = {
+        .name = "history",
+        .fetch = fetch_history,
+        .interval_ms = HISTORY_SAVE_INTERVAL_MS,
+        .backoff_min_ms = HISTORY_SAVE_INTERVAL_MS,
+        .backoff_max_ms = HISTORY_SAVE_INTERVAL_MS,
+        .timeout_ms = 1000,
+        .first_delay_ms = HISTORY_SAVE_INTERVAL_MS, // a boot loop must not wear the flash
+    };
+    scheduler_register(&history_save);
+    for (int i = 0; i < PROVIDER_COUNT; i++)
+    {
+        hedge_register(providers[i].name); // ids follow the providers array
+    }
+    // Set before the scheduler runs: an address that comes later may find the
+    // first fetches already failed, one that comes earlier is there for them
+    xEventGroupSetBits(display_events, BOOT_FETCH_READY);
+    if (PROVIDER_COUNT > 1 && FETCH_HEDGE_MS > 0 && hedge_start(FETCH_STAGE_PRIORITY, FETCH_STAGE_CORE) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "hedge_start failed");
+    }
+    if (stream_pipe_start(PARSE_STAGE_PRIORITY, PARSE_STAGE_CORE) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "stream_pipe_start failed");
+    }
+    if (scheduler_start(FETCH_STAGE_PRIORITY, FETCH_STAGE_CORE) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "scheduler_start failed");
+    }
+}
+
+// Start every source now, the klines spread out
+static void fetch_trigger_all(void)
+{
+    if (gas_source)
+    {
+        scheduler_trigger(gas_source);
+    }
+    scheduler_trigger(prices_source);
+    for (int i = 0; i < SYMBOL_COUNT; i++)
+    {
+        scheduler_trigger_in(symbols[i].source, i * KLINE_STAGGER_MS);
+    }
+}
+
+/*
+ * What the display shows for each symbol. Owned by app_main: snapshots and
+ * streamed ticks are folded in as they arrive, so switching pages redraws
+ * from here without waiting on the network.
+ */
+typedef struct
+{
+    Kline chart;
+    bool chart_error; // the last kline fetch failed
+    double price;     // 0 until known
+    bool stale;       // restored from flash, no chart fetched since boot
+} symbol_view_t;
+
+static symbol_view_t views[SYMBOL_MAX];
+
+/*
+ * One LCD on the bus. Tag t starts on page t, so a wall of SYMBOL_COUNT
+ * tags shows every symbol at once; only when there are fewer do they
+ * rotate.
+ */
+typedef struct
+{
+    lcd_handle_t lcd;
+    int page;
+    int last_y;
+    kline_chart_glyphs_t glyphs;
+} tag_t;
+
+static tag_t tags[LCD_MAX];
+static int tag_count;
+
+static GasFee gas_view;
+static bool gas_known; // fetched or restored, else the field stays blank
+static bool gas_stale;
+
+static void draw_marquee(tag_t *tag);
+
+// Stale values are marked with a '~' in front
+static void draw_price(tag_t *tag)
+{
+    if (MARQUEE_ENABLED)
+    {
+        draw_marquee(tag);
+        return;
+    }
+    const symbol_view_t *view = &views[tag->page];
+    char buf[10];
+    char mark = view->stale ? '~' : '$';
+    if (view->price > 0)
+        snprintf(buf, sizeof(buf), "%c%f", mark, view->price);
+    else
+        snprintf(buf, sizeof(buf), "%c      ", mark);
+    lcd_fb_put_string(tag->lcd, 1, 9, buf);
+}
+
+static const char *const top_labels[] = {"GAS", "SMA", "EMA", "VWP", "RSI", "CHG", "LO", "HI"};
+_Static_assert(sizeof(top_labels) / sizeof(top_labels[0]) == INDICATOR_COUNT + 1, "a label per TOP_FIELD");
+
+// The top row value for symbol s, cut to 7 characters like prices in
+// draw_price(); false while there is nothing to show
+static bool field_text(int s, char buf[8], bool *stale)
+{
+    if (TOP_FIELD == TOP_FIELD_GAS)
+    {
+        if (gas_view.Ok)
+            snprintf(buf, 8, "%7.2f", gas_view.suggestBaseFee);
+        else
+            snprintf(buf, 8, " error");
+        *stale = gas_stale;
+        return gas_known;
+    }
+    const symbol_view_t *view = &views[s];
+    indicator_t indicator = (indicator_t)TOP_FIELD;
+    double value = view->chart.Ok ? indicators_value(&view->chart.indicators, &view->chart.candle, indicator) : NAN;
+    if (isnan(value))
+        snprintf(buf, 8, "     --");
+    else if (indicator == INDICATOR_CHANGE)
+        snprintf(buf, 8, "%+6.2f%%", value);
+    else if (indicator == INDICATOR_RSI)
+        snprintf(buf, 8, "%7.2f", value);
+    else
+        snprintf(buf, 8, "%f", value);
+    *stale = view->stale;
+    return true;
+}
+
+// The value on the top row
+static void draw_field(tag_t *tag)
+{
+    if (MARQUEE_ENABLED)
+    {
+        draw_marquee(tag);
+        return;
+    }
+    char buf[8];
+    bool stale;
+    if (field_text(tag->page, buf, &stale))
+    {
+        lcd_fb_put_char(tag->lcd, 0, 8, stale ? '~' : ' ');
+        lcd_fb_put_string(tag->lcd, 0, 9, buf);
+    }
+}
+
+static void draw_chart(tag_t *tag)
+{
+    if (MARQUEE_ENABLED)
+    {
+        draw_marquee(tag);
+        return;
+    }
+    int64_t start_us = esp_timer_get_time();
+    tag->last_y = kline_chart_render(views[tag->page].chart.open, KLINE_WINDOW, tag->glyphs);
+    METRICS_OBSERVE(m_chart, esp_timer_get_time() - start_us);
+    for (int i = 0; i < 4; i++)
+    {
+        lcd_fb_put_glyph(tag->lcd, 0, i, tag->glyphs[i]);
+        lcd_fb_put_glyph(tag->lcd, 1, i, tag->glyphs[i + 4]);
+    }
+}
+
+// Redraw the symbol half of the screen from the cached view
+static void draw_page(tag_t *tag)
+{
+    if (MARQUEE_ENABLED)
+    {
+        draw_marquee(tag);
+        return;
+    }
+    const symbol_view_t *view = &views[tag->page];
+    char label[6];
+    snprintf(label, sizeof(label), "%-4s$", symbols[tag->page].label);
+    lcd_fb_put_string(tag->lcd, 1, 5, label);
+    draw_price(tag);
+    if (view->chart.Ok)
+    {
+        draw_chart(tag);
+    }
+    else
     {
-        if (strcmp(cJSON_GetObjectItem(root, "status")->valuestring, "1") == 0)
+        kline_chart_render(NULL, 0, tag->glyphs);
+        for (int i = 0; i < 4; i++)
         {
-            cJSON *result = cJSON_GetObjectItem(root, "result");
-            const char *suggestBaseFee = cJSON_GetObjectItem(result, "suggestBaseFee")->valuestring;
-            double suggestBaseFee_num = strtod(suggestBaseFee, NULL);
-            gas_fee->suggestBaseFee = suggestBaseFee_num;
-            gas_fee->Ok = true;
+            lcd_fb_put_char(tag->lcd, 0, i, ' ');
+            lcd_fb_put_char(tag->lcd, 1, i, ' ');
         }
-        cJSON_Delete(root);
     }
-    free(buffer);
-    return gas_fee;
+    lcd_fb_backlight(tag->lcd, view->chart_error);
+    draw_field(tag);
 }
 
-typedef struct
+// Column of the ticker at the left edge of the screen
+static int marquee_pos;
+
+/*
+ * Ticker of every symbol: "ETH $3588.60" on the bottom row, its top field
+ * right above, "GAS   12.34" or e.g. "CHG  +1.20%". The text is far longer
+ * than the screen; lcd_fb_marquee() keeps the next 40 columns of it in
+ * DDRAM, so a step to the next marquee_pos costs a shift command and the
+ * one cell that scrolls in later. Each tag continues where the one before
+ * it ends.
+ */
+static void draw_marquee(tag_t *tag)
+{
+    static char top[SYMBOL_MAX * 16 + 1];
+    static char bottom[SYMBOL_MAX * 16 + 1];
+    const char *label = top_labels[TOP_FIELD + 1];
+    for (int s = 0; s < SYMBOL_COUNT; s++)
+    {
+        const symbol_view_t *view = &views[s];
+        char price[9];
+        if (view->price > 0)
+            snprintf(price, sizeof(price), "%f", view->price);
+        else
+            price[0] = 0;
+        snprintf(bottom + s * 16, 17, "%-4s%c%-8s   ", symbols[s].label, view->stale ? '~' : '$', price);
+        char value[8];
+        bool stale = false;
+        const char *text = field_text(s, value, &stale) ? value : "";
+        while (*text == ' ')
+            text++; // left-aligned under the price
+        snprintf(top + s * 16, 17, "%-4s%c%-8s   ", label, stale ? '~' : ' ', text);
+    }
+    int pos = marquee_pos + (int)(tag - tags) * LCD_COLS;
+    lcd_fb_marquee(tag->lcd, 0, top, pos);
+    lcd_fb_marquee(tag->lcd, 1, bottom, pos);
+}
+
+// Gas or an indicator on the top row, the tag's symbol page below
+static void draw_screen(tag_t *tag)
 {
-    GasFee *gas;
-    Kline *kline;
-    double update_gas;
-    double update_kline;
-} fetch_response_t;
+    if (MARQUEE_ENABLED)
+    {
+        draw_marquee(tag);
+        return;
+    }
+    char label[12];
+    snprintf(label, sizeof(label), "%-11s", top_labels[TOP_FIELD + 1]);
+    lcd_fb_put_string(tag->lcd, 0, 5, label);
+    draw_page(tag);
+}
 
-static fetch_response_t response = {0};
+static void draw_wifi(tag_t *tag)
+{
+    lcd_fb_clear(tag->lcd);
+    lcd_fb_put_string(tag->lcd, 0, 0, "WIFI");
+    lcd_fb_put_string(tag->lcd, 1, 0, "connecting");
+}
 
-void fetch_data()
+// Seed the views from the saved history; false when there was none
+static bool history_restore(void)
 {
-    for (;;)
+    static history_t saved; // not worth a third of main's stack
+    esp_err_t err = nvs_record_load(HISTORY_KEY, HISTORY_VERSION, &saved, sizeof(saved));
+    if (err != ESP_OK)
+    {
+        ESP_LOGI(TAG, "no saved history: %s", esp_err_to_name(err));
+        return false;
+    }
+    bool restored = false;
+    if (saved.gas > 0)
+    {
+        gas_view = (GasFee){.Ok = true, .suggestBaseFee = saved.gas};
+        gas_known = gas_stale = true;
+        history.gas = saved.gas;
+        restored = true;
+    }
+    // Matched by name: SYMBOLS may have changed since the save
+    for (int i = 0; i < SYMBOL_MAX; i++)
     {
-        double now = esp_timer_get_time() / 1000000.0;
-        if (response.gas == NULL && (response.update_gas == 0 || now - response.update_gas > 30))
+        const history_chart_t *chart = &saved.charts[i];
+        int s = chart->symbol[0] ? symbol_find(chart->symbol) : -1;
+        if (s < 0)
         {
-            ESP_LOGI(TAG, "fetch-gas");
-            response.gas = get_basefee();
-            response.update_gas = now;
+            continue;
         }
+        Kline *kline = &views[s].chart;
+        kline->Ok = true;
+        memcpy(kline->open, chart->open, sizeof(kline->open));
+        kline->last_open_ms = chart->last_open_ms;
+        kline->last_price = chart->last_price;
+        views[s].price = chart->last_price;
+        views[s].stale = true;
+        history.charts[s] = *chart;
+        restored = true;
+    }
+    return restored;
+}
+
+#ifdef PRICE_STREAM_ENABLED
+// Every push in order, not just the newest: the push that opens a candle
+// has to reach its chart even when trades, or other symbols' pushes,
+// follow it before the display wakes up
+#define STREAM_QUEUE_LENGTH 16
+
+static QueueHandle_t stream_queue;
+static StaticQueue_t stream_queue_buf;
+static uint8_t stream_queue_storage[STREAM_QUEUE_LENGTH * sizeof(price_tick_t)];
+
+static void price_on_tick(void *ctx, const price_tick_t *tick)
+{
+    if (xQueueSend(stream_queue, tick, 0) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "Display behind, %s push dropped", tick->symbol);
+    }
+    xEventGroupSetBits(display_events, DISPLAY_STREAM);
+}
+
+static void price_on_state(void *ctx, bool up)
+{
+    if (!up)
+    {
+        // Prices come from REST polling until the stream is back
+        scheduler_trigger(prices_source);
+    }
+}
 
-        static const int PRICE_UPDATE_INTERVAL =
-#ifdef USE_ALLTICK
-            30;
+static void price_stream_begin(void)
+{
+#ifdef PRICE_STREAM_SUBSCRIBE
+    static const char subscribe[] = PRICE_STREAM_SUBSCRIBE;
 #else
-            60 * 2;
+    // {"method":"SUBSCRIBE","params":["ethusdt@kline_5m","ethusdt@aggTrade",...],"id":1}
+    static char subscribe[64 + SYMBOL_MAX * 48];
+    int len = snprintf(subscribe, sizeof(subscribe), "{\"method\":\"SUBSCRIBE\",\"params\":[");
+    for (int i = 0; i < SYMBOL_COUNT; i++)
+    {
+        char lower[PRICE_STREAM_SYMBOL_MAX];
+        int j = 0;
+        for (; symbols[i].name[j] && j < (int)sizeof(lower) - 1; j++)
+        {
+            lower[j] = tolower((unsigned char)symbols[i].name[j]);
+        }
+        lower[j] = 0;
+        len += snprintf(subscribe + len, sizeof(subscribe) - len, "%s\"%s@kline_5m\",\"%s@aggTrade\"",
+                        i ? "," : "", lower, lower);
+    }
+    snprintf(subscribe + len, sizeof(subscribe) - len, "],\"id\":1}");
 #endif
-        if (response.kline == NULL && (response.update_kline == 0 || now - response.update_kline > PRICE_UPDATE_INTERVAL))
+    stream_queue = xQueueCreateStatic(STREAM_QUEUE_LENGTH, sizeof(price_tick_t), stream_queue_storage,
+                                      &stream_queue_buf);
+    price_stream_config_t config = {
+        .uri = PRICE_STREAM_URI,
+        .subscribe = subscribe,
+        .ping_interval_s = 30,
+        .pong_timeout_s = 90,
+        .reconnect_ms = 5000,
+        .on_tick = price_on_tick,
+        .on_state = price_on_state,
+    };
+    if (price_stream_start(&config) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "price_stream_start failed");
+    }
+}
+
+// Fold a streamed update into the open candle the indicators are evaluated
+// with. When a new candle starts, the closed one is only counted in after
+// the next REST fetch.
+static void candle_apply_tick(candle_t *candle, const price_tick_t *tick)
+{
+    if (candle->open_time_ms == 0 || (tick->open_time_ms != 0 && tick->open_time_ms < candle->open_time_ms))
+    {
+        return;
+    }
+    if (tick->open_time_ms > candle->open_time_ms)
+    {
+        *candle = (candle_t){
+            .open_time_ms = tick->open_time_ms,
+            .open = tick->open,
+            .high = tick->high,
+            .low = tick->low,
+            .close = tick->close,
+        };
+        return;
+    }
+    candle->close = tick->close;
+    candle->high = fmax(candle->high, tick->close);
+    candle->low = fmin(candle->low, tick->close);
+}
+
+// Fold a streamed update into the chart, true when a new candle started
+static bool chart_apply_tick(Kline *chart, const price_tick_t *tick)
+{
+    if (KLINE_SPAN > KLINE_WINDOW)
+    {
+        return false; // points stand for several candles; the next fetch moves them
+    }
+    if (tick->open_time_ms <= chart->last_open_ms || chart->last_open_ms == 0)
+    {
+        return false; // A trade, the current candle, or a stale push
+    }
+    // Candles missed in between are filled in by the next REST fetch
+    memmove(chart->open, chart->open + 1, sizeof(chart->open[0]) * (KLINE_WINDOW - 1));
+    chart->open[KLINE_WINDOW - 1] = llround(tick->open * PRICE_CHART_SCALE);
+    chart->last_open_ms = tick->open_time_ms;
+    return true;
+}
+#endif
+
+/*
+ * Boot runs in two halves at once: app_main brings up the LCDs while
+ * net_boot, on the Wi-Fi core, initializes NVS and starts Wi-Fi. The
+ * first address then starts the DNS lookups of every API host and, if
+ * they ran without one, retries the first fetches.
+ *
+ * Each phase's end is logged once the first price is shown, in ms since
+ * the app started; the ROM and second-stage bootloader come before that.
+ */
+typedef enum
+{
+    BOOT_LCD,
+    BOOT_NVS,
+    BOOT_WIFI,
+    BOOT_IP,
+    BOOT_DNS,
+    BOOT_PRICE,
+    BOOT_PHASES,
+} boot_phase_t;
+
+#define NET_BOOT_STACK_SIZE 3584 // what app_main had for the same calls
+
+static const char *const boot_phase_names[BOOT_PHASES] = {"lcd", "nvs", "wifi", "ip", "dns", "price"};
+static int64_t boot_marks_us[BOOT_PHASES];
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+static StaticTask_t net_boot_task_buf;
+static StackType_t net_boot_task_stack[NET_BOOT_STACK_SIZE];
+
+// Only the first time a phase ends counts
+static void boot_mark(boot_phase_t phase)
+{
+    int64_t now_us = esp_timer_get_time();
+    taskENTER_CRITICAL(&boot_lock);
+    if (boot_marks_us[phase] == 0)
+    {
+        boot_marks_us[phase] = now_us;
+    }
+    taskEXIT_CRITICAL(&boot_lock);
+}
+
+static void boot_report(void)
+{
+    char line[96];
+    int len = 0;
+    taskENTER_CRITICAL(&boot_lock);
+    for (int p = 0; p < BOOT_PHASES && len < (int)sizeof(line); p++)
+    {
+        if (boot_marks_us[p] != 0)
         {
-            ESP_LOGI(TAG, "fetch-kline");
-            response.kline = get_kline();
-            response.update_kline = now;
+            len += snprintf(line + len, sizeof(line) - len, " %s %lld", boot_phase_names[p],
+                            (long long)(boot_marks_us[p] / 1000));
         }
+    }
+    taskEXIT_CRITICAL(&boot_lock);
+    ESP_LOGI(TAG, "Boot (ms since app start):%s", len > 0 ? line : " -");
+}
 
-        vTaskDelay(500 / portTICK_PERIOD_MS);
+static void boot_on_resolved(void *ctx)
+{
+    boot_mark(BOOT_DNS);
+}
+
+// On the event task, every time the station gets an address
+static void boot_on_ip(void *ctx)
+{
+    static bool resolved;
+    boot_mark(BOOT_IP);
+    if (!resolved)
+    {
+        const char *hosts[PROVIDER_COUNT + 1];
+        int count = 0;
+        for (int i = 0; i < PROVIDER_COUNT; i++)
+        {
+            hosts[count++] = providers[i].host;
+        }
+        if (TOP_FIELD == TOP_FIELD_GAS)
+        {
+            hosts[count++] = "api.etherscan.io";
+        }
+        resolved = http_resolve_ahead(hosts, count, boot_on_resolved, NULL) == ESP_OK;
+    }
+    // Fetches that failed before there was an address, or while the
+    // connection was down, are backing off. The only trigger on a new
+    // address: the display loop leaves it to this.
+    if (xEventGroupGetBits(display_events) & BOOT_FETCH_READY)
+    {
+        fetch_trigger_all();
+    }
+}
+
+// The callbacks go in first: a direct join to the last AP can get an
+// address before wifi_connect_start() returns
+static void net_boot(void)
+{
+    ESP_ERROR_CHECK(nvs_record_init());
+    boot_mark(BOOT_NVS);
+    xEventGroupSetBits(display_events, BOOT_NVS_READY);
+    if (wifi_connect_notify(display_events, DISPLAY_WIFI) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "wifi_connect_notify failed");
+    }
+    if (wifi_connect_on_ip(boot_on_ip, NULL) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "wifi_connect_on_ip failed");
     }
+    wifi_connect_start();
+    boot_mark(BOOT_WIFI);
 }
 
-static int last_y = 0;
+static void net_boot_task(void *arg)
+{
+    net_boot();
+    vTaskDelete(NULL);
+}
 
 void app_main(void)
 {
-    i2c_master_init();
-    lcd_init(I2C_MASTER_NUM);
-    lcd_backlight_off();
-    lcd_clear();
+    display_events = xEventGroupCreate();
+    if (xTaskCreateStaticPinnedToCore(net_boot_task, "net_boot", NET_BOOT_STACK_SIZE, NULL, FETCH_STAGE_PRIORITY,
+                                      net_boot_task_stack, &net_boot_task_buf, FETCH_STAGE_CORE) == NULL)
+    {
+        net_boot();
+    }
 
-    wifi_connect_start();
-    bool connection_status = false;
+    lcd_bus_handle_t bus = i2c_master_init();
+    uint8_t addresses[LCD_MAX];
+    int found = lcd_probe(bus, addresses);
+    if (found == 0)
+    {
+        ESP_LOGW(TAG, "No LCD answered, trying 0x%02X", LCD_I2C_ADDRESS);
+        addresses[found++] = LCD_I2C_ADDRESS;
+    }
+    for (int t = 0; t < found; t++)
+    {
+        lcd_config_t lcd_config = {
+            .bus = bus,
+            .address = addresses[t],
+            .scl_speed_hz = I2C_MASTER_FREQ_HZ,
+            .async = true,
+            .busy_poll = true,
+        };
+        tag_t *tag = &tags[tag_count];
+        if (lcd_init(&lcd_config, &tag->lcd) == ESP_OK)
+        {
+            tag->page = tag_count % SYMBOL_COUNT;
+            lcd_fb_backlight(tag->lcd, false);
+            tag_count++;
+        }
+    }
+    lcd_render_start(RENDER_STAGE_PRIORITY, RENDER_STAGE_CORE);
+    boot_mark(BOOT_LCD);
 
-    lcd_clear();
-    lcd_put_cur(0, 0);
-    lcd_send_string("WIFI");
-    lcd_put_cur(1, 0);
-    lcd_send_string("connecting");
+    symbols_init();
+    xEventGroupWaitBits(display_events, BOOT_NVS_READY, pdFALSE, pdTRUE, portMAX_DELAY);
+    bool wifi_screen = !history_restore();
+    for (int t = 0; t < tag_count; t++)
+    {
+        if (wifi_screen)
+        {
+            draw_wifi(&tags[t]);
+        }
+        else
+        {
+            lcd_fb_clear(tags[t].lcd);
+            draw_screen(&tags[t]);
+        }
+        lcd_fb_flush(tags[t].lcd);
+    }
+    mailbox_set_notify(&gas_mailbox, display_events, DISPLAY_GAS);
+    mailbox_set_notify(&prices_mailbox, display_events, DISPLAY_PRICES);
+    for (int s = 0; s < SYMBOL_COUNT; s++)
+    {
+        mailbox_set_notify(&symbols[s].mailbox, display_events, DISPLAY_KLINE);
+    }
+    bool connection_status = false;
 
-    BaseType_t ret = xTaskCreate(fetch_data, "fetch_data", 5 * 1024, NULL, 10, NULL);
-    if (ret != pdTRUE)
+    fetch_start();
+#if CONFIG_METRICS_ENABLE
+    static const char *const watched_tasks[] = {"main",         "lcd_render",  "scheduler",
+                                                "sched_worker", "stream_pipe", "hedge0"};
+    for (size_t t = 0; t < sizeof(watched_tasks) / sizeof(watched_tasks[0]); t++)
     {
-        ESP_LOGE(TAG, "xTaskCreate failed");
+        metrics_watch_task(watched_tasks[t]);
     }
+#endif
+#if CONFIG_TRACE_ENABLE
+    metrics_server_add("/trace", "application/json", trace_dump);
+#endif
 
-    for (int i = 0;; i++)
+    // Sleep until a new snapshot, a Wi-Fi change or the next blink tick,
+    // whichever comes first. Deadlines use esp_timer like the scheduler,
+    // so both follow the same clock.
+    int64_t next_tick_us = esp_timer_get_time() + DISPLAY_TICK_MS * 1000LL;
+    int64_t next_step_us = esp_timer_get_time() + MARQUEE_STEP_MS * 1000LL;
+    for (int i = 0;;)
     {
-        vTaskDelay(500 / portTICK_PERIOD_MS);
+        int64_t deadline_us = MARQUEE_ENABLED && !wifi_screen && next_step_us < next_tick_us ? next_step_us : next_tick_us;
+        int64_t wait_us = deadline_us - esp_timer_get_time();
+        TickType_t wait = wait_us > 0 ? pdMS_TO_TICKS(wait_us / 1000) + 1 : 0;
+        TRACE_BEGIN("display_wait");
+        EventBits_t events = xEventGroupWaitBits(display_events,
+                                                 DISPLAY_GAS | DISPLAY_KLINE | DISPLAY_WIFI | DISPLAY_PRICES | DISPLAY_STREAM,
+                                                 pdTRUE, pdFALSE, wait);
+        TRACE_END("display_wait");
+        TRACE_SCOPE("display_update");
+        bool tick = esp_timer_get_time() >= next_tick_us;
+        if (tick)
+        {
+            i++;
+            next_tick_us += DISPLAY_TICK_MS * 1000LL;
+        }
+        int64_t now_us = esp_timer_get_time();
+        if (MARQUEE_ENABLED && now_us >= next_step_us)
+        {
+            // No catching up after the Wi-Fi screen or a slow frame
+            next_step_us = next_step_us + MARQUEE_STEP_MS * 1000LL > now_us ? next_step_us + MARQUEE_STEP_MS * 1000LL
+                                                                           : now_us + MARQUEE_STEP_MS * 1000LL;
+            if (!wifi_screen)
+            {
+                marquee_pos++;
+                for (int t = 0; t < tag_count; t++)
+                {
+                    draw_marquee(&tags[t]);
+                }
+            }
+        }
+
         bool connection_status_changed = false;
-        bool new_status = check_wifi_status();
+        bool kline_redrawn = false;
+        // The blink tick re-checks too, in case a notification was missed
+        bool new_status = (events & DISPLAY_WIFI) || tick ? check_wifi_status() : connection_status;
         if (new_status != connection_status)
         {
             connection_status_changed = true;
@@ -285,156 +1671,200 @@ void app_main(void)
         connection_status = new_status;
         if (connection_status_changed)
         {
-            lcd_clear();
-            if (connection_status)
+            wifi_screen = !connection_status;
+            for (int t = 0; t < tag_count; t++)
             {
-                lcd_put_cur(0, 5);
-                lcd_send_string("GAS        ");
-                lcd_put_cur(1, 5);
-                lcd_send_string("ETH $      ");
+                if (connection_status)
+                {
+                    lcd_fb_clear(tags[t].lcd);
+                    draw_screen(&tags[t]);
+                }
+                else
+                {
+                    draw_wifi(&tags[t]);
+                }
             }
-            else
+            if (connection_status)
             {
-                lcd_put_cur(0, 0);
-                lcd_send_string("WIFI");
-                lcd_put_cur(1, 0);
-                lcd_send_string("connecting");
+                // boot_on_ip() has already restarted the fetches
+#ifdef PRICE_STREAM_ENABLED
+                static bool stream_started;
+                if (!stream_started)
+                {
+                    price_stream_begin();
+                    stream_started = true;
+                }
+#endif
+#if (CONFIG_METRICS_ENABLE || CONFIG_TRACE_ENABLE) && !CONFIG_IDF_TARGET_LINUX
+                static bool metrics_started;
+                if (!metrics_started)
+                {
+                    metrics_started = metrics_server_start(CONFIG_METRICS_HTTP_PORT) == ESP_OK;
+                }
+#endif
             }
         }
         else
         {
             if (connection_status)
             {
-                if (response.gas != NULL)
+                const GasFee *gas = mailbox_take(&gas_mailbox, NULL);
+                if (gas != NULL)
                 {
-                    char buf[10];
-                    if (response.gas->Ok)
-                        snprintf(buf, sizeof(buf), "%7.2f", response.gas->suggestBaseFee);
-                    else
-                        snprintf(buf, sizeof(buf), " error");
-                    free(response.gas);
-                    response.gas = NULL;
-                    lcd_put_cur(0, 9);
-                    lcd_send_string(buf);
+                    gas_view = *gas;
+                    gas_known = true;
+                    gas_stale = false;
+                    if (gas->Ok)
+                    {
+                        history_note_gas(gas->suggestBaseFee);
+                    }
+                    for (int t = 0; t < tag_count; t++)
+                    {
+                        draw_field(&tags[t]);
+                    }
                 }
-                if (response.kline != NULL)
+                const Prices *prices = mailbox_take(&prices_mailbox, NULL);
+                if (prices != NULL)
                 {
-                    Kline *kline = response.kline;
+                    bool priced = false;
+                    for (int s = 0; s < SYMBOL_COUNT; s++)
+                    {
+                        if (prices->price[s] > 0)
+                        {
+                            views[s].price = prices->price[s];
+                            priced = true;
+                        }
+                    }
+                    for (int t = 0; t < tag_count; t++)
+                    {
+                        draw_price(&tags[t]);
+                    }
+                    if (priced && boot_marks_us[BOOT_PRICE] == 0) // only app_main sets it
+                    {
+                        boot_mark(BOOT_PRICE);
+                        boot_report();
+                    }
+                }
+                for (int s = 0; s < SYMBOL_COUNT; s++)
+                {
+                    uint32_t kline_seq;
+                    const Kline *kline = mailbox_take(&symbols[s].mailbox, &kline_seq);
+                    if (kline == NULL)
+                    {
+                        continue;
+                    }
+                    ESP_LOGD(TAG, "%s kline snapshot %lu", symbols[s].name, (unsigned long)kline_seq);
+                    views[s].chart_error = !kline->Ok;
                     if (kline->Ok)
                     {
-                        lcd_backlight_off();
+                        views[s].chart = *kline;
+                        views[s].price = kline->last_price;
+                        views[s].stale = false;
+                        history_note_chart(s, kline);
+                    }
+                    for (int t = 0; t < tag_count; t++)
+                    {
+                        if (tags[t].page == s || MARQUEE_ENABLED)
                         {
-                            char buf[10];
-                            snprintf(buf, sizeof(buf), "$%f", kline->open[19]);
-                            lcd_put_cur(1, 9);
-                            lcd_send_string(buf);
+                            draw_page(&tags[t]);
+                            kline_redrawn |= kline->Ok;
                         }
-                        { // kline
-                            double high = kline->open[0];
-                            double low = kline->open[0];
-                            for (int j = 0; j < 20; j++)
-                            {
-                                if (kline->open[j] > high)
-                                    high = kline->open[j];
-                                if (kline->open[j] < low)
-                                    low = kline->open[j];
-                            }
-                            double step = (high - low) / 16;
-                            klineBitMapClear();
-                            for (int x = 0; x < 20; x++)
-                            {
-                                int y = (kline->open[x] - low) / step;
-                                if (true && x < 19)
-                                {
-                                    int y_next = (kline->open[x + 1] - low) / step;
-                                    int diff = abs(y - y_next);
-                                    if (diff > 1)
-                                    {
-                                        for (int _y = 1; _y < diff; _y++)
-                                        {
-                                            if (y > y_next)
-                                                klineSetPixel(x, y - _y);
-                                            else
-                                                klineSetPixel(x, y + _y);
-                                        }
-                                    }
-                                }
-                                klineSetPixel(x, y);
-                                if (x == 19)
-                                {
-                                    last_y = y;
-                                }
-                            }
-                            for (int j = 0; j < 8; j++)
-                            {
-                                lcd_create_char(j, klineBitMap[j]);
-                                vTaskDelay(20 / portTICK_PERIOD_MS);
-                            }
-                            for (int i = 0; i < 4; i++)
-                            {
-                                lcd_put_cur(0, i);
-                                lcd_send_data(i);
-                            }
-                            for (int i = 0; i < 4; i++)
-                            {
-                                lcd_put_cur(1, i);
-                                lcd_send_data(i + 4);
-                            }
+                    }
+                }
+#ifdef PRICE_STREAM_ENABLED
+                // Fold in every push, then draw each symbol that changed once
+                bool pushed[SYMBOL_MAX] = {0};
+                bool chart_moved[SYMBOL_MAX] = {0};
+                price_tick_t price;
+                while (xQueueReceive(stream_queue, &price, 0) == pdTRUE)
+                {
+                    int s = symbol_find(price.symbol);
+                    if (s < 0)
+                    {
+                        continue;
+                    }
+                    views[s].price = price.close;
+                    candle_apply_tick(&views[s].chart.candle, &price);
+                    chart_moved[s] |= views[s].chart.Ok && chart_apply_tick(&views[s].chart, &price);
+                    pushed[s] = true;
+                }
+                for (int t = 0; t < tag_count; t++)
+                {
+                    bool shown = false;
+                    bool moved = false;
+                    for (int s = 0; s < SYMBOL_COUNT; s++)
+                    {
+                        if (pushed[s] && (tags[t].page == s || MARQUEE_ENABLED))
+                        {
+                            shown = true;
+                            moved |= chart_moved[s];
                         }
                     }
-                    else
+                    if (!shown)
+                    {
+                        continue;
+                    }
+                    if (moved)
                     {
-                        lcd_backlight_on();
+                        draw_chart(&tags[t]);
+                        kline_redrawn = true;
                     }
-                    free(response.kline);
-                    response.kline = NULL;
+                    draw_price(&tags[t]);
+                    draw_field(&tags[t]);
                 }
-
-                if (response.update_kline >= 0)
+#endif
+                // Tags only rotate when there are too few to show every symbol
+                bool rotate = tick && !MARQUEE_ENABLED && SYMBOL_COUNT > tag_count &&
+                              i % (PAGE_ROTATE_MS / DISPLAY_TICK_MS) == 0;
+                for (int t = 0; t < tag_count; t++)
                 {
-                    if (i % 2 == 0)
+                    tag_t *tag = &tags[t];
+                    if (rotate)
                     {
-                        klineClearPixel(19, last_y);
+                        tag->page = (tag->page + 1) % SYMBOL_COUNT;
+                        draw_page(tag);
                     }
-                    else
+                    if (views[tag->page].chart.Ok && !MARQUEE_ENABLED)
                     {
-                        klineSetPixel(19, last_y);
+                        kline_chart_pixel(tag->glyphs, KLINE_CHART_WIDTH - 1, tag->last_y, i % 2 != 0);
+                        lcd_fb_put_glyph(tag->lcd, 0, 3, tag->glyphs[3]);
+                        lcd_fb_put_glyph(tag->lcd, 1, 3, tag->glyphs[7]);
                     }
-                    lcd_create_char(3, klineBitMap[3]);
-                    vTaskDelay(20 / portTICK_PERIOD_MS);
-                    lcd_create_char(7, klineBitMap[7]);
                 }
             }
-            else
+            else if (tick && wifi_screen)
             {
-                lcd_put_cur(1, 10);
-                switch (i % 4)
+                static const char *const dots[] = {"   ", ".  ", ".. ", "..."};
+                for (int t = 0; t < tag_count; t++)
                 {
-                case 0:
-                    lcd_send_string("   ");
-                    break;
-                case 1:
-                    lcd_send_string(".  ");
-                    break;
-                case 2:
-                    lcd_send_string(".. ");
-                    break;
-                case 3:
-                    lcd_send_string("...");
-                    break;
-                default:
-                    break;
+                    lcd_fb_put_string(tags[t].lcd, 1, 10, dots[i % 4]);
                 }
             }
         }
+
+        lcd_stats_t total = {0};
+        for (int t = 0; t < tag_count; t++)
+        {
+            lcd_fb_flush(tags[t].lcd);
+            lcd_stats_t stats;
+            lcd_get_stats(tags[t].lcd, &stats);
+            total.transactions += stats.transactions;
+            total.bytes += stats.bytes;
+        }
+        if (kline_redrawn)
+        {
+            ESP_LOGI(TAG, "lcd since boot: %lu i2c transactions, %lu bytes",
+                     (unsigned long)total.transactions, (unsigned long)total.bytes);
+        }
     }
 
     for (int i = 0;; i++)
     {
         vTaskDelay(500 / portTICK_PERIOD_MS);
-        if (i % 2 == 0)
-            lcd_backlight_on();
-        else
-            lcd_backlight_off();
+        for (int t = 0; t < tag_count; t++)
+        {
+            lcd_fb_backlight(tags[t].lcd, i % 2 == 0);
+            lcd_fb_flush(tags[t].lcd);
+        }
     }
 }
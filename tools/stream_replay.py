@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Replay recorded price stream frames over a WebSocket.
+
+Serves the same files the linux build replays, one frame per line, each
+after the number of milliseconds it starts with. Point the device at it
+with PRICE_STREAM_URI "ws://<this machine>:8765/ws". Every connection
+plays the file from the top and is closed after the last frame, so the
+device's reconnect path runs too. Standard library only.
+
+    python3 tools/stream_replay.py fixtures/stream.binance.com/ws
+"""
+
+import argparse
+import base64
+import hashlib
+import socket
+import struct
+import threading
+import time
+
+WS_GUID = b"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+
+def read_frames(path):
+    frames = []
+    with open(path) as f:
+        for line in f:
+            delay, _, text = line.strip().partition(" ")
+            if text:
+                frames.append((int(delay), text.encode()))
+    return frames
+
+
+def handshake(conn):
+    request = b""
+    while b"\r\n\r\n" not in request:
+        chunk = conn.recv(1024)
+        if not chunk:
+            return False
+        request += chunk
+    key = None
+    for line in request.split(b"\r\n"):
+        name, _, value = line.partition(b":")
+        if name.strip().lower() == b"sec-websocket-key":
+            key = value.strip()
+    if key is None:
+        return False
+    accept = base64.b64encode(hashlib.sha1(key + WS_GUID).digest())
+    conn.sendall(b"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                 b"Sec-WebSocket-Accept: " + accept + b"\r\n\r\n")
+    return True
+
+
+def send_frame(conn, opcode, payload):
+    header = bytes([0x80 | opcode])
+    if len(payload) < 126:
+        header += bytes([len(payload)])
+    elif len(payload) < 65536:
+        header += bytes([126]) + struct.pack(">H", len(payload))
+    else:
+        header += bytes([127]) + struct.pack(">Q", len(payload))
+    conn.sendall(header + payload)
+
+
+def answer_pings(conn):
+    """Reply to pings and drop everything else the client sends."""
+    try:
+        while True:
+            head = conn.recv(2)
+            if len(head) < 2:
+                return
+            opcode, length = head[0] & 0x0F, head[1] & 0x7F
+            if length == 126:
+                length = struct.unpack(">H", conn.recv(2))[0]
+            elif length == 127:
+                length = struct.unpack(">Q", conn.recv(8))[0]
+            mask = conn.recv(4) if head[1] & 0x80 else b"\0\0\0\0"
+            data = b""
+            while len(data) < length:
+                chunk = conn.recv(length - len(data))
+                if not chunk:
+                    return
+                data += chunk
+            data = bytes(b ^ mask[i % 4] for i, b in enumerate(data))
+            if opcode == 0x9:
+                send_frame(conn, 0xA, data)
+            elif opcode == 0x8:
+                return
+    except OSError:
+        pass
+
+
+def serve(conn, address, frames):
+    with conn:
+        if not handshake(conn):
+            return
+        print(f"{address[0]} connected")
+        threading.Thread(target=answer_pings, args=(conn,), daemon=True).start()
+        try:
+            for delay_ms, text in frames:
+                time.sleep(delay_ms / 1000)
+                send_frame(conn, 0x1, text)
+            send_frame(conn, 0x8, struct.pack(">H", 1000))
+        except OSError:
+            pass
+        print(f"{address[0]} done")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("frames", help="recorded frames, one per line after a delay in ms")
+    parser.add_argument("--port", type=int, default=8765)
+    args = parser.parse_args()
+    frames = read_frames(args.frames)
+    with socket.create_server(("", args.port)) as server:
+        print(f"Replaying {len(frames)} frames on ws://0.0.0.0:{args.port}/ws")
+        while True:
+            conn, address = server.accept()
+            threading.Thread(target=serve, args=(conn, address, frames), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()